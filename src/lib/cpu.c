@@ -13,6 +13,20 @@
 // limitations under the License.
 
 #include "cpu.h"
+#include "jit.h"
+#include "trace.h"
+
+#include <string.h>
+
+// Computed goto is a GCC/Clang extension, so fall back to the table-driven
+// core everywhere else
+#if defined(M6502_THREADED_DISPATCH) && !defined(__GNUC__)
+#undef M6502_THREADED_DISPATCH
+#endif
+
+#ifdef M6502_CYCLE_EXACT
+#undef M6502_THREADED_DISPATCH
+#endif
 
 #define STACK_START 0x0100
 #define STACK_END 0x01FF
@@ -24,10 +38,17 @@
 #define MSB 0x80
 #define LSB 0x1
 
-static u8 cycles;
+// Interrupts latched for the cycle-exact engine
+#define PENDING_IRQ 0x1
+#define PENDING_NMI 0x2
 
-static u16 addr;
-static u8 val;
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define NOINLINE __attribute__((noinline))
+#else
+#define ALWAYS_INLINE inline
+#define NOINLINE
+#endif
 
 typedef enum addr_mode {
     IMPLICIT,
@@ -45,10 +66,21 @@ typedef enum addr_mode {
     INDIRECT_INDEXED,
 } addr_mode_t;
 
+typedef enum access {
+    NONE,
+    READ,
+    WRITE,
+    READ_MODIFY_WRITE,
+} access_t;
+
 typedef struct instr {
     u8 cycles;
+    u1 legal;
     addr_mode_t addr_mode;
-    void (*exec_instruction)(cpu_t* cpu);
+    access_t access;
+    void (*exec_instruction)(cpu_t* cpu, const u16 addr, const u8 val);
+    u8 (*exec_fused)(cpu_t* cpu);
+    u8 (*exec_decoded)(cpu_t* cpu, u16 operand);
 } instr_t;
 
 // =================================================================================
@@ -56,44 +88,409 @@ typedef struct instr {
 // =================================================================================
 
 _Bool cpu_is_complete(cpu_t* cpu) {
-    return cycles == 0;
+#ifdef M6502_CYCLE_EXACT
+    return cpu->cycles == 0 && cpu->uop == NULL;
+#else
+    return cpu->cycles == 0;
+#endif
+}
+
+// Mapped pages are plain host memory and cost a single load or store. Only
+// unmapped pages (typically memory-mapped I/O) call out to the bus.
+// cpu_peek is a read that the profiler doesn't count as a data access, for
+// instruction fetches and for looking at code without running it.
+static ALWAYS_INLINE u8 cpu_peek(cpu_t* cpu, u16 addr) {
+    const u8* page = cpu->read_map[addr >> 8];
+    if(page)
+        return page[addr & 0xFF];
+#ifdef M6502_DEBUG
+    // Mapped, but left out of read_map for its watchpoints
+    page = cpu->debug.read_map[addr >> 8];
+    if(page)
+        return page[addr & 0xFF];
+#endif
+    return cpu->read_bus(cpu->bus, addr);
+}
+
+#ifdef M6502_TRACE
+
+// Code bytes for a record, read without going through the bus
+static ALWAYS_INLINE u8 cpu_trace_peek(cpu_t* cpu, u16 addr) {
+#ifdef M6502_DEBUG
+    const u8* page = cpu->debug.read_map[addr >> 8];
+#else
+    const u8* page = cpu->read_map[addr >> 8];
+#endif
+    return page ? page[addr & 0xFF] : 0;
+}
+
+static void cpu_trace_record(cpu_t* cpu, u8 kind, u64 cycle) {
+    const trace_record_t record = {
+        .cycle = cycle,
+        .addr = cpu->pc,
+        .kind = kind,
+        .data = {cpu_trace_peek(cpu, cpu->pc), cpu_trace_peek(cpu, cpu->pc + 1), cpu_trace_peek(cpu, cpu->pc + 2)},
+        .a = cpu->a,
+        .x = cpu->x,
+        .y = cpu->y,
+        .sp = cpu->sp,
+        .p = cpu_get_status(cpu),
+    };
+
+    trace_push(cpu->trace, &record);
+}
+
+// Record the instruction or interrupt about to start at the PC. Accesses
+// from here on are stamped with the same cycle.
+static ALWAYS_INLINE void cpu_trace(cpu_t* cpu, u8 kind, u64 cycle) {
+    cpu->trace_cycle = cycle;
+
+    if(cpu->trace)
+        cpu_trace_record(cpu, kind, cycle);
+}
+
+static ALWAYS_INLINE void cpu_trace_access(cpu_t* cpu, u8 kind, u16 addr, u8 val) {
+    if(cpu->trace && cpu->trace->bus) {
+        const trace_record_t record = {.cycle = cpu->trace_cycle, .addr = addr, .kind = kind, .data = {val}};
+        trace_push(cpu->trace, &record);
+    }
+}
+
+#endif
+
+#ifdef M6502_DEBUG
+
+#define DEBUG_BIT(bitmap, addr) ((bitmap)[(addr) >> 3] & (1 << ((addr) & 7)))
+
+static u8 cpu_debug_operand(cpu_t* cpu, const debug_cond_t* cond, u8 val) {
+    switch(cond->operand) {
+        case DEBUG_A:
+            return cpu->a;
+        case DEBUG_X:
+            return cpu->x;
+        case DEBUG_Y:
+            return cpu->y;
+        case DEBUG_SP:
+            return cpu->sp;
+        case DEBUG_P:
+            return cpu_get_status(cpu);
+        case DEBUG_MEM: {
+            const u8* page = cpu->debug.read_map[cond->addr >> 8];
+            return page ? page[cond->addr & 0xFF] : 0;
+        }
+        default:
+            return val;
+    }
+}
+
+static _Bool cpu_debug_cond(cpu_t* cpu, const debug_cond_t* cond, u8 val) {
+    if(cond->operand == DEBUG_ALWAYS)
+        return 1;
+
+    const u8 operand = cpu_debug_operand(cpu, cond, val);
+
+    switch(cond->compare) {
+        case DEBUG_EQ:
+            return operand == cond->value;
+        case DEBUG_NE:
+            return operand != cond->value;
+        case DEBUG_LT:
+            return operand < cond->value;
+        case DEBUG_GE:
+            return operand >= cond->value;
+        default:
+            return (operand & cond->value) != 0;
+    }
+}
+
+// Slow path, for addresses whose bit is set: count a hit on every
+// breakpoint that covers the access and whose condition holds, and stop
+// for the first one past its ignore count. Returns whether it stops.
+static NOINLINE _Bool cpu_debug_match(cpu_t* cpu, u8 kind, u16 addr, u8 val) {
+    cpu_debug_t* debug = &cpu->debug;
+    _Bool stop = 0;
+
+    for(u32 i = 0; i < DEBUG_MAX_BREAKPOINTS; ++i) {
+        cpu_breakpoint_t* breakpoint = &debug->breakpoints[i];
+
+        if(!(breakpoint->kinds & kind) || addr < breakpoint->start || addr > breakpoint->end)
+            continue;
+
+        if(!cpu_debug_cond(cpu, &breakpoint->cond, val) || ++breakpoint->hits <= breakpoint->ignore)
+            continue;
+
+        // An instruction can hit several, the first one is reported
+        if(!debug->stopped) {
+            debug->stopped = 1;
+            debug->stop_kind = kind;
+            debug->stop_val = val;
+            debug->stop_addr = addr;
+            debug->stop_index = i;
+        }
+
+        stop = 1;
+    }
+
+    // A data access lets its instruction finish, and the run stops before
+    // the next one
+    if(stop && kind != DEBUG_EXEC && !debug->flooded) {
+        memset(debug->dispatch_bitmap, 0xFF, sizeof(debug->dispatch_bitmap));
+        debug->flooded = 1;
+    }
+
+    return stop;
+}
+
+// Data accesses to pages with watchpoints, which read_map and write_map
+// leave out. Everything else doesn't pay for them.
+static NOINLINE u8 cpu_debug_read(cpu_t* cpu, u16 addr) {
+    const u8* page = cpu->debug.read_map[addr >> 8];
+    const u8 val = page ? page[addr & 0xFF] : cpu->read_bus(cpu->bus, addr);
+
+    if(DEBUG_BIT(cpu->debug.read_bitmap, addr))
+        cpu_debug_match(cpu, DEBUG_READ, addr, val);
+
+    return val;
+}
+
+static NOINLINE void cpu_debug_write(cpu_t* cpu, u16 addr, u8 val) {
+    u8* page = cpu->debug.write_map[addr >> 8];
+    if(page)
+        page[addr & 0xFF] = val;
+    else
+        cpu->write_bus(cpu->bus, addr, val);
+
+    if(DEBUG_BIT(cpu->debug.write_bitmap, addr))
+        cpu_debug_match(cpu, DEBUG_WRITE, addr, val);
 }
 
-static inline u16 cpu_read_word_from_bus(cpu_t* cpu, u16 addr) {
-    return cpu->read_bus(cpu->bus, addr) | (cpu->read_bus(cpu->bus, addr + 1) << 8);
+static NOINLINE _Bool cpu_debug_exec(cpu_t* cpu) {
+    cpu_debug_t* debug = &cpu->debug;
+
+    if(debug->stopped)
+        return 1;
+
+    if(debug->resume) {
+        debug->resume = 0;
+        if(cpu->pc == debug->stop_addr)
+            return 0;
+    }
+
+    return cpu_debug_match(cpu, DEBUG_EXEC, cpu->pc, 0);
+}
+
+// Checked before every instruction: whether to stop at the PC, or because
+// the instruction before hit a read or write breakpoint. Costs one bit
+// test while nothing is hit.
+static ALWAYS_INLINE _Bool cpu_debug_break(cpu_t* cpu) {
+    if(!DEBUG_BIT(cpu->debug.dispatch_bitmap, cpu->pc))
+        return 0;
+
+    return cpu_debug_exec(cpu);
+}
+
+#endif
+
+static ALWAYS_INLINE u8 cpu_read(cpu_t* cpu, u16 addr) {
+#ifdef M6502_PROFILE
+    cpu->profile.reads[addr]++;
+#endif
+
+#ifdef M6502_DEBUG
+    const u8* page = cpu->read_map[addr >> 8];
+    const u8 val = page ? page[addr & 0xFF] : cpu_debug_read(cpu, addr);
+#else
+    const u8 val = cpu_peek(cpu, addr);
+#endif
+
+#ifdef M6502_TRACE
+    cpu_trace_access(cpu, TRACE_READ, addr, val);
+#endif
+
+    return val;
+}
+
+#ifdef M6502_BLOCK_CACHE
+static void cpu_invalidate_code(cpu_t* cpu, u16 addr);
+static void cpu_flush_blocks(cpu_t* cpu);
+#endif
+
+static ALWAYS_INLINE void cpu_write(cpu_t* cpu, u16 addr, u8 val) {
+#ifdef M6502_PROFILE
+    cpu->profile.writes[addr]++;
+#endif
+
+#ifdef M6502_TRACE
+    cpu_trace_access(cpu, TRACE_WRITE, addr, val);
+#endif
+
+#ifdef M6502_BLOCK_CACHE
+    if(cpu->code_bitmap[addr >> 3] & (1 << (addr & 7)))
+        cpu_invalidate_code(cpu, addr);
+#endif
+
+    u8* page = cpu->write_map[addr >> 8];
+    if(page)
+        page[addr & 0xFF] = val;
+    else
+#ifdef M6502_DEBUG
+        cpu_debug_write(cpu, addr, val);
+#else
+        cpu->write_bus(cpu->bus, addr, val);
+#endif
+}
+
+void cpu_map(cpu_t* cpu, u16 start, u32 size, u8* read_mem, u8* write_mem) {
+    for(u32 offset = 0; offset < size; offset += CPU_PAGE_SIZE) {
+        const u8 page = (start + offset) >> 8;
+
+        cpu->read_map[page] = read_mem ? read_mem + offset : NULL;
+        cpu->write_map[page] = write_mem ? write_mem + offset : NULL;
+
+#ifdef M6502_DEBUG
+        cpu->debug.read_map[page] = cpu->read_map[page];
+        cpu->debug.write_map[page] = cpu->write_map[page];
+
+        if(cpu->debug.read_pages[page])
+            cpu->read_map[page] = NULL;
+        if(cpu->debug.write_pages[page])
+            cpu->write_map[page] = NULL;
+#endif
+    }
+
+#ifdef M6502_IDLE_SKIP
+    cpu->busy_valid = 0;
+#endif
+
+#ifdef M6502_BLOCK_CACHE
+    cpu_flush_blocks(cpu);
+#endif
+}
+
+static ALWAYS_INLINE u16 cpu_read_word_from_bus(cpu_t* cpu, u16 addr) {
+    return cpu_read(cpu, addr) | (cpu_read(cpu, addr + 1) << 8);
+}
+
+// Zero page pointers wrap within the zero page
+static ALWAYS_INLINE u16 cpu_read_zero_page_word(cpu_t* cpu, u8 addr) {
+    return cpu_read(cpu, addr) | (cpu_read(cpu, (u8)(addr + 1)) << 8);
 }
 
-static inline u8 cpu_fetch_byte(cpu_t* cpu) {
-    return cpu->read_bus(cpu->bus, cpu->pc++);
+static ALWAYS_INLINE u8 cpu_fetch_byte(cpu_t* cpu) {
+    return cpu_peek(cpu, cpu->pc++);
 }
 
-static inline u16 cpu_fetch_word(cpu_t* cpu) {
-    const u16 val =cpu_read_word_from_bus(cpu, cpu->pc);
+static ALWAYS_INLINE u16 cpu_fetch_word(cpu_t* cpu) {
+    const u16 val = cpu_peek(cpu, cpu->pc) | (cpu_peek(cpu, cpu->pc + 1) << 8);
     cpu->pc += 2;
     return val;
 }
 
 static inline void cpu_push(cpu_t* cpu, u8 byte) {
-    cpu->write_bus(cpu->bus, STACK_START + cpu->sp, byte);
+    cpu_write(cpu, STACK_START + cpu->sp, byte);
     --cpu->sp;
 }
 
 static inline u8 cpu_pop(cpu_t* cpu) {
     ++cpu->sp;
-    return cpu->read_bus(cpu->bus, STACK_START + cpu->sp);
+    return cpu_read(cpu, STACK_START + cpu->sp);
+}
+
+// =================================================================================
+// FLAGS
+// =================================================================================
+
+// Instructions only go through these for N, Z, C and V, so the lazy mode
+// can store the raw inputs and leave the work to whoever reads the flags.
+
+#ifdef M6502_LAZY_FLAGS
+
+static ALWAYS_INLINE void cpu_set_nz(cpu_t* cpu, u8 res) {
+    cpu->nz = res;
+}
+
+// N from bit 7 of n_src and Z from z_src. Bit 7 of z_src is folded into
+// bit 0 so it cannot leak into N, which matters for decimal ADC.
+static ALWAYS_INLINE void cpu_set_n_z(cpu_t* cpu, u8 n_src, u8 z_src) {
+    cpu->nz = (z_src & 0x7F) | (z_src >> 7) | ((n_src & MSB) << 1);
 }
 
+static ALWAYS_INLINE void cpu_set_c(cpu_t* cpu, u8 c) {
+    cpu->c = c;
+}
+
+static ALWAYS_INLINE void cpu_set_v(cpu_t* cpu, u8 v) {
+    cpu->v = v;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_c(cpu_t* cpu) {
+    return cpu->c;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_z(cpu_t* cpu) {
+    return (cpu->nz & 0xFF) == 0;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_v(cpu_t* cpu) {
+    return cpu->v != 0;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_n(cpu_t* cpu) {
+    return (cpu->nz & 0x180) != 0;
+}
+
+#else
+
+static ALWAYS_INLINE void cpu_set_nz(cpu_t* cpu, u8 res) {
+    cpu->p = (cpu->p & ~(STATUS_N | STATUS_Z)) | (res & STATUS_N) | (res == 0) << 1;
+}
+
+static ALWAYS_INLINE void cpu_set_n_z(cpu_t* cpu, u8 n_src, u8 z_src) {
+    cpu->p = (cpu->p & ~(STATUS_N | STATUS_Z)) | (n_src & STATUS_N) | (z_src == 0) << 1;
+}
+
+static ALWAYS_INLINE void cpu_set_c(cpu_t* cpu, u8 c) {
+    cpu->p = (cpu->p & ~STATUS_C) | (c != 0);
+}
+
+static ALWAYS_INLINE void cpu_set_v(cpu_t* cpu, u8 v) {
+    cpu->p = (cpu->p & ~STATUS_V) | (v != 0) << 6;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_c(cpu_t* cpu) {
+    return cpu->p & STATUS_C;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_z(cpu_t* cpu) {
+    return (cpu->p >> 1) & 1;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_v(cpu_t* cpu) {
+    return (cpu->p >> 6) & 1;
+}
+
+static ALWAYS_INLINE u1 cpu_flag_n(cpu_t* cpu) {
+    return cpu->p >> 7;
+}
+
+#endif
+
 void cpu_set_status(cpu_t* cpu, u8 byte) {
-    cpu->sr.c = byte & 0x1;
-    cpu->sr.z = (byte & 0x2) >> 1;
-    cpu->sr.i = (byte & 0x4) >> 2;
-    cpu->sr.d = (byte & 0x8) >> 3;
-    cpu->sr.v = (byte & 0x40) >> 6;
-    cpu->sr.n = (byte & MSB) >> 7;
+    cpu->p = (byte | STATUS_U) & ~STATUS_B;
+
+#ifdef M6502_LAZY_FLAGS
+    cpu_set_c(cpu, byte & STATUS_C);
+    cpu_set_n_z(cpu, byte, (byte & STATUS_Z) ^ STATUS_Z);
+    cpu_set_v(cpu, byte & STATUS_V);
+#endif
 }
 
 u8 cpu_get_status(cpu_t* cpu) {
-    return (cpu->sr.n << 7) | (cpu->sr.v << 6) | (1 << 5) | (cpu->sr.d << 3) | (cpu->sr.i << 2) | (cpu->sr.z << 1) | (cpu->sr.c);
+#ifdef M6502_LAZY_FLAGS
+    return (cpu->p & (STATUS_I | STATUS_D)) | STATUS_U | (cpu_flag_n(cpu) << 7) | (cpu_flag_v(cpu) << 6) | (cpu_flag_z(cpu) << 1) | cpu_flag_c(cpu);
+#else
+    return cpu->p;
+#endif
 }
 
 static inline void cpu_push_status(cpu_t* cpu) {
@@ -101,7 +498,7 @@ static inline void cpu_push_status(cpu_t* cpu) {
 }
 
 static inline void cpu_push_status_b(cpu_t* cpu) {
-    cpu_push(cpu, cpu_get_status(cpu) | 0x10);
+    cpu_push(cpu, cpu_get_status(cpu) | STATUS_B);
 }
 
 static inline void cpu_pop_status(cpu_t* cpu) {
@@ -113,419 +510,527 @@ static inline void cpu_pop_status(cpu_t* cpu) {
 // =================================================================================
 
 void cpu_reset(cpu_t* cpu) {
-    cpu->pc = cpu_read_word_from_bus(cpu->bus, RST_START);
+#ifdef M6502_BLOCK_CACHE
+    cpu_flush_blocks(cpu);
+#endif
+
+    cpu->pc = cpu_read_word_from_bus(cpu, RST_START);
 
     cpu->a = cpu->x = cpu->y = 0;
     cpu->sp = SP_START;
-    cpu->sr.c = 0;
-    cpu->sr.z = 0;
-    cpu->sr.i = 0;
-    cpu->sr.d = 0;
-    cpu->sr.v = 0;
-    cpu->sr.n = 0;
+    cpu_set_status(cpu, 0);
 
-    cycles = 7;
+#ifdef M6502_CYCLE_EXACT
+    // The reset sequence's own bus traffic is not modeled, it only takes
+    // its 7 cycles
+    cpu->uop = NULL;
+    cpu->pending = 0;
+#endif
+
+    cpu->cycles = 7;
 }
 
+// Hardware interrupts push P with B clear, which is how a handler tells
+// them apart from BRK
 void cpu_irq(cpu_t* cpu) {
-    if(cpu->sr.i == 1)
+    if(CPU_FLAG(cpu, STATUS_I))
+        return;
+
+#ifdef M6502_HALT_ON_KIL
+    // Only a reset gets a jammed CPU going again
+    if(cpu_is_jammed(cpu))
         return;
+#endif
+
+#ifdef M6502_CYCLE_EXACT
+    // Taken at the next instruction boundary, one bus access per cycle
+    cpu->pending |= PENDING_IRQ;
+#else
+#ifdef M6502_TRACE
+    cpu_trace(cpu, TRACE_IRQ, cpu->total_cycles);
+#endif
 
+    cpu_push(cpu, cpu->pc >> 8);
     cpu_push(cpu, cpu->pc & 0xFF);
-    cpu_push(cpu, (cpu->pc >> 8) & 0xFF);
 
-    cpu_push_status_b(cpu);
+    cpu_push_status(cpu);
 
-    cpu->pc = cpu_read_word_from_bus(cpu->bus, IRQ_START);
+    cpu->p |= STATUS_I;
+
+    cpu->pc = cpu_read_word_from_bus(cpu, IRQ_START);
 
-    cycles = 7;
+    // Comes after whatever cpu_clock still has left of the last instruction
+    cpu->cycles += 7;
+#endif
 }
 
 void cpu_nmi(cpu_t* cpu) {
+#ifdef M6502_HALT_ON_KIL
+    if(cpu_is_jammed(cpu))
+        return;
+#endif
+
+#ifdef M6502_CYCLE_EXACT
+    cpu->pending |= PENDING_NMI;
+#else
+#ifdef M6502_TRACE
+    cpu_trace(cpu, TRACE_NMI, cpu->total_cycles);
+#endif
+
+    cpu_push(cpu, cpu->pc >> 8);
     cpu_push(cpu, cpu->pc & 0xFF);
-    cpu_push(cpu, (cpu->pc >> 8) & 0xFF);
 
-    cpu_push_status_b(cpu);
+    cpu_push_status(cpu);
+
+    cpu->p |= STATUS_I;
 
-    cpu->pc = cpu_read_word_from_bus(cpu->bus, NMI_START);
+    cpu->pc = cpu_read_word_from_bus(cpu, NMI_START);
 
-    cycles = 7;
+    cpu->cycles += 7;
+#endif
 }
 
 // =================================================================================
 // ADDRESSING MODES
 // =================================================================================
 
-static void process_addr_mode(cpu_t* cpu, addr_mode_t addr_mode) {
+static ALWAYS_INLINE u8 addr_mode_size(const addr_mode_t addr_mode) {
+    switch(addr_mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+            return 0;
+        case ABSOLUTE:
+        case ABSOLUTE_X:
+        case ABSOLUTE_Y:
+        case INDIRECT:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Fetch the operand bytes that follow the opcode
+static ALWAYS_INLINE u16 fetch_operand(cpu_t* cpu, const addr_mode_t addr_mode) {
+    switch(addr_mode_size(addr_mode)) {
+        case 0:
+            return 0;
+        case 1:
+            return cpu_fetch_byte(cpu);
+        default:
+            return cpu_fetch_word(cpu);
+    }
+}
+
+// Returns the effective address for the given mode and raw operand, with the
+// PC already past the instruction. Every caller passes a constant mode, so
+// the switch folds down to just the work that mode needs.
+static ALWAYS_INLINE u16 process_addr_mode(cpu_t* cpu, const addr_mode_t addr_mode, const u16 operand) {
     switch(addr_mode) {
         case IMPLICIT:
-            break;
         case ACCUMULATOR:
-            val = cpu->a;
-            break;
         case IMMEDIATE:
-            val = cpu_fetch_byte(cpu);
-            break;
+            return 0;
         case ZERO_PAGE:
-            addr = cpu_fetch_byte(cpu);
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+        case ABSOLUTE:
+            return operand;
         case ZERO_PAGE_X:
-            addr = (cpu_fetch_byte(cpu) + cpu->x) & 0xFF;
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            return (operand + cpu->x) & 0xFF;
         case ZERO_PAGE_Y:
-            addr = (cpu_fetch_byte(cpu) + cpu->y) & 0xFF;
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            return (operand + cpu->y) & 0xFF;
         case RELATIVE:
-            addr = cpu->pc - 1 + (int8_t)cpu_fetch_byte(cpu);
-            break;
-        case ABSOLUTE:
-            addr = cpu_fetch_word(cpu) & 0xFFFF;
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            return cpu->pc + (int8_t)operand;
         case ABSOLUTE_X:
-            addr = (cpu_fetch_word(cpu) + cpu->x) & 0xFFFF;
-            val = cpu->read_bus(cpu->bus, addr);
-            break; 
+            return operand + cpu->x;
         case ABSOLUTE_Y:
-            addr = (cpu_fetch_word(cpu) + cpu->y) & 0xFFFF;
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            return operand + cpu->y;
         case INDIRECT:
-            addr = cpu_read_word_from_bus(cpu, cpu_fetch_word(cpu));
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            // The pointer's high byte is fetched without carrying into the
+            // page, so JMP ($xxFF) reads it from $xx00
+            return cpu_read(cpu, operand) | (cpu_read(cpu, (operand & 0xFF00) | ((operand + 1) & 0xFF)) << 8);
         case INDEXED_INDIRECT:
-            addr = cpu_read_word_from_bus(cpu, (cpu_fetch_byte(cpu) + cpu->x) & 0xFF);
-            val = cpu->read_bus(cpu->bus, addr);
-            break;
+            return cpu_read_zero_page_word(cpu, operand + cpu->x);
         case INDIRECT_INDEXED:
-            addr = cpu_read_word_from_bus(cpu, cpu_fetch_byte(cpu)) + cpu->y;
-            val = cpu->read_bus(cpu->bus, addr);
-            break; 
+            return cpu_read_zero_page_word(cpu, operand) + cpu->y;
     }
+
+    return 0;
+}
+
+// Only instructions that consume their operand read it. Stores would
+// otherwise issue a dummy read, which is a full bus callback for nothing.
+static ALWAYS_INLINE u8 process_operand(cpu_t* cpu, const addr_mode_t addr_mode, const access_t access, const u16 addr, const u16 operand) {
+    if(addr_mode == IMMEDIATE)
+        return operand;
+    if(access == READ || access == READ_MODIFY_WRITE)
+        return cpu_read(cpu, addr);
+    return 0;
 }
 
 // =================================================================================
 // INSTRUCTIONS
 // =================================================================================
 
-//To-Do: Implement decimal mode
-static void adc(cpu_t* cpu) {
-    const u16 sum = (u16)cpu->a + (u16)val + (u16)cpu->sr.c;
+static inline void adc_binary(cpu_t* cpu, const u8 val) {
+    const u16 sum = (u16)cpu->a + (u16)val + (u16)cpu_flag_c(cpu);
 
-    cpu->sr.c = sum > 255;
-    cpu->sr.v = ~(cpu->a ^ val) & (cpu->a ^ sum) & MSB;
+    cpu_set_c(cpu, sum > 255);
+    cpu_set_v(cpu, ~(cpu->a ^ val) & (cpu->a ^ sum) & MSB);
 
     cpu->a = (u8)sum;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
+}
+
+#ifndef M6502_NO_DECIMAL
+
+// Decimal mode on the NMOS 6502 adjusts each digit separately, without
+// checking that the inputs are valid BCD. Only the low digit's adjustment
+// is irregular, so it comes from these tables instead of a chain of tests.
+
+// Low digit of an add, indexed by the sum of both low nibbles and carry.
+// 0x10 and up carries into the high digit.
+static const u8 bcd_add_lo[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+    0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+};
+
+// Low digit of a subtract, indexed by the difference of both low nibbles
+// minus borrow, modulo 32. Negative values borrow from the high digit.
+static const int8_t bcd_sub_lo[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    -0x06, -0x05, -0x04, -0x03, -0x02, -0x01, -0x10, -0x0F, -0x0E, -0x0D, -0x0C, -0x0B, -0x0A, -0x09, -0x08, -0x07,
+};
+
+// Z comes from the binary sum, N and V from the result before the high
+// digit is adjusted, and C from the adjusted result
+static inline void adc_decimal(cpu_t* cpu, const u8 val) {
+    const u1 carry = cpu_flag_c(cpu);
+    const u8 a = cpu->a;
+
+    u16 res = (a & 0xF0) + (val & 0xF0) + bcd_add_lo[(a & 0x0F) + (val & 0x0F) + carry];
+
+    cpu_set_n_z(cpu, res, a + val + carry);
+    cpu_set_v(cpu, ~(a ^ val) & (a ^ res) & MSB);
+
+    if(res >= 0xA0)
+        res += 0x60;
+
+    cpu_set_c(cpu, res > 0xFF);
+
+    cpu->a = (u8)res;
+}
+
+// All flags are those of the binary subtract
+static inline void sbc_decimal(cpu_t* cpu, const u8 val) {
+    const u1 carry = cpu_flag_c(cpu);
+    const u8 a = cpu->a;
+
+    adc_binary(cpu, ~val);
+
+    int16_t res = (a & 0xF0) - (val & 0xF0) + bcd_sub_lo[((a & 0x0F) - (val & 0x0F) - !carry) & 0x1F];
+
+    if(res < 0)
+        res -= 0x60;
+
+    cpu->a = (u8)res;
 }
 
-static void and(cpu_t* cpu) {
+#endif
+
+static inline void adc(cpu_t* cpu, const u16 addr, const u8 val) {
+#ifndef M6502_NO_DECIMAL
+    if(CPU_FLAG(cpu, STATUS_D)) {
+        adc_decimal(cpu, val);
+        return;
+    }
+#endif
+
+    adc_binary(cpu, val);
+}
+
+static inline void and(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a &= val;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void asl_acc(cpu_t* cpu) {
-    cpu->sr.c = cpu->a & MSB;
+static inline void asl_acc(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, cpu->a & MSB);
 
     cpu->a <<= 1;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void asl(cpu_t* cpu) {
-    cpu->sr.c = val & MSB;
+static inline void asl(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val << 1;
 
-    cpu->write_bus(cpu->bus, addr, val << 1);
+    cpu_set_c(cpu, val & MSB);
 
-    cpu->sr.z = (val << 1) == 0;
-    cpu->sr.n = (val << 1) & MSB;
+    cpu_write(cpu, addr, res);
+
+    cpu_set_nz(cpu, res);
 }
 
-static void bcc(cpu_t* cpu) {
-    if(cpu->sr.c == 0)
+static inline void bcc(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(!cpu_flag_c(cpu))
         cpu->pc = addr;
 }
 
-static void bcs(cpu_t* cpu) {
-    if(cpu->sr.c == 1)
+static inline void bcs(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(cpu_flag_c(cpu))
         cpu->pc = addr;
 }
 
-static void beq(cpu_t* cpu) {
-    if(cpu->sr.z == 1)
+static inline void beq(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(cpu_flag_z(cpu))
         cpu->pc = addr;
 }
 
-static void bit(cpu_t* cpu) {
+static inline void bit(cpu_t* cpu, const u16 addr, const u8 val) {
     u8 res = cpu->a & val;
 
-    cpu->sr.z = res == 0;
-    cpu->sr.v = val & 0x40;
-    cpu->sr.n = val & MSB;
+    cpu_set_v(cpu, val & 0x40);
+    cpu_set_n_z(cpu, val, res);
 }
 
-static void bmi(cpu_t* cpu) {
-    if(cpu->sr.n == 1)
+static inline void bmi(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(cpu_flag_n(cpu))
         cpu->pc = addr;
 }
 
-static void bne(cpu_t* cpu) {
-    if(cpu->sr.z == 0)
+static inline void bne(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(!cpu_flag_z(cpu))
         cpu->pc = addr;
 }
 
-static void bpl(cpu_t* cpu) {
-    if(cpu->sr.n == 0)
+static inline void bpl(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(!cpu_flag_n(cpu))
         cpu->pc = addr;
 }
 
-static void brk(cpu_t* cpu) {
+static inline void brk(cpu_t* cpu, const u16 addr, const u8 val) {
     ++cpu->pc;
     cpu_push(cpu, cpu->pc >> 8);
     cpu_push(cpu, cpu->pc & 0xFF);
 
     cpu_push_status_b(cpu);
 
-    cpu->sr.i = 1;
+    cpu->p |= STATUS_I;
 
     cpu->pc = cpu_read_word_from_bus(cpu, IRQ_START);
 }
 
-static void bvc(cpu_t* cpu) {
-    if(cpu->sr.v == 0)
+static inline void bvc(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(!cpu_flag_v(cpu))
         cpu->pc = addr;
 }
 
-static void bvs(cpu_t* cpu) {
-    if(cpu->sr.v == 1)
+static inline void bvs(cpu_t* cpu, const u16 addr, const u8 val) {
+    if(cpu_flag_v(cpu))
         cpu->pc = addr;
 }
 
-static void clc(cpu_t* cpu) {
-    cpu->sr.c = 0;
+static inline void clc(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, 0);
 }
 
-static void cld(cpu_t* cpu) {
-    cpu->sr.d = 0;
+static inline void cld(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->p &= ~STATUS_D;
 }
 
-static void cli(cpu_t* cpu) {
-    cpu->sr.i = 0;
+static inline void cli(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->p &= ~STATUS_I;
 }
 
-static void clv(cpu_t* cpu) {
-    cpu->sr.v = 0;
+static inline void clv(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_v(cpu, 0);
 }
 
-static void cmp(cpu_t* cpu) {
-    cpu->sr.c = cpu->a >= val;
-    cpu->sr.z = cpu->a == val;
-    cpu->sr.n = ((u8)(cpu->a - val)) & MSB;
+static inline void cmp(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, cpu->a >= val);
+    cpu_set_nz(cpu, cpu->a - val);
 }
 
-static void cpx(cpu_t* cpu) {
-    cpu->sr.c = cpu->x >= val;
-    cpu->sr.z = cpu->x == val;
-    cpu->sr.n = ((u8)(cpu->x - val)) & MSB;
+static inline void cpx(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, cpu->x >= val);
+    cpu_set_nz(cpu, cpu->x - val);
 }
 
-static void cpy(cpu_t* cpu) {
-    cpu->sr.c = cpu->y >= val;
-    cpu->sr.z = cpu->y == val;
-    cpu->sr.n = ((u8)(cpu->y - val)) & MSB;
+static inline void cpy(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, cpu->y >= val);
+    cpu_set_nz(cpu, cpu->y - val);
 }
 
-static void dec(cpu_t* cpu) {
-    cpu->write_bus(cpu->bus, addr, cpu->read_bus(cpu->bus, addr) - 1);
+static inline void dec(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val - 1;
+
+    cpu_write(cpu, addr, res);
 
-    cpu->sr.z = cpu->read_bus(cpu->bus, addr) == 0;
-    cpu->sr.n = cpu->read_bus(cpu->bus, addr) & MSB;
+    cpu_set_nz(cpu, res);
 }
 
-static void dex(cpu_t* cpu) {
+static inline void dex(cpu_t* cpu, const u16 addr, const u8 val) {
     --cpu->x;
 
-    cpu->sr.z = cpu->x == 0;
-    cpu->sr.n = cpu->x & MSB;
+    cpu_set_nz(cpu, cpu->x);
 }
 
-static void dey(cpu_t* cpu) {
+static inline void dey(cpu_t* cpu, const u16 addr, const u8 val) {
     --cpu->y;
 
-    cpu->sr.z = cpu->y == 0;
-    cpu->sr.n = cpu->y & MSB;
+    cpu_set_nz(cpu, cpu->y);
 }
 
-static void eor(cpu_t* cpu) {
+static inline void eor(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a ^= val;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void inc(cpu_t* cpu) {
-    cpu->write_bus(cpu->bus, addr, cpu->read_bus(cpu->bus, addr) + 1);
+static inline void inc(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val + 1;
 
-    cpu->sr.z = cpu->read_bus(cpu->bus, addr) == 0;
-    cpu->sr.n = cpu->read_bus(cpu->bus, addr) & MSB;
+    cpu_write(cpu, addr, res);
+
+    cpu_set_nz(cpu, res);
 }
 
-static void inx(cpu_t* cpu) {
+static inline void inx(cpu_t* cpu, const u16 addr, const u8 val) {
     ++cpu->x;
 
-    cpu->sr.z = cpu->x == 0;
-    cpu->sr.n = cpu->x & MSB;
+    cpu_set_nz(cpu, cpu->x);
 }
 
-static void iny(cpu_t* cpu) {
+static inline void iny(cpu_t* cpu, const u16 addr, const u8 val) {
     ++cpu->y;
 
-    cpu->sr.z = cpu->y == 0;
-    cpu->sr.n = cpu->y & MSB;
+    cpu_set_nz(cpu, cpu->y);
 }
 
-static void jmp(cpu_t* cpu) {
+static inline void jmp(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->pc = addr;
 }
 
-static void jsr(cpu_t* cpu) {
+static inline void jsr(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu_push(cpu, (cpu->pc - 1) >> 8);
     cpu_push(cpu, (cpu->pc - 1) & 0xFF);
     cpu->pc = addr;
 }
 
-static void lda(cpu_t* cpu) {
+static inline void lda(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a = val;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void ldx(cpu_t* cpu) {
+static inline void ldx(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->x = val;
 
-    cpu->sr.z = cpu->x == 0;
-    cpu->sr.n = cpu->x & MSB;
+    cpu_set_nz(cpu, cpu->x);
 }
 
-static void ldy(cpu_t* cpu) {
+static inline void ldy(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->y = val;
 
-    cpu->sr.z = cpu->y == 0;
-    cpu->sr.n = cpu->y & MSB;
+    cpu_set_nz(cpu, cpu->y);
 }
 
-static void lsr_acc(cpu_t* cpu) {
-    cpu->sr.c = cpu->a & LSB;
+static inline void lsr_acc(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, cpu->a & LSB);
 
     cpu->a >>= 1;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void lsr(cpu_t* cpu) {
-    cpu->sr.c = val & LSB;
+static inline void lsr(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val >> 1;
+
+    cpu_set_c(cpu, val & LSB);
 
-    cpu->write_bus(cpu->bus, addr, val >> 1);
+    cpu_write(cpu, addr, res);
 
-    cpu->sr.z = (val >> 1) == 0;
-    cpu->sr.n = (val >> 1) & MSB;
+    cpu_set_nz(cpu, res);
 }
 
-static void nop(cpu_t* cpu) {
-    ++cpu->pc;
-};
+static inline void nop(cpu_t* cpu, const u16 addr, const u8 val) {
+}
 
-static void ora(cpu_t* cpu) {
+static inline void ora(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a |= val;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void pha(cpu_t* cpu) {
+static inline void pha(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu_push(cpu, cpu->a);
 }
 
-static void php(cpu_t* cpu) {
+static inline void php(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu_push_status_b(cpu);
 }
 
-static void pla(cpu_t* cpu) {
+static inline void pla(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a = cpu_pop(cpu);
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void plp(cpu_t* cpu) {
+static inline void plp(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu_pop_status(cpu);
 }
 
-static void rol_acc(cpu_t* cpu) {
-    const u1 old_carry = cpu->sr.c;
+static inline void rol_acc(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u1 old_carry = cpu_flag_c(cpu);
 
-    cpu->sr.c = cpu->a & MSB;
+    cpu_set_c(cpu, cpu->a & MSB);
 
     cpu->a = (cpu->a << 1) | old_carry;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void rol(cpu_t* cpu) {
-    const u1 old_carry = cpu->sr.c;
+static inline void rol(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = (val << 1) | cpu_flag_c(cpu);
 
-    cpu->sr.c = val & MSB;
+    cpu_set_c(cpu, val & MSB);
 
-    cpu->write_bus(cpu->bus, addr, (val << 1) | old_carry);
+    cpu_write(cpu, addr, res);
 
-    cpu->sr.z = ((val << 1) | old_carry) == 0;
-    cpu->sr.n = ((val << 1) | old_carry) & MSB;
+    cpu_set_nz(cpu, res);
 }
 
-static void ror_acc(cpu_t* cpu) {
-    const u1 old_carry = cpu->sr.c;
+static inline void ror_acc(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u1 old_carry = cpu_flag_c(cpu);
 
-    cpu->sr.c = cpu->a & LSB;
+    cpu_set_c(cpu, cpu->a & LSB);
     
     cpu->a = (cpu->a >> 1) | (old_carry << 7);
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void ror(cpu_t* cpu) {
-    const u1 old_carry = cpu->sr.c;
+static inline void ror(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = (val >> 1) | (cpu_flag_c(cpu) << 7);
 
-    cpu->sr.c = val & LSB;
-    
-    cpu->write_bus(cpu->bus, addr, (val >> 1) | (old_carry << 7));
+    cpu_set_c(cpu, val & LSB);
 
-    cpu->sr.z = ((val >> 1) | (old_carry << 7)) == 0;
-    cpu->sr.n = ((val >> 1) | (old_carry << 7)) & MSB;
+    cpu_write(cpu, addr, res);
+
+    cpu_set_nz(cpu, res);
 }
 
-static void rti(cpu_t* cpu) {
+static inline void rti(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu_pop_status(cpu);
 
-    const u8 hi = cpu_pop(cpu);
     const u8 lo = cpu_pop(cpu);
+    const u8 hi = cpu_pop(cpu);
 
     cpu->pc = (hi << 8) | lo;
 }
 
-static void rts(cpu_t* cpu) {
+static inline void rts(cpu_t* cpu, const u16 addr, const u8 val) {
     const u8 lo = cpu_pop(cpu);
     const u8 hi = cpu_pop(cpu);
 
@@ -533,353 +1038,1597 @@ static void rts(cpu_t* cpu) {
     cpu->pc++;
 }
 
-static void sbc(cpu_t* cpu) {
-    val = ~val;
-    adc(cpu);
+static inline void sbc(cpu_t* cpu, const u16 addr, const u8 val) {
+#ifndef M6502_NO_DECIMAL
+    if(CPU_FLAG(cpu, STATUS_D)) {
+        sbc_decimal(cpu, val);
+        return;
+    }
+#endif
+
+    adc_binary(cpu, ~val);
 }
 
-static void sec(cpu_t* cpu) {
-    cpu->sr.c = 1;
+static inline void sec(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_set_c(cpu, 1);
 }
 
-static void sed(cpu_t* cpu) {
-    cpu->sr.d = 1;
+static inline void sed(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->p |= STATUS_D;
 }
 
-static void sei(cpu_t* cpu) {
-    cpu->sr.i = 1;
+static inline void sei(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->p |= STATUS_I;
 }
 
-static void sta(cpu_t* cpu) {
-    cpu->write_bus(cpu->bus, addr, cpu->a);
+static inline void sta(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write(cpu, addr, cpu->a);
 }
 
-static void stx(cpu_t* cpu) {
-    cpu->write_bus(cpu->bus, addr, cpu->x);
+static inline void stx(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write(cpu, addr, cpu->x);
 }
 
-static void sty(cpu_t* cpu) {
-    cpu->write_bus(cpu->bus, addr, cpu->y);
+static inline void sty(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write(cpu, addr, cpu->y);
 }
 
-static void tax(cpu_t* cpu) {
+static inline void tax(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->x = cpu->a;
 
-    cpu->sr.z = cpu->x == 0;
-    cpu->sr.n = cpu->x & MSB;
+    cpu_set_nz(cpu, cpu->x);
 }
 
-static void tay(cpu_t* cpu) {
+static inline void tay(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->y = cpu->a;
 
-    cpu->sr.z = cpu->y == 0;
-    cpu->sr.n = cpu->y & MSB;
+    cpu_set_nz(cpu, cpu->y);
 }
 
-static void tsx(cpu_t* cpu) {
+static inline void tsx(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->x = cpu->sp;
 
-    cpu->sr.z = cpu->x == 0;
-    cpu->sr.n = cpu->x & MSB;
+    cpu_set_nz(cpu, cpu->x);
 }
 
-static void txa(cpu_t* cpu) {
+static inline void txa(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a = cpu->x;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
-static void txs(cpu_t* cpu) {
+static inline void txs(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->sp = cpu->x;
 }
 
-static void tya(cpu_t* cpu) {
+static inline void tya(cpu_t* cpu, const u16 addr, const u8 val) {
     cpu->a = cpu->y;
 
-    cpu->sr.z = cpu->a == 0;
-    cpu->sr.n = cpu->a & MSB;
+    cpu_set_nz(cpu, cpu->a);
 }
 
 // =================================================================================
-// OPCODES
+// UNDOCUMENTED INSTRUCTIONS
 // =================================================================================
 
-static instr_t opcode_table[NUM_MAX_OPCODES] = {
-    {.exec_instruction = brk, .addr_mode = IMPLICIT, .cycles = 7},          //0x00 
-    {.exec_instruction = ora, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0x01
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x02
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x03
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x04
-    {.exec_instruction = ora, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x05
-    {.exec_instruction = asl, .addr_mode = ZERO_PAGE, .cycles = 5},         //0x06
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x07
-    {.exec_instruction = php, .addr_mode = IMPLICIT, .cycles = 3},          //0x08
-    {.exec_instruction = ora, .addr_mode = IMMEDIATE, .cycles = 2},         //0x09
-    {.exec_instruction = asl_acc, .addr_mode = ACCUMULATOR, .cycles = 2},   //0x0A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x0B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x0C
-    {.exec_instruction = ora, .addr_mode = ABSOLUTE, .cycles = 4},          //0x0D
-    {.exec_instruction = asl, .addr_mode = ABSOLUTE, .cycles = 6},          //0x0E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x0F
-    {.exec_instruction = bpl, .addr_mode = RELATIVE, .cycles = 2},          //0x10
-    {.exec_instruction = ora, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0x11
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x12
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x13
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x14
-    {.exec_instruction = ora, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0x15
-    {.exec_instruction = asl, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0x16
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x17
-    {.exec_instruction = clc, .addr_mode = IMPLICIT, .cycles = 2},          //0x18
-    {.exec_instruction = ora, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0x19
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x1A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x1B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x1C
-    {.exec_instruction = ora, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0x1D
-    {.exec_instruction = asl, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0x1E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x1F
-    {.exec_instruction = jsr, .addr_mode = ABSOLUTE, .cycles = 6},          //0x20
-    {.exec_instruction = and, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0x21
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x22   
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x23     
-    {.exec_instruction = bit, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x24
-    {.exec_instruction = and, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x25
-    {.exec_instruction = rol, .addr_mode = ZERO_PAGE, .cycles = 5},         //0x26
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x27
-    {.exec_instruction = plp, .addr_mode = IMPLICIT, .cycles = 4},          //0x28
-    {.exec_instruction = and, .addr_mode = IMMEDIATE, .cycles = 2},         //0x29
-    {.exec_instruction = rol_acc, .addr_mode = ACCUMULATOR, .cycles = 2},   //0x2A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x2B
-    {.exec_instruction = bit, .addr_mode = ABSOLUTE, .cycles = 4},          //0x2C
-    {.exec_instruction = and, .addr_mode = ABSOLUTE, .cycles = 4},          //0x2D
-    {.exec_instruction = rol, .addr_mode = ABSOLUTE, .cycles = 6},          //0x2E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x2F
-    {.exec_instruction = bmi, .addr_mode = RELATIVE, .cycles = 2},          //0x30
-    {.exec_instruction = and, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0x31
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x32
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x33
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x34
-    {.exec_instruction = and, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x35
-    {.exec_instruction = rol, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0x36
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x37
-    {.exec_instruction = sec, .addr_mode = IMPLICIT, .cycles = 2},          //0x38
-    {.exec_instruction = and, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0x39
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x3A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x3B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x3C
-    {.exec_instruction = and, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0x3D
-    {.exec_instruction = rol, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0x3E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x3F
-    {.exec_instruction = rti, .addr_mode = IMPLICIT, .cycles = 6},          //0x40
-    {.exec_instruction = eor, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0x41
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x42
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x43
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x44
-    {.exec_instruction = eor, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x45
-    {.exec_instruction = lsr, .addr_mode = ZERO_PAGE, .cycles = 5},         //0x46
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x47
-    {.exec_instruction = pha, .addr_mode = IMPLICIT, .cycles = 3},          //0x48
-    {.exec_instruction = eor, .addr_mode = IMMEDIATE, .cycles = 2},         //0x49
-    {.exec_instruction = lsr_acc, .addr_mode = ACCUMULATOR, .cycles = 2},   //0x4A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x4B
-    {.exec_instruction = jmp, .addr_mode = ABSOLUTE, .cycles = 3},          //0x4C
-    {.exec_instruction = eor, .addr_mode = ABSOLUTE, .cycles = 4},          //0x4D
-    {.exec_instruction = lsr, .addr_mode = ABSOLUTE, .cycles = 6},          //0x4E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x4F
-    {.exec_instruction = bvc, .addr_mode = RELATIVE, .cycles = 2},          //0x50
-    {.exec_instruction = eor, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0x51
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x52
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x53
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x54
-    {.exec_instruction = eor, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0x55
-    {.exec_instruction = lsr, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0x56
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x57
-    {.exec_instruction = cli, .addr_mode = IMPLICIT, .cycles = 2},          //0x58
-    {.exec_instruction = eor, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0x59
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x5A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x5B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x5C
-    {.exec_instruction = eor, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0x5D
-    {.exec_instruction = lsr, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0x5E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x5F
-    {.exec_instruction = rts, .addr_mode = IMPLICIT, .cycles = 6},          //0x60
-    {.exec_instruction = adc, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0x61
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x62
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x63
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x64
-    {.exec_instruction = adc, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x65
-    {.exec_instruction = ror, .addr_mode = ZERO_PAGE, .cycles = 5},         //0x66
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x67
-    {.exec_instruction = pla, .addr_mode = IMPLICIT, .cycles = 4},          //0x68
-    {.exec_instruction = adc, .addr_mode = IMMEDIATE, .cycles = 2},         //0x69
-    {.exec_instruction = ror_acc, .addr_mode = ACCUMULATOR, .cycles = 2},   //0x6A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x6B
-    {.exec_instruction = jmp, .addr_mode = INDIRECT, .cycles = 5},          //0x6C
-    {.exec_instruction = adc, .addr_mode = ABSOLUTE, .cycles = 4},          //0x6D
-    {.exec_instruction = ror, .addr_mode = ABSOLUTE, .cycles = 6},          //0x6E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x6F
-    {.exec_instruction = bvs, .addr_mode = RELATIVE, .cycles = 2},          //0x70
-    {.exec_instruction = adc, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0x71
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x72
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x73
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x74
-    {.exec_instruction = adc, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0x75
-    {.exec_instruction = ror, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0x76
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x77
-    {.exec_instruction = sei, .addr_mode = IMPLICIT, .cycles = 2},          //0x78
-    {.exec_instruction = adc, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0x79
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x7A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x7B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x7C
-    {.exec_instruction = adc, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0x7D
-    {.exec_instruction = ror, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0x7E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x7F
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x80
-    {.exec_instruction = sta, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0x81
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x82
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x83
-    {.exec_instruction = sty, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x84
-    {.exec_instruction = sta, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x85
-    {.exec_instruction = stx, .addr_mode = ZERO_PAGE, .cycles = 3},         //0x86
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x87
-    {.exec_instruction = dey, .addr_mode = IMPLICIT, .cycles = 2},          //0x88
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x89
-    {.exec_instruction = txa, .addr_mode = IMPLICIT, .cycles = 2},          //0x8A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x8B
-    {.exec_instruction = sty, .addr_mode = ABSOLUTE, .cycles = 4},          //0x8C
-    {.exec_instruction = sta, .addr_mode = ABSOLUTE, .cycles = 4},          //0x8D
-    {.exec_instruction = stx, .addr_mode = ABSOLUTE, .cycles = 4},          //0x8E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x8F
-    {.exec_instruction = bcc, .addr_mode = RELATIVE, .cycles = 2},          //0x90
-    {.exec_instruction = sta, .addr_mode = INDIRECT_INDEXED, .cycles = 6},  //0x91
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x92
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x93
-    {.exec_instruction = sty, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0x94
-    {.exec_instruction = sta, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0x95
-    {.exec_instruction = stx, .addr_mode = ZERO_PAGE_Y, .cycles = 4},       //0x96
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x97
-    {.exec_instruction = tya, .addr_mode = IMPLICIT, .cycles = 2},          //0x98
-    {.exec_instruction = sta, .addr_mode = ABSOLUTE_Y, .cycles = 5},        //0x99
-    {.exec_instruction = txs, .addr_mode = IMPLICIT, .cycles = 2},          //0x9A
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x9B
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x9C
-    {.exec_instruction = sta, .addr_mode = ABSOLUTE_X, .cycles = 5},        //0x9D
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x9E
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0x9F
-    {.exec_instruction = ldy, .addr_mode = IMMEDIATE, .cycles = 2},         //0xA0
-    {.exec_instruction = lda, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0xA1
-    {.exec_instruction = ldx, .addr_mode = IMMEDIATE, .cycles = 2},         //0xA2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xA3
-    {.exec_instruction = ldy, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xA4
-    {.exec_instruction = lda, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xA5
-    {.exec_instruction = ldx, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xA6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xA7
-    {.exec_instruction = tay, .addr_mode = IMPLICIT, .cycles = 2},          //0xA8
-    {.exec_instruction = lda, .addr_mode = IMMEDIATE, .cycles = 2},         //0xA9
-    {.exec_instruction = tax, .addr_mode = IMPLICIT, .cycles = 2},          //0xAA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xAB
-    {.exec_instruction = ldy, .addr_mode = ABSOLUTE, .cycles = 4},          //0xAC
-    {.exec_instruction = lda, .addr_mode = ABSOLUTE, .cycles = 4},          //0xAD
-    {.exec_instruction = ldx, .addr_mode = ABSOLUTE, .cycles = 4},          //0xAE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xAF
-    {.exec_instruction = bcs, .addr_mode = RELATIVE, .cycles = 2},          //0xB0
-    {.exec_instruction = lda, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0xB1
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xB2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xB3
-    {.exec_instruction = ldy, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0xB4
-    {.exec_instruction = lda, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0xB5
-    {.exec_instruction = ldx, .addr_mode = ZERO_PAGE_Y, .cycles = 4},       //0xB6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xB7
-    {.exec_instruction = clv, .addr_mode = IMPLICIT, .cycles = 2},          //0xB8
-    {.exec_instruction = lda, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0xB9
-    {.exec_instruction = tsx, .addr_mode = IMPLICIT, .cycles = 2},          //0xBA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xBB
-    {.exec_instruction = ldy, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0xBC
-    {.exec_instruction = lda, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0xBD
-    {.exec_instruction = ldx, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0xBE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xBF
-    {.exec_instruction = cpy, .addr_mode = IMMEDIATE, .cycles = 2},         //0xC0
-    {.exec_instruction = cmp, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0xC1
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xC2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xC3
-    {.exec_instruction = cpy, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xC4
-    {.exec_instruction = cmp, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xC5
-    {.exec_instruction = dec, .addr_mode = ZERO_PAGE, .cycles = 5},         //0xC6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xC7
-    {.exec_instruction = iny, .addr_mode = IMPLICIT, .cycles = 2},          //0xC8
-    {.exec_instruction = cmp, .addr_mode = IMMEDIATE, .cycles = 2},         //0xC9
-    {.exec_instruction = dex, .addr_mode = IMPLICIT, .cycles = 2},          //0xCA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xCB
-    {.exec_instruction = cpy, .addr_mode = ABSOLUTE, .cycles = 4},          //0xCC
-    {.exec_instruction = cmp, .addr_mode = ABSOLUTE, .cycles = 4},          //0xCD
-    {.exec_instruction = dec, .addr_mode = ABSOLUTE, .cycles = 6},          //0xCE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xCF
-    {.exec_instruction = bne, .addr_mode = RELATIVE, .cycles = 2},          //0xD0
-    {.exec_instruction = cmp, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0xD1
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xD2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xD3
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xD4
-    {.exec_instruction = cmp, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0xD5
-    {.exec_instruction = dec, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0xD6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xD7
-    {.exec_instruction = cld, .addr_mode = IMPLICIT, .cycles = 2},          //0xD8
-    {.exec_instruction = cmp, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0xD9
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xDA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xDB
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xDC
-    {.exec_instruction = cmp, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0xDD
-    {.exec_instruction = dec, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0xDE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xDF
-    {.exec_instruction = cpx, .addr_mode = IMMEDIATE, .cycles = 2},         //0xE0
-    {.exec_instruction = sbc, .addr_mode = INDEXED_INDIRECT, .cycles = 6},  //0xE1
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xE2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xE3
-    {.exec_instruction = cpx, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xE4
-    {.exec_instruction = sbc, .addr_mode = ZERO_PAGE, .cycles = 3},         //0xE5
-    {.exec_instruction = inc, .addr_mode = ZERO_PAGE, .cycles = 5},         //0xE6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xE7
-    {.exec_instruction = inx, .addr_mode = IMPLICIT, .cycles = 2},          //0xE8
-    {.exec_instruction = sbc, .addr_mode = IMMEDIATE, .cycles = 2},         //0xE9
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xEA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xEB
-    {.exec_instruction = cpx, .addr_mode = ABSOLUTE, .cycles = 4},          //0xEC
-    {.exec_instruction = sbc, .addr_mode = ABSOLUTE, .cycles = 4},          //0xED
-    {.exec_instruction = inc, .addr_mode = ABSOLUTE, .cycles = 6},          //0xEE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xEF
-    {.exec_instruction = beq, .addr_mode = RELATIVE, .cycles = 2},          //0xF0
-    {.exec_instruction = sbc, .addr_mode = INDIRECT_INDEXED, .cycles = 5},  //0xF1
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xF2
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xF3
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xF4
-    {.exec_instruction = sbc, .addr_mode = ZERO_PAGE_X, .cycles = 4},       //0xF5
-    {.exec_instruction = inc, .addr_mode = ZERO_PAGE_X, .cycles = 6},       //0xF6
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xF7
-    {.exec_instruction = sed, .addr_mode = IMPLICIT, .cycles = 2},          //0xF8
-    {.exec_instruction = sbc, .addr_mode = ABSOLUTE_Y, .cycles = 4},        //0xF9
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xFA
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xFB
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xFC
-    {.exec_instruction = sbc, .addr_mode = ABSOLUTE_X, .cycles = 4},        //0xFD
-    {.exec_instruction = inc, .addr_mode = ABSOLUTE_X, .cycles = 7},        //0xFE
-    {.exec_instruction = nop, .addr_mode = IMPLICIT, .cycles = 2},          //0xFF
-};
+// What ANE and LXA OR into A first. It varies between chips and with
+// temperature; 0xEE is the value most test suites expect.
+#define UNSTABLE_MAGIC 0xEE
 
-_Bool cpu_is_illegal(cpu_t* cpu) {
-    if(cycles == 0)
-        return opcode_table[cpu->read_bus(cpu->bus, cpu->pc)].exec_instruction == nop;
-    return 0;
+static inline void alr(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a &= val;
+
+    lsr_acc(cpu, addr, val);
 }
 
-void cpu_clock(cpu_t* cpu) {
-    if(cycles == 0) {
-        const u8 opcode = cpu_fetch_byte(cpu);
+static inline void anc(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a &= val;
+
+    cpu_set_c(cpu, cpu->a & MSB);
+    cpu_set_nz(cpu, cpu->a);
+}
+
+static inline void ane(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a = (cpu->a | UNSTABLE_MAGIC) & cpu->x & val;
+
+    cpu_set_nz(cpu, cpu->a);
+}
+
+// AND, then ROR A with C and V taken from bits 6 and 5 of the result. In
+// decimal mode the digits of the result also get adjusted, and C comes from
+// the high digit's adjustment instead.
+static inline void arr(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 and_res = cpu->a & val;
+    const u8 res = (and_res >> 1) | (cpu_flag_c(cpu) << 7);
+
+    cpu_set_nz(cpu, res);
+    cpu_set_v(cpu, (res ^ (res << 1)) & 0x40);
+
+#ifndef M6502_NO_DECIMAL
+    if(CPU_FLAG(cpu, STATUS_D)) {
+        u8 adjusted = res;
 
-        cycles = opcode_table[opcode].cycles;
+        if((and_res & 0x0F) + (and_res & 0x01) > 5)
+            adjusted = (adjusted & 0xF0) | ((adjusted + 6) & 0x0F);
 
-        process_addr_mode(cpu, opcode_table[opcode].addr_mode);
+        const u1 carry = (and_res & 0xF0) + (and_res & 0x10) > 0x50;
+        if(carry)
+            adjusted += 0x60;
 
-        opcode_table[opcode].exec_instruction(cpu);
+        cpu_set_c(cpu, carry);
+        cpu->a = adjusted;
+        return;
     }
+#endif
+
+    cpu_set_c(cpu, res & 0x40);
+    cpu->a = res;
+}
+
+static inline void dcp(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val - 1;
+
+    cpu_write(cpu, addr, res);
+
+    cmp(cpu, addr, res);
+}
+
+static inline void isc(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val + 1;
+
+    cpu_write(cpu, addr, res);
+
+    sbc(cpu, addr, res);
+}
+
+// KIL/JAM lock up an NMOS 6502 until reset. By default they run as one-byte
+// NOPs. With M6502_HALT_ON_KIL the PC stays on the opcode, so the CPU keeps
+// running it and goes nowhere.
+static inline void kil(cpu_t* cpu, const u16 addr, const u8 val) {
+#ifdef M6502_HALT_ON_KIL
+    --cpu->pc;
+#endif
+}
+
+static inline void las(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a = cpu->x = cpu->sp = val & cpu->sp;
+
+    cpu_set_nz(cpu, cpu->a);
+}
+
+static inline void lax(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a = cpu->x = val;
+
+    cpu_set_nz(cpu, cpu->a);
+}
+
+static inline void lxa(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->a = cpu->x = (cpu->a | UNSTABLE_MAGIC) & val;
+
+    cpu_set_nz(cpu, cpu->a);
+}
+
+static inline void rla(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = (val << 1) | cpu_flag_c(cpu);
+
+    cpu_set_c(cpu, val & MSB);
+
+    cpu_write(cpu, addr, res);
+
+    and(cpu, addr, res);
+}
+
+static inline void rra(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = (val >> 1) | (cpu_flag_c(cpu) << 7);
+
+    cpu_set_c(cpu, val & LSB);
+
+    cpu_write(cpu, addr, res);
+
+    adc(cpu, addr, res);
+}
+
+static inline void sax(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write(cpu, addr, cpu->a & cpu->x);
+}
+
+static inline void sbx(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 and_res = cpu->a & cpu->x;
+
+    cpu_set_c(cpu, and_res >= val);
+
+    cpu->x = and_res - val;
+
+    cpu_set_nz(cpu, cpu->x);
+}
+
+// The indexed stores below AND their value with the high byte of the
+// unindexed address plus one. When indexing carried into the high byte,
+// that value also replaces the high byte of the address.
+static inline void cpu_write_unstable(cpu_t* cpu, u16 addr, const u8 index, u8 val) {
+    const u16 base = addr - index;
+
+    val &= (base >> 8) + 1;
+
+    if((base ^ addr) & 0xFF00)
+        addr = (val << 8) | (addr & 0xFF);
+
+    cpu_write(cpu, addr, val);
+}
+
+static inline void sha(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write_unstable(cpu, addr, cpu->y, cpu->a & cpu->x);
+}
+
+static inline void shx(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write_unstable(cpu, addr, cpu->y, cpu->x);
+}
+
+static inline void shy(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu_write_unstable(cpu, addr, cpu->x, cpu->y);
+}
+
+static inline void slo(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val << 1;
+
+    cpu_set_c(cpu, val & MSB);
+
+    cpu_write(cpu, addr, res);
+
+    ora(cpu, addr, res);
+}
+
+static inline void sre(cpu_t* cpu, const u16 addr, const u8 val) {
+    const u8 res = val >> 1;
+
+    cpu_set_c(cpu, val & LSB);
+
+    cpu_write(cpu, addr, res);
+
+    eor(cpu, addr, res);
+}
 
-    cycles--;
+static inline void tas(cpu_t* cpu, const u16 addr, const u8 val) {
+    cpu->sp = cpu->a & cpu->x;
+
+    cpu_write_unstable(cpu, addr, cpu->y, cpu->sp);
+}
+
+// =================================================================================
+// OPCODES
+// =================================================================================
+
+// One fused handler per opcode: addressing mode, operand access, operation
+// and cycle count are all compile-time constants here, so e.g. LDA #imm is
+// just a fetch and a register write. exec_XX runs the instruction from an
+// already fetched operand, which lets pre-decoded blocks skip the fetch.
+#define OPCODE(op, instr, mode, access, cyc, legal) \
+    static ALWAYS_INLINE u8 exec_##op(cpu_t* cpu, const u16 operand) { \
+        const u16 addr = process_addr_mode(cpu, mode, operand); \
+        instr(cpu, addr, process_operand(cpu, mode, access, addr, operand)); \
+        return cyc; \
+    } \
+    \
+    static ALWAYS_INLINE u8 op_##op(cpu_t* cpu) { \
+        return exec_##op(cpu, fetch_operand(cpu, mode)); \
+    }
+#include "opcodes.h"
+
+static const instr_t opcode_table[NUM_MAX_OPCODES] = {
+#define OPCODE(op, instr, mode, acc, cyc, leg) [op] = {.exec_instruction = instr, .exec_fused = op_##op, .exec_decoded = exec_##op, .addr_mode = mode, .access = acc, .cycles = cyc, .legal = leg},
+#include "opcodes.h"
+};
+
+_Bool cpu_is_illegal(cpu_t* cpu) {
+    if(cpu_is_complete(cpu))
+        return !opcode_table[cpu_peek(cpu, cpu->pc)].legal;
+    return 0;
+}
+
+_Bool cpu_is_jammed(cpu_t* cpu) {
+    if(cpu_is_complete(cpu))
+        return opcode_table[cpu_peek(cpu, cpu->pc)].exec_instruction == kil;
+    return 0;
+}
+
+#ifdef M6502_OPCODE_STATS
+
+static ALWAYS_INLINE void cpu_count_opcode(cpu_t* cpu, u8 opcode) {
+    cpu->stats.pairs[cpu->stats.last][opcode] += cpu->stats.primed;
+    cpu->stats.opcodes[opcode]++;
+    cpu->stats.last = opcode;
+    cpu->stats.primed = 1;
+}
+
+#endif
+
+// Fetch the opcode of the next instruction, counting it in stats builds
+static ALWAYS_INLINE u8 cpu_fetch_opcode(cpu_t* cpu) {
+    const u8 opcode = cpu_fetch_byte(cpu);
+
+#ifdef M6502_OPCODE_STATS
+    cpu_count_opcode(cpu, opcode);
+#endif
+
+    return opcode;
+}
+
+#ifdef M6502_PROFILE
+
+// Charge an instruction that started at pc to the heat map, passing its
+// cycles through
+static ALWAYS_INLINE u8 cpu_profile_exec(cpu_t* cpu, u16 pc, u8 cycles) {
+    cpu->profile.exec[pc]++;
+    cpu->profile.cycles[pc] += cycles;
+    return cycles;
+}
+
+#endif
+
+// Execute one whole instruction and return how many cycles it takes
+static inline u8 cpu_step(cpu_t* cpu) {
+#ifdef M6502_PROFILE
+    const u16 pc = cpu->pc;
+    return cpu_profile_exec(cpu, pc, opcode_table[cpu_fetch_opcode(cpu)].exec_fused(cpu));
+#else
+    return opcode_table[cpu_fetch_opcode(cpu)].exec_fused(cpu);
+#endif
+}
+
+#ifndef M6502_CYCLE_EXACT
+
+void cpu_clock(cpu_t* cpu) {
+    if(cpu->cycles == 0) {
+#ifdef M6502_TRACE
+        cpu_trace(cpu, TRACE_INSTR, cpu->total_cycles);
+#endif
+
+        cpu->cycles = cpu_step(cpu);
+        ++cpu->total_instructions;
+    }
+
+    cpu->cycles--;
+    ++cpu->total_cycles;
+}
+
+#endif
+
+// =================================================================================
+// IDLE LOOPS
+// =================================================================================
+
+#ifdef M6502_IDLE_SKIP
+
+#define IDLE_MAX_INSTRS 8
+
+// Instructions allowed in an idle loop body: they never write memory and
+// their only reads are of their operand
+static _Bool idle_safe(const instr_t* instr) {
+    void (*const exec)(cpu_t*, const u16, const u8) = instr->exec_instruction;
+
+    if(instr->access == READ)
+        return exec == lda || exec == ldx || exec == ldy || exec == lax || exec == bit
+            || exec == cmp || exec == cpx || exec == cpy || exec == and || exec == ora || exec == nop;
+
+    return exec == tax || exec == tay || exec == txa || exec == tya || exec == tsx || exec == txs
+        || exec == clc || exec == sec || exec == cli || exec == sei || exec == cld || exec == sed
+        || exec == clv || exec == nop;
+}
+
+static _Bool idle_readable(cpu_t* cpu, u16 addr, u32 size) {
+    for(u32 i = 0; i < size; ++i) {
+        const u16 a = addr + i;
+
+        if(!cpu->read_map[a >> 8] && !(cpu->stable_bitmap[a >> 3] & (1 << (a & 7))))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Whether the operand read can only hit mapped memory or stable addresses.
+// Indexed reads have to be safe for any index, and pointers are rejected
+// since whatever they point at can change between runs.
+static _Bool idle_operand_readable(cpu_t* cpu, const addr_mode_t addr_mode, const u16 operand) {
+    switch(addr_mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+        case IMMEDIATE:
+            return 1;
+        case ZERO_PAGE:
+        case ABSOLUTE:
+            return idle_readable(cpu, operand, 1);
+        case ZERO_PAGE_X:
+        case ZERO_PAGE_Y:
+            return idle_readable(cpu, 0x0000, CPU_PAGE_SIZE);
+        case ABSOLUTE_X:
+        case ABSOLUTE_Y:
+            return idle_readable(cpu, operand, CPU_PAGE_SIZE);
+        default:
+            return 0;
+    }
+}
+
+// If head starts a straight run of safe instructions that ends by jumping
+// or branching back to head, return its length in instructions, else 0.
+// Only code in mapped memory is looked at, like the block cache does.
+static u8 cpu_idle_body(cpu_t* cpu, u16 head) {
+    u32 addr = head;
+
+    for(u8 len = 1; len <= IDLE_MAX_INSTRS; ++len) {
+        // Loops that wrap past $FFFF are left to the interpreter, like
+        // blocks are
+        if(addr >= 0x10000)
+            return 0;
+
+        const u8* page = cpu->read_map[addr >> 8];
+        if(!page)
+            return 0;
+
+        const instr_t* instr = &opcode_table[page[addr & 0xFF]];
+        const u32 size = 1 + addr_mode_size(instr->addr_mode);
+
+        if(addr + size > 0x10000 || !cpu->read_map[(addr + size - 1) >> 8])
+            return 0;
+
+        u16 operand = 0;
+        if(size > 1)
+            operand = cpu_peek(cpu, addr + 1);
+        if(size > 2)
+            operand |= cpu_peek(cpu, addr + 2) << 8;
+
+        if(instr->addr_mode == RELATIVE)
+            return (u16)(addr + size + (int8_t)operand) == head ? len : 0;
+
+        if(instr->exec_instruction == jmp)
+            return instr->addr_mode == ABSOLUTE && operand == head ? len : 0;
+
+#ifdef M6502_HALT_ON_KIL
+        if(instr->exec_instruction == kil)
+            return addr == head ? len : 0;
+#endif
+
+        if(!idle_safe(instr) || !idle_operand_readable(cpu, instr->addr_mode, operand))
+            return 0;
+
+        addr += size;
+    }
+
+    return 0;
+}
+
+// Run one iteration of the len-instruction idle loop at the PC. If it comes
+// back to the same registers and flags, every further iteration is
+// identical, so skip as many whole ones as fit in what is left of the cycle
+// budget and instruction count. The partial iteration at the end is left to
+// the caller, which keeps the result identical to interpreting the loop.
+static u32 cpu_idle_skip(cpu_t* cpu, u8 len, u32 budget, u32* n) {
+    const u16 head = cpu->pc;
+    const u8 a = cpu->a, x = cpu->x, y = cpu->y, sp = cpu->sp;
+    const u8 status = cpu_get_status(cpu);
+
+    u32 elapsed = 0;
+
+#ifdef M6502_OPCODE_STATS
+    u8 body[IDLE_MAX_INSTRS];
+#endif
+
+    for(u8 i = 0; i < len; ++i) {
+        if(elapsed >= budget || *n == 0)
+            return elapsed;
+
+        elapsed += cpu_step(cpu);
+        --*n;
+
+#ifdef M6502_OPCODE_STATS
+        body[i] = cpu->stats.last;
+#endif
+    }
+
+    if(elapsed >= budget || cpu->pc != head
+        || cpu->a != a || cpu->x != x || cpu->y != y || cpu->sp != sp || cpu_get_status(cpu) != status)
+        return elapsed;
+
+    const u32 iter_cycles = elapsed;
+    u32 iters = (budget - elapsed - 1) / iter_cycles;
+    if(iters > *n / len)
+        iters = *n / len;
+
+    *n -= iters * len;
+
+#ifdef M6502_OPCODE_STATS
+    // Each skipped iteration runs the body once more, starting with the
+    // pair that closes the loop
+    for(u8 i = 0; i < len; ++i) {
+        cpu->stats.opcodes[body[i]] += iters;
+        cpu->stats.pairs[body[(i + len - 1) % len]][body[i]] += iters;
+    }
+#endif
+
+    return elapsed + iters * iter_cycles;
+}
+
+// The block cache marks idle loops once when decoding them, the other
+// cores look for one whenever a control transfer lands further back
+#ifndef M6502_BLOCK_CACHE
+
+static ALWAYS_INLINE _Bool cpu_idle_known_busy(cpu_t* cpu, u16 head) {
+    const u8 slot = head & (IDLE_BUSY_SIZE - 1);
+
+    return (cpu->busy_valid & (1 << slot)) && cpu->busy_pc[slot] == head;
+}
+
+static u32 cpu_idle_check(cpu_t* cpu, u32 elapsed, u32 budget, u32* n) {
+    if(elapsed >= budget)
+        return 0;
+
+    const u8 len = cpu_idle_body(cpu, cpu->pc);
+    if(len == 0) {
+        const u8 slot = cpu->pc & (IDLE_BUSY_SIZE - 1);
+
+        cpu->busy_pc[slot] = cpu->pc;
+        cpu->busy_valid |= 1 << slot;
+        return 0;
+    }
+
+    return cpu_idle_skip(cpu, len, budget - elapsed, n);
+}
+
+// Instructions that can close an idle loop, constant per opcode
+#ifdef M6502_HALT_ON_KIL
+#define IDLE_CANDIDATE(instr, mode) ((mode) == RELATIVE || (instr) == jmp || (instr) == kil)
+#else
+#define IDLE_CANDIDATE(instr, mode) ((mode) == RELATIVE || (instr) == jmp)
+#endif
+
+#endif
+
+#endif
+
+// =================================================================================
+// CYCLE-EXACT ENGINE
+// =================================================================================
+
+#ifdef M6502_CYCLE_EXACT
+
+// One cycle each, and each does exactly one bus access, dummy reads and
+// writes included. An instruction is its opcode fetch followed by the
+// sequence for its addressing mode and access, or by a sequence of its own
+// for stack and control flow instructions. The work itself is still done by
+// the instruction handlers, which make the final access themselves for
+// stores, read-modify-writes, pushes and pulls.
+typedef enum micro_op {
+    UOP_DONE,
+
+    // Operand and pointer fetches
+    UOP_FETCH_LO,       // addr = read(pc++)
+    UOP_FETCH_HI,       // addr |= read(pc++) << 8
+    UOP_FETCH_HI_X,     // same, then index addr, base keeps the uncarried sum
+    UOP_FETCH_HI_Y,
+    UOP_ZERO_PAGE_X,    // dummy read of addr, then index it within the zero page
+    UOP_ZERO_PAGE_Y,
+    UOP_FETCH_PTR,      // ptr = read(pc++)
+    UOP_PTR_X,          // dummy read of ptr, then ptr += x
+    UOP_PTR_LO,         // addr = read(ptr)
+    UOP_PTR_HI,         // addr |= read(ptr + 1) << 8
+    UOP_PTR_HI_Y,       // same, then index addr by y
+
+    // Operand access
+    UOP_IMPLIED,        // dummy read of pc, execute
+    UOP_IMMEDIATE,      // execute with read(pc++)
+    UOP_READ,           // execute with read(addr)
+    UOP_READ_CARRY,     // read(base), the operand unless the index carried
+    UOP_READ_BASE,      // dummy read of base
+    UOP_READ_DATA,      // data = read(addr)
+    UOP_WRITE_DATA,     // dummy write of data back to addr
+    UOP_EXECUTE,        // execute with data, the handler makes the access
+
+    // Branches
+    UOP_BRANCH,         // fetch the offset, done unless taken
+    UOP_BRANCH_TAKEN,   // dummy read of pc, move within the page
+    UOP_BRANCH_CARRY,   // dummy read of pc, fix the high byte
+
+    // Jumps, stack and interrupts
+    UOP_JMP,            // pc = addr | read(pc) << 8
+    UOP_LATCH,          // data = read(addr)
+    UOP_JMP_INDIRECT,   // pc = data | read(addr + 1) << 8, without page carry
+    UOP_READ_PC,        // dummy read of pc
+    UOP_INC_PC,         // dummy read of pc, then ++pc
+    UOP_BRK_PAD,        // skip the byte after BRK
+    UOP_READ_STACK,     // dummy read of the stack top
+    UOP_PUSH_PCH,
+    UOP_PUSH_PCL,
+    UOP_PUSH_STATUS,    // B clear, then set I
+    UOP_PUSH_STATUS_B,  // B set, then set I
+    UOP_PULL_STATUS,
+    UOP_PULL_PCL,
+    UOP_PULL_PCH,
+} micro_op_t;
+
+static const u8 seq_implied[] = {UOP_IMPLIED, UOP_DONE};
+static const u8 seq_immediate[] = {UOP_IMMEDIATE, UOP_DONE};
+
+static const u8 seq_zero_page_read[] = {UOP_FETCH_LO, UOP_READ, UOP_DONE};
+static const u8 seq_zero_page_write[] = {UOP_FETCH_LO, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_zero_page_rmw[] = {UOP_FETCH_LO, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_zero_page_x_read[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_X, UOP_READ, UOP_DONE};
+static const u8 seq_zero_page_x_write[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_X, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_zero_page_x_rmw[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_X, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_zero_page_y_read[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_Y, UOP_READ, UOP_DONE};
+static const u8 seq_zero_page_y_write[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_Y, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_zero_page_y_rmw[] = {UOP_FETCH_LO, UOP_ZERO_PAGE_Y, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_absolute_read[] = {UOP_FETCH_LO, UOP_FETCH_HI, UOP_READ, UOP_DONE};
+static const u8 seq_absolute_write[] = {UOP_FETCH_LO, UOP_FETCH_HI, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_absolute_rmw[] = {UOP_FETCH_LO, UOP_FETCH_HI, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+// Reads only take the extra cycle when the index carries into the high
+// byte, writes and read-modify-writes always do
+static const u8 seq_absolute_x_read[] = {UOP_FETCH_LO, UOP_FETCH_HI_X, UOP_READ_CARRY, UOP_READ, UOP_DONE};
+static const u8 seq_absolute_x_write[] = {UOP_FETCH_LO, UOP_FETCH_HI_X, UOP_READ_BASE, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_absolute_x_rmw[] = {UOP_FETCH_LO, UOP_FETCH_HI_X, UOP_READ_BASE, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_absolute_y_read[] = {UOP_FETCH_LO, UOP_FETCH_HI_Y, UOP_READ_CARRY, UOP_READ, UOP_DONE};
+static const u8 seq_absolute_y_write[] = {UOP_FETCH_LO, UOP_FETCH_HI_Y, UOP_READ_BASE, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_absolute_y_rmw[] = {UOP_FETCH_LO, UOP_FETCH_HI_Y, UOP_READ_BASE, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_indexed_indirect_read[] = {UOP_FETCH_PTR, UOP_PTR_X, UOP_PTR_LO, UOP_PTR_HI, UOP_READ, UOP_DONE};
+static const u8 seq_indexed_indirect_write[] = {UOP_FETCH_PTR, UOP_PTR_X, UOP_PTR_LO, UOP_PTR_HI, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_indexed_indirect_rmw[] = {UOP_FETCH_PTR, UOP_PTR_X, UOP_PTR_LO, UOP_PTR_HI, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_indirect_indexed_read[] = {UOP_FETCH_PTR, UOP_PTR_LO, UOP_PTR_HI_Y, UOP_READ_CARRY, UOP_READ, UOP_DONE};
+static const u8 seq_indirect_indexed_write[] = {UOP_FETCH_PTR, UOP_PTR_LO, UOP_PTR_HI_Y, UOP_READ_BASE, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_indirect_indexed_rmw[] = {UOP_FETCH_PTR, UOP_PTR_LO, UOP_PTR_HI_Y, UOP_READ_BASE, UOP_READ_DATA, UOP_WRITE_DATA, UOP_EXECUTE, UOP_DONE};
+
+static const u8 seq_relative[] = {UOP_BRANCH, UOP_BRANCH_TAKEN, UOP_BRANCH_CARRY, UOP_DONE};
+static const u8 seq_jmp[] = {UOP_FETCH_LO, UOP_JMP, UOP_DONE};
+static const u8 seq_jmp_indirect[] = {UOP_FETCH_LO, UOP_FETCH_HI, UOP_LATCH, UOP_JMP_INDIRECT, UOP_DONE};
+static const u8 seq_jsr[] = {UOP_FETCH_LO, UOP_READ_STACK, UOP_PUSH_PCH, UOP_PUSH_PCL, UOP_JMP, UOP_DONE};
+static const u8 seq_rts[] = {UOP_READ_PC, UOP_READ_STACK, UOP_PULL_PCL, UOP_PULL_PCH, UOP_INC_PC, UOP_DONE};
+static const u8 seq_rti[] = {UOP_READ_PC, UOP_READ_STACK, UOP_PULL_STATUS, UOP_PULL_PCL, UOP_PULL_PCH, UOP_DONE};
+static const u8 seq_brk[] = {UOP_BRK_PAD, UOP_PUSH_PCH, UOP_PUSH_PCL, UOP_PUSH_STATUS_B, UOP_LATCH, UOP_JMP_INDIRECT, UOP_DONE};
+static const u8 seq_push[] = {UOP_READ_PC, UOP_EXECUTE, UOP_DONE};
+static const u8 seq_pull[] = {UOP_READ_PC, UOP_READ_STACK, UOP_EXECUTE, UOP_DONE};
+
+// IRQ and NMI, starting with the opcode fetch they replace
+static const u8 seq_interrupt[] = {UOP_READ_PC, UOP_READ_PC, UOP_PUSH_PCH, UOP_PUSH_PCL, UOP_PUSH_STATUS, UOP_LATCH, UOP_JMP_INDIRECT, UOP_DONE};
+
+static const u8* const micro_sequences[INDIRECT_INDEXED + 1][READ_MODIFY_WRITE + 1] = {
+    [IMPLICIT] = {[NONE] = seq_implied},
+    [ACCUMULATOR] = {[NONE] = seq_implied},
+    [IMMEDIATE] = {[READ] = seq_immediate},
+    [ZERO_PAGE] = {[READ] = seq_zero_page_read, [WRITE] = seq_zero_page_write, [READ_MODIFY_WRITE] = seq_zero_page_rmw},
+    [ZERO_PAGE_X] = {[READ] = seq_zero_page_x_read, [WRITE] = seq_zero_page_x_write, [READ_MODIFY_WRITE] = seq_zero_page_x_rmw},
+    [ZERO_PAGE_Y] = {[READ] = seq_zero_page_y_read, [WRITE] = seq_zero_page_y_write, [READ_MODIFY_WRITE] = seq_zero_page_y_rmw},
+    [RELATIVE] = {[NONE] = seq_relative},
+    [ABSOLUTE] = {[NONE] = seq_jmp, [READ] = seq_absolute_read, [WRITE] = seq_absolute_write, [READ_MODIFY_WRITE] = seq_absolute_rmw},
+    [ABSOLUTE_X] = {[READ] = seq_absolute_x_read, [WRITE] = seq_absolute_x_write, [READ_MODIFY_WRITE] = seq_absolute_x_rmw},
+    [ABSOLUTE_Y] = {[READ] = seq_absolute_y_read, [WRITE] = seq_absolute_y_write, [READ_MODIFY_WRITE] = seq_absolute_y_rmw},
+    [INDIRECT] = {[NONE] = seq_jmp_indirect},
+    [INDEXED_INDIRECT] = {[READ] = seq_indexed_indirect_read, [WRITE] = seq_indexed_indirect_write, [READ_MODIFY_WRITE] = seq_indexed_indirect_rmw},
+    [INDIRECT_INDEXED] = {[READ] = seq_indirect_indexed_read, [WRITE] = seq_indirect_indexed_write, [READ_MODIFY_WRITE] = seq_indirect_indexed_rmw},
+};
+
+static const u8* cpu_micro_sequence(const instr_t* instr) {
+    void (*const exec)(cpu_t*, const u16, const u8) = instr->exec_instruction;
+
+    if(exec == jsr)
+        return seq_jsr;
+    if(exec == rts)
+        return seq_rts;
+    if(exec == rti)
+        return seq_rti;
+    if(exec == brk)
+        return seq_brk;
+    if(exec == pha || exec == php)
+        return seq_push;
+    if(exec == pla || exec == plp)
+        return seq_pull;
+
+    return micro_sequences[instr->addr_mode][instr->access];
+}
+
+// Branch opcodes encode their condition: bits 7-6 pick N, V, C or Z and
+// bit 5 is the value that takes the branch
+static inline _Bool cpu_branch_taken(cpu_t* cpu, u8 opcode) {
+    u1 flag;
+    switch(opcode >> 6) {
+        case 0:
+            flag = cpu_flag_n(cpu);
+            break;
+        case 1:
+            flag = cpu_flag_v(cpu);
+            break;
+        case 2:
+            flag = cpu_flag_c(cpu);
+            break;
+        default:
+            flag = cpu_flag_z(cpu);
+            break;
+    }
+
+    return flag == ((opcode >> 5) & 1);
+}
+
+// Index addr and remember where the read would land without the carry
+static inline void cpu_micro_index(cpu_t* cpu, u8 index) {
+    cpu->base = (cpu->addr & 0xFF00) | ((cpu->addr + index) & 0xFF);
+    cpu->addr += index;
+}
+
+static void cpu_micro_op(cpu_t* cpu) {
+    void (*const exec)(cpu_t*, const u16, const u8) = opcode_table[cpu->opcode].exec_instruction;
+
+    switch(*cpu->uop++) {
+        case UOP_FETCH_LO:
+            cpu->addr = cpu_fetch_byte(cpu);
+            break;
+        case UOP_FETCH_HI:
+            cpu->addr |= cpu_fetch_byte(cpu) << 8;
+            break;
+        case UOP_FETCH_HI_X:
+            cpu->addr |= cpu_fetch_byte(cpu) << 8;
+            cpu_micro_index(cpu, cpu->x);
+            break;
+        case UOP_FETCH_HI_Y:
+            cpu->addr |= cpu_fetch_byte(cpu) << 8;
+            cpu_micro_index(cpu, cpu->y);
+            break;
+        case UOP_ZERO_PAGE_X:
+            cpu_read(cpu, cpu->addr);
+            cpu->addr = (u8)(cpu->addr + cpu->x);
+            break;
+        case UOP_ZERO_PAGE_Y:
+            cpu_read(cpu, cpu->addr);
+            cpu->addr = (u8)(cpu->addr + cpu->y);
+            break;
+        case UOP_FETCH_PTR:
+            cpu->ptr = cpu_fetch_byte(cpu);
+            break;
+        case UOP_PTR_X:
+            cpu_read(cpu, cpu->ptr);
+            cpu->ptr += cpu->x;
+            break;
+        case UOP_PTR_LO:
+            cpu->addr = cpu_read(cpu, cpu->ptr);
+            break;
+        case UOP_PTR_HI:
+            cpu->addr |= cpu_read(cpu, (u8)(cpu->ptr + 1)) << 8;
+            break;
+        case UOP_PTR_HI_Y:
+            cpu->addr |= cpu_read(cpu, (u8)(cpu->ptr + 1)) << 8;
+            cpu_micro_index(cpu, cpu->y);
+            break;
+
+        case UOP_IMPLIED:
+            cpu_read(cpu, cpu->pc);
+            exec(cpu, 0, 0);
+            break;
+        case UOP_IMMEDIATE:
+            exec(cpu, 0, cpu_fetch_byte(cpu));
+            break;
+        case UOP_READ:
+            exec(cpu, cpu->addr, cpu_read(cpu, cpu->addr));
+            break;
+        case UOP_READ_CARRY: {
+            const u8 val = cpu_read(cpu, cpu->base);
+            if(cpu->base == cpu->addr) {
+                exec(cpu, cpu->addr, val);
+                cpu->uop = NULL;
+                return;
+            }
+            break;
+        }
+        case UOP_READ_BASE:
+            cpu_read(cpu, cpu->base);
+            break;
+        case UOP_READ_DATA:
+            cpu->data = cpu_read(cpu, cpu->addr);
+            break;
+        case UOP_WRITE_DATA:
+            cpu_write(cpu, cpu->addr, cpu->data);
+            break;
+        case UOP_EXECUTE:
+            exec(cpu, cpu->addr, cpu->data);
+            break;
+
+        case UOP_BRANCH:
+            cpu->data = cpu_fetch_byte(cpu);
+            if(!cpu_branch_taken(cpu, cpu->opcode)) {
+                cpu->uop = NULL;
+                return;
+            }
+            cpu->addr = cpu->pc + (int8_t)cpu->data;
+            break;
+        case UOP_BRANCH_TAKEN:
+            cpu_read(cpu, cpu->pc);
+            cpu->pc = (cpu->pc & 0xFF00) | (cpu->addr & 0xFF);
+            if(cpu->pc == cpu->addr) {
+                cpu->uop = NULL;
+                return;
+            }
+            break;
+        case UOP_BRANCH_CARRY:
+            cpu_read(cpu, cpu->pc);
+            cpu->pc = cpu->addr;
+            break;
+
+        case UOP_JMP:
+            cpu->pc = cpu->addr | (cpu_peek(cpu, cpu->pc) << 8);
+            break;
+        case UOP_LATCH:
+            cpu->data = cpu_read(cpu, cpu->addr);
+            break;
+        case UOP_JMP_INDIRECT:
+            cpu->pc = cpu->data | (cpu_read(cpu, (cpu->addr & 0xFF00) | ((cpu->addr + 1) & 0xFF)) << 8);
+            break;
+        case UOP_READ_PC:
+            cpu_read(cpu, cpu->pc);
+            break;
+        case UOP_INC_PC:
+            cpu_read(cpu, cpu->pc);
+            ++cpu->pc;
+            break;
+        case UOP_BRK_PAD:
+            cpu_fetch_byte(cpu);
+            cpu->addr = IRQ_START;
+            break;
+        case UOP_READ_STACK:
+            cpu_read(cpu, STACK_START + cpu->sp);
+            break;
+        case UOP_PUSH_PCH:
+            cpu_push(cpu, cpu->pc >> 8);
+            break;
+        case UOP_PUSH_PCL:
+            cpu_push(cpu, cpu->pc & 0xFF);
+            break;
+        case UOP_PUSH_STATUS:
+            cpu_push_status(cpu);
+            cpu->p |= STATUS_I;
+            break;
+        case UOP_PUSH_STATUS_B:
+            cpu_push_status_b(cpu);
+            cpu->p |= STATUS_I;
+            break;
+        case UOP_PULL_STATUS:
+            cpu_pop_status(cpu);
+            break;
+        case UOP_PULL_PCL:
+            cpu->pc = (cpu->pc & 0xFF00) | cpu_pop(cpu);
+            break;
+        case UOP_PULL_PCH:
+            cpu->pc = (cpu->pc & 0xFF) | (cpu_pop(cpu) << 8);
+            break;
+    }
+
+    if(*cpu->uop == UOP_DONE)
+        cpu->uop = NULL;
+}
+
+// First cycle of an instruction: the opcode fetch, or a pending interrupt
+// in its place, which still reads the opcode and throws it away
+static void cpu_micro_start(cpu_t* cpu) {
+    u16 vector = 0;
+
+    if(cpu->pending & PENDING_NMI) {
+        cpu->pending &= ~PENDING_NMI;
+        vector = NMI_START;
+
+#ifdef M6502_TRACE
+        cpu_trace(cpu, TRACE_NMI, cpu->trace_cycle);
+#endif
+    }
+    else if(cpu->pending & PENDING_IRQ) {
+        cpu->pending &= ~PENDING_IRQ;
+        if(!CPU_FLAG(cpu, STATUS_I)) {
+            vector = IRQ_START;
+
+#ifdef M6502_TRACE
+            cpu_trace(cpu, TRACE_IRQ, cpu->trace_cycle);
+#endif
+        }
+    }
+
+#ifdef M6502_PROFILE
+    cpu->profile.pc = cpu->pc;
+#endif
+
+    if(vector) {
+        cpu->addr = vector;
+        cpu->uop = seq_interrupt;
+        cpu_micro_op(cpu);
+        return;
+    }
+
+#ifdef M6502_PROFILE
+    cpu->profile.exec[cpu->pc]++;
+#endif
+
+#ifdef M6502_TRACE
+    cpu_trace(cpu, TRACE_INSTR, cpu->trace_cycle);
+#endif
+
+    cpu->opcode = cpu_fetch_opcode(cpu);
+    cpu->uop = cpu_micro_sequence(&opcode_table[cpu->opcode]);
+
+    ++cpu->total_instructions;
+}
+
+static void cpu_micro_clock(cpu_t* cpu) {
+    if(cpu->cycles != 0)
+        --cpu->cycles;
+    else if(cpu->uop)
+        cpu_micro_op(cpu);
+    else
+        cpu_micro_start(cpu);
+
+#ifdef M6502_PROFILE
+    cpu->profile.cycles[cpu->profile.pc]++;
+#endif
+}
+
+void cpu_clock(cpu_t* cpu) {
+#ifdef M6502_TRACE
+    cpu->trace_cycle = cpu->total_cycles;
+#endif
+
+    cpu_micro_clock(cpu);
+
+    ++cpu->total_cycles;
+}
+
+// Runs until either the cycle budget or the instruction count is used up,
+// finishing any instruction cpu_clock left in flight first. Leaves what is
+// left of the count in *remaining.
+static u32 cpu_run_micro(cpu_t* cpu, u32 budget, u32* remaining) {
+    u32 n = *remaining;
+    u32 elapsed = 0;
+
+    while(n != 0 && elapsed < budget) {
+#ifdef M6502_DEBUG
+        if(cpu_is_complete(cpu) && cpu_debug_break(cpu))
+            break;
+#endif
+
+        do {
+#ifdef M6502_TRACE
+            cpu->trace_cycle = cpu->trace_base + elapsed;
+#endif
+
+            cpu_micro_clock(cpu);
+            ++elapsed;
+        } while(!cpu_is_complete(cpu));
+
+        --n;
+    }
+
+    *remaining = n;
+    return elapsed;
+}
+
+#endif
+
+#if defined(M6502_THREADED_DISPATCH) && !defined(M6502_BLOCK_CACHE)
+
+// Threaded dispatch: every opcode gets its own label and its own copy of the
+// dispatch jump, so the host predictor tracks the successor of each opcode
+// separately instead of sharing one indirect call site. The fused handlers
+// are inlined into their labels.
+// Runs until either the cycle budget or the instruction count is used up,
+// and leaves what is left of the count in *remaining.
+static u32 cpu_run_threaded(cpu_t* cpu, u32 budget, u32* remaining) {
+    static void* const labels[NUM_MAX_OPCODES] = {
+#define OPCODE(op, instr, mode, access, cyc, legal) [op] = &&do_##op,
+#include "opcodes.h"
+    };
+
+    u32 n = *remaining;
+    u32 elapsed = 0;
+
+#ifdef M6502_PROFILE
+    // Where the instruction being run started
+    u16 at = 0;
+#define DISPATCH_MARK() (at = cpu->pc)
+#else
+#define DISPATCH_MARK() ((void)0)
+#endif
+
+#ifdef M6502_TRACE
+#define DISPATCH_TRACE() cpu_trace(cpu, TRACE_INSTR, cpu->trace_base + elapsed)
+#else
+#define DISPATCH_TRACE() ((void)0)
+#endif
+
+#ifdef M6502_DEBUG
+#define DISPATCH_BREAK() cpu_debug_break(cpu)
+#else
+#define DISPATCH_BREAK() 0
+#endif
+
+#define DISPATCH() \
+    do { \
+        if(elapsed >= budget || n == 0 || DISPATCH_BREAK()) { \
+            *remaining = n; \
+            return elapsed; \
+        } \
+        --n; \
+        DISPATCH_MARK(); \
+        DISPATCH_TRACE(); \
+        goto *labels[cpu_fetch_opcode(cpu)]; \
+    } while(0)
+
+    DISPATCH();
+
+#ifdef M6502_IDLE_SKIP
+    // Only the opcodes that can close a loop look for an idle one, and only
+    // when they went backwards
+#define OPCODE(op, instr, mode, access, cyc, legal) \
+    do_##op: { \
+        const u16 from = cpu->pc; \
+        elapsed += op_##op(cpu); \
+        if(IDLE_CANDIDATE(instr, mode) && cpu->pc < from && !cpu_idle_known_busy(cpu, cpu->pc)) { \
+            u32 left = n; \
+            elapsed += cpu_idle_check(cpu, elapsed, budget, &left); \
+            n = left; \
+        } \
+    } \
+        DISPATCH();
+#elif defined(M6502_PROFILE)
+#define OPCODE(op, instr, mode, access, cyc, legal) \
+    do_##op: \
+        elapsed += cpu_profile_exec(cpu, at, op_##op(cpu)); \
+        DISPATCH();
+#else
+#define OPCODE(op, instr, mode, access, cyc, legal) \
+    do_##op: \
+        elapsed += op_##op(cpu); \
+        DISPATCH();
+#endif
+#include "opcodes.h"
+
+#undef DISPATCH
+#undef DISPATCH_MARK
+#undef DISPATCH_TRACE
+#undef DISPATCH_BREAK
+}
+
+#endif
+
+#if !defined(M6502_THREADED_DISPATCH) && !defined(M6502_BLOCK_CACHE) && !defined(M6502_CYCLE_EXACT)
+
+// Portable table-driven core.
+// Runs until either the cycle budget or the instruction count is used up,
+// and leaves what is left of the count in *remaining.
+static u32 cpu_run_table(cpu_t* cpu, u32 budget, u32* remaining) {
+    u32 n = *remaining;
+    u32 elapsed = 0;
+
+    while(elapsed < budget && n != 0) {
+#ifdef M6502_DEBUG
+        if(cpu_debug_break(cpu))
+            break;
+#endif
+
+#ifdef M6502_IDLE_SKIP
+        const u16 from = cpu->pc;
+#endif
+
+#ifdef M6502_TRACE
+        cpu_trace(cpu, TRACE_INSTR, cpu->trace_base + elapsed);
+#endif
+
+        elapsed += cpu_step(cpu);
+        --n;
+
+#ifdef M6502_IDLE_SKIP
+        if(cpu->pc <= from && !cpu_idle_known_busy(cpu, cpu->pc))
+            elapsed += cpu_idle_check(cpu, elapsed, budget, &n);
+#endif
+    }
+
+    *remaining = n;
+    return elapsed;
+}
+
+#endif
+
+// =================================================================================
+// BLOCK CACHE
+// =================================================================================
+
+#ifdef M6502_BLOCK_CACHE
+
+// Anything that moves the PC somewhere other than the next instruction ends
+// a block, since replay sets the PC from the decoded record
+static _Bool ends_block(const instr_t* instr) {
+#ifdef M6502_HALT_ON_KIL
+    if(instr->exec_instruction == kil)
+        return 1;
+#endif
+
+    return instr->addr_mode == RELATIVE
+        || instr->exec_instruction == jmp
+        || instr->exec_instruction == jsr
+        || instr->exec_instruction == rts
+        || instr->exec_instruction == rti
+        || instr->exec_instruction == brk;
+}
+
+static void cpu_flush_blocks(cpu_t* cpu) {
+    for(size_t i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+        cpu->blocks[i].len = 0;
+#ifdef M6502_JIT
+        cpu->blocks[i].native = NULL;
+#endif
+    }
+
+    memset(cpu->code_bitmap, 0, sizeof(cpu->code_bitmap));
+
+#ifdef M6502_JIT
+    if(cpu->jit)
+        jit_flush(cpu->jit);
+#endif
+}
+
+// Drop every block containing addr. Self-modifying code is rare enough that
+// a scan of the whole cache is cheaper than keeping reverse mappings.
+static void cpu_invalidate_code(cpu_t* cpu, u16 addr) {
+    for(size_t i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+        block_t* block = &cpu->blocks[i];
+
+        if(block->len != 0 && (u16)(addr - block->start) < block->size) {
+#ifdef M6502_JIT
+            if(block->native)
+                jit_unlink(cpu->jit, block);
+#endif
+            block->len = 0;
+        }
+    }
+
+    cpu->code_bitmap[addr >> 3] &= ~(1 << (addr & 7));
+}
+
+// Decode the run starting at pc into block. Only instructions that sit
+// entirely in mapped memory are cached, since reading MMIO can have side
+// effects and its contents can change without a write from the CPU.
+static _Bool cpu_decode_block(cpu_t* cpu, block_t* block, u16 pc) {
+    u32 addr = pc;
+
+#ifdef M6502_JIT
+    // The slot may still hold native code for whatever was here before
+    if(block->native)
+        jit_unlink(cpu->jit, block);
+    block->hits = 0;
+#endif
+
+    block->start = pc;
+    block->len = 0;
+
+    // A run that reaches $FFFF ends there, and the wrapped PC starts a
+    // block of its own
+    while(block->len < BLOCK_MAX_INSTRS && addr < 0x10000) {
+        const u8* page = cpu->read_map[addr >> 8];
+        if(!page)
+            break;
+
+        const instr_t* instr = &opcode_table[page[addr & 0xFF]];
+        const u32 size = 1 + addr_mode_size(instr->addr_mode);
+
+        if(addr + size > 0x10000 || !cpu->read_map[(addr + size - 1) >> 8])
+            break;
+
+        u16 operand = 0;
+        if(size > 1)
+            operand = cpu_peek(cpu, addr + 1);
+        if(size > 2)
+            operand |= cpu_peek(cpu, addr + 2) << 8;
+
+        decoded_instr_t* decoded = &block->instrs[block->len++];
+        decoded->exec = instr->exec_decoded;
+        decoded->operand = operand;
+        decoded->next_pc = addr + size;
+        decoded->opcode = page[addr & 0xFF];
+        decoded->cycles = instr->cycles;
+
+        for(u32 i = addr; i < addr + size; ++i)
+            cpu->code_bitmap[i >> 3] |= 1 << (i & 7);
+
+        addr += size;
+
+        if(ends_block(instr))
+            break;
+    }
+
+    block->size = addr - pc;
+
+#ifdef M6502_IDLE_SKIP
+    block->idle = block->len != 0 && cpu_idle_body(cpu, pc) == block->len;
+#endif
+
+    return block->len != 0;
+}
+
+#ifdef M6502_JIT
+
+u8 cpu_jit_read(cpu_t* cpu, u16 addr) {
+    return cpu_read(cpu, addr);
+}
+
+void cpu_jit_write(cpu_t* cpu, u16 addr, u8 val) {
+    cpu_write(cpu, addr, val);
+}
+
+static void cpu_compile_block(cpu_t* cpu, block_t* block) {
+    if(!cpu->jit)
+        cpu->jit = jit_create();
+
+    // Without executable memory everything stays interpreted
+    if(!cpu->jit)
+        return;
+
+    if(jit_compile(cpu->jit, cpu, block))
+        return;
+
+    // Out of code space. Start over rather than tracking what is still in
+    // use, hot blocks come back quickly.
+    for(size_t i = 0; i < BLOCK_CACHE_SIZE; ++i)
+        cpu->blocks[i].native = NULL;
+    jit_flush(cpu->jit);
+
+    jit_compile(cpu->jit, cpu, block);
+}
+
+#endif
+
+// Runs until either the cycle budget or the instruction count is used up,
+// and leaves what is left of the count in *remaining.
+static u32 cpu_run_blocks(cpu_t* cpu, u32 budget, u32* remaining) {
+    u32 n = *remaining;
+    u32 elapsed = 0;
+
+    while(elapsed < budget && n != 0) {
+        block_t* block = &cpu->blocks[cpu->pc & (BLOCK_CACHE_SIZE - 1)];
+
+        if((block->len == 0 || block->start != cpu->pc) && !cpu_decode_block(cpu, block, cpu->pc)) {
+            // Code outside mapped memory is interpreted as usual
+#ifdef M6502_TRACE
+            cpu_trace(cpu, TRACE_INSTR, cpu->trace_base + elapsed);
+#endif
+
+            elapsed += cpu_step(cpu);
+            --n;
+            continue;
+        }
+
+#ifdef M6502_IDLE_SKIP
+        // Idle loops are stepped through the interpreter and never compiled,
+        // so native code can't spin in them either
+        if(block->idle) {
+            elapsed += cpu_idle_skip(cpu, block->len, budget - elapsed, &n);
+            continue;
+        }
+#endif
+
+#ifdef M6502_JIT
+        if(!block->native && ++block->hits == JIT_HOT_THRESHOLD)
+            cpu_compile_block(cpu, block);
+
+        // Native code only runs blocks that fit entirely, the rest of the
+        // budget is used up by replaying
+        if(block->native && budget - elapsed > block->min_budget && n >= block->len) {
+            elapsed += jit_run(cpu->jit, cpu, block, budget - elapsed, &n);
+            continue;
+        }
+#endif
+
+        // A write from inside the block can invalidate it, which zeroes len
+        // and stops the replay right after the offending instruction
+        for(u8 i = 0; i < block->len; ++i) {
+            const decoded_instr_t* decoded = &block->instrs[i];
+
+#ifdef M6502_TRACE
+            cpu_trace(cpu, TRACE_INSTR, cpu->trace_base + elapsed);
+#endif
+
+#ifdef M6502_OPCODE_STATS
+            cpu_count_opcode(cpu, decoded->opcode);
+#endif
+
+#ifdef M6502_PROFILE
+            const u16 at = cpu->pc;
+            cpu->pc = decoded->next_pc;
+            elapsed += cpu_profile_exec(cpu, at, decoded->exec(cpu, decoded->operand));
+#else
+            cpu->pc = decoded->next_pc;
+            elapsed += decoded->exec(cpu, decoded->operand);
+#endif
+            --n;
+
+            if(elapsed >= budget || n == 0)
+                break;
+        }
+    }
+
+    *remaining = n;
+    return elapsed;
+}
+
+#endif
+
+void cpu_release(cpu_t* cpu) {
+#ifdef M6502_JIT
+    if(cpu->jit) {
+        cpu_flush_blocks(cpu);
+        jit_destroy(cpu->jit);
+        cpu->jit = NULL;
+    }
+#endif
+}
+
+void cpu_invalidate(cpu_t* cpu, u16 start, u32 size) {
+#ifdef M6502_IDLE_SKIP
+    cpu->busy_valid = 0;
+#endif
+
+#ifdef M6502_BLOCK_CACHE
+    // Large ranges are usually whole program loads, just start over
+    if(size >= 0x1000) {
+        cpu_flush_blocks(cpu);
+        return;
+    }
+
+    for(u32 addr = start; addr < (u32)start + size && addr < 0x10000; ++addr) {
+        if(cpu->code_bitmap[addr >> 3] & (1 << (addr & 7)))
+            cpu_invalidate_code(cpu, addr);
+    }
+#endif
+}
+
+void cpu_set_stable(cpu_t* cpu, u16 start, u32 size, _Bool stable) {
+#ifdef M6502_IDLE_SKIP
+    for(u32 addr = start; addr < (u32)start + size && addr < 0x10000; ++addr) {
+        if(stable)
+            cpu->stable_bitmap[addr >> 3] |= 1 << (addr & 7);
+        else
+            cpu->stable_bitmap[addr >> 3] &= ~(1 << (addr & 7));
+    }
+
+    // Loops already judged by the old set have to be looked at again
+    cpu->busy_valid = 0;
+#ifdef M6502_BLOCK_CACHE
+    cpu_flush_blocks(cpu);
+#endif
+#endif
+}
+
+// Whichever engine this build uses
+static inline u32 cpu_run_engine(cpu_t* cpu, u32 budget, u32* n) {
+#if defined(M6502_CYCLE_EXACT)
+    return cpu_run_micro(cpu, budget, n);
+#elif defined(M6502_BLOCK_CACHE)
+    return cpu_run_blocks(cpu, budget, n);
+#elif defined(M6502_THREADED_DISPATCH)
+    return cpu_run_threaded(cpu, budget, n);
+#else
+    return cpu_run_table(cpu, budget, n);
+#endif
+}
+
+#ifdef M6502_DEBUG
+
+// A run that starts where an execute breakpoint stopped the last one steps
+// over it, as long as it is still there. Hits from outside a run, e.g. the
+// vector reads of cpu_irq, don't stop the next one.
+static inline u32 cpu_run(cpu_t* cpu, u32 budget, u32* n) {
+    cpu_debug_t* debug = &cpu->debug;
+
+    debug->resume = debug->stopped && debug->stop_kind == DEBUG_EXEC && debug->stop_addr == cpu->pc;
+    debug->stopped = 0;
+
+    if(debug->flooded) {
+        memcpy(debug->dispatch_bitmap, debug->exec_bitmap, sizeof(debug->dispatch_bitmap));
+        debug->flooded = 0;
+    }
+
+    const u32 elapsed = cpu_run_engine(cpu, budget, n);
+
+    debug->resume = 0;
+
+    return elapsed;
+}
+
+#else
+
+static inline u32 cpu_run(cpu_t* cpu, u32 budget, u32* n) {
+    return cpu_run_engine(cpu, budget, n);
+}
+
+#endif
+
+// The counters are only brought up to date once per batch. The cycle-exact
+// engine counts instructions as it fetches them instead, since its batches
+// also count interrupt sequences.
+static inline void cpu_count(cpu_t* cpu, u32 cycles, u32 instructions) {
+    cpu->total_cycles += cycles;
+#ifndef M6502_CYCLE_EXACT
+    cpu->total_instructions += instructions;
+#endif
+}
+
+u32 cpu_run_cycles(cpu_t* cpu, u32 budget) {
+    // Drain whatever is left of an instruction started by cpu_clock
+    u32 elapsed = cpu->cycles;
+    cpu->cycles = 0;
+
+#ifdef M6502_TRACE
+    cpu->trace_base = cpu->total_cycles + elapsed;
+#endif
+
+    u32 n = UINT32_MAX;
+    if(elapsed < budget)
+        elapsed += cpu_run(cpu, budget - elapsed, &n);
+
+    cpu_count(cpu, elapsed, UINT32_MAX - n);
+
+    return elapsed;
+}
+
+u32 cpu_run_instructions(cpu_t* cpu, u32 n) {
+    u32 elapsed = 0;
+
+    // An instruction already in flight counts as the first one. It was
+    // already counted when cpu_clock started it.
+    if(cpu->cycles != 0 && n != 0) {
+        elapsed = cpu->cycles;
+        cpu->cycles = 0;
+        --n;
+    }
+
+#ifdef M6502_TRACE
+    cpu->trace_base = cpu->total_cycles + elapsed;
+#endif
+
+    const u32 requested = n;
+    elapsed += cpu_run(cpu, UINT32_MAX, &n);
+
+    cpu_count(cpu, elapsed, requested - n);
+
+    return elapsed;
+}
+
+u64 cpu_get_cycles(const cpu_t* cpu) {
+    return cpu->total_cycles;
+}
+
+u64 cpu_get_instructions(const cpu_t* cpu) {
+    return cpu->total_instructions;
+}
+
+// Split up so that cycles * 1e9 can't overflow
+u64 cpu_cycles_to_ns(u64 cycles, u32 clock_hz) {
+    return cycles / clock_hz * 1000000000 + cycles % clock_hz * 1000000000 / clock_hz;
+}
+
+// =================================================================================
+// SNAPSHOTS
+// =================================================================================
+
+#ifdef M6502_CYCLE_EXACT
+
+// Position of uop in seq, or -1 if it points somewhere else. Only equality
+// is used, which is well defined between different arrays.
+static int cpu_uop_position(const u8* seq, const u8* uop) {
+    for(int i = 0; ; ++i) {
+        if(seq + i == uop)
+            return i;
+        if(seq[i] == UOP_DONE)
+            return -1;
+    }
+}
+
+// The micro-op at pos in seq, or NULL if seq is shorter than that
+static const u8* cpu_uop_at(const u8* seq, u8 pos) {
+    for(u8 i = 0; i < pos; ++i) {
+        if(seq[i] == UOP_DONE)
+            return NULL;
+    }
+
+    return seq[pos] == UOP_DONE ? NULL : seq + pos;
+}
+
+#endif
+
+size_t cpu_snapshot(cpu_t* cpu, void* buf, size_t size) {
+    if(size < CPU_SNAPSHOT_SIZE)
+        return 0;
+
+    cpu_snapshot_t snapshot = {
+        .magic = CPU_SNAPSHOT_MAGIC,
+        .version = CPU_SNAPSHOT_VERSION,
+        .size = CPU_SNAPSHOT_SIZE,
+        .pc = cpu->pc,
+        .a = cpu->a,
+        .x = cpu->x,
+        .y = cpu->y,
+        .sp = cpu->sp,
+        .status = cpu_get_status(cpu),
+        .cycles = cpu->cycles,
+        .total_cycles = cpu->total_cycles,
+        .total_instructions = cpu->total_instructions,
+    };
+
+#ifdef M6502_CYCLE_EXACT
+    snapshot.opcode = cpu->opcode;
+    snapshot.ptr = cpu->ptr;
+    snapshot.data = cpu->data;
+    snapshot.pending = cpu->pending;
+    snapshot.addr = cpu->addr;
+    snapshot.base = cpu->base;
+
+    if(cpu->uop) {
+        const int pos = cpu_uop_position(cpu_micro_sequence(&opcode_table[cpu->opcode]), cpu->uop);
+
+        snapshot.uop_seq = pos >= 0 ? 1 : 2;
+        snapshot.uop_pos = pos >= 0 ? pos : cpu_uop_position(seq_interrupt, cpu->uop);
+    }
+#endif
+
+    // buf may be a byte offset into something bigger
+    memcpy(buf, &snapshot, CPU_SNAPSHOT_SIZE);
+
+    return CPU_SNAPSHOT_SIZE;
+}
+
+_Bool cpu_restore(cpu_t* cpu, const void* buf, size_t size) {
+    if(size < CPU_SNAPSHOT_SIZE)
+        return 0;
+
+    cpu_snapshot_t snapshot;
+    memcpy(&snapshot, buf, CPU_SNAPSHOT_SIZE);
+
+    if(snapshot.magic != CPU_SNAPSHOT_MAGIC || snapshot.version != CPU_SNAPSHOT_VERSION || snapshot.size != CPU_SNAPSHOT_SIZE)
+        return 0;
+
+#ifdef M6502_CYCLE_EXACT
+    const u8* uop = NULL;
+
+    if(snapshot.uop_seq == 1)
+        uop = cpu_uop_at(cpu_micro_sequence(&opcode_table[snapshot.opcode]), snapshot.uop_pos);
+    else if(snapshot.uop_seq == 2)
+        uop = cpu_uop_at(seq_interrupt, snapshot.uop_pos);
+
+    if(snapshot.uop_seq > 2 || (snapshot.uop_seq != 0 && !uop))
+        return 0;
+
+    cpu->uop = uop;
+    cpu->opcode = snapshot.opcode;
+    cpu->ptr = snapshot.ptr;
+    cpu->data = snapshot.data;
+    cpu->pending = snapshot.pending;
+    cpu->addr = snapshot.addr;
+    cpu->base = snapshot.base;
+#else
+    // Other engines can't pick up half a micro-op sequence or an interrupt
+    // latched for the next boundary
+    if(snapshot.uop_seq != 0 || snapshot.pending != 0)
+        return 0;
+#endif
+
+    cpu->pc = snapshot.pc;
+    cpu->a = snapshot.a;
+    cpu->x = snapshot.x;
+    cpu->y = snapshot.y;
+    cpu->sp = snapshot.sp;
+    cpu_set_status(cpu, snapshot.status);
+    cpu->cycles = snapshot.cycles;
+    cpu->total_cycles = snapshot.total_cycles;
+    cpu->total_instructions = snapshot.total_instructions;
+
+#ifdef M6502_IDLE_SKIP
+    cpu->busy_valid = 0;
+#endif
+
+    return 1;
 }
\ No newline at end of file
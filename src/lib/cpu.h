@@ -25,31 +25,442 @@
 #define IRQ_START 0xFFFE
 // #define IRQ_END 0xFFFF
 
+#define STATUS_C 0x01
+#define STATUS_Z 0x02
+#define STATUS_I 0x04
+#define STATUS_D 0x08
+#define STATUS_B 0x10
+#define STATUS_U 0x20
+#define STATUS_V 0x40
+#define STATUS_N 0x80
+
+// Test or change a single flag in cpu_t::p, e.g. CPU_FLAG(cpu, STATUS_I).
+// With M6502_LAZY_FLAGS only I and D are kept there.
+#define CPU_FLAG(cpu, flag) (((cpu)->p & (flag)) != 0)
+#define CPU_SET_FLAG(cpu, flag, on) ((cpu)->p = (u8)(((cpu)->p & ~(flag)) | ((on) ? (flag) : 0)))
+
+#define CPU_PAGE_SIZE 0x100
+#define CPU_NUM_PAGES 0x100
+
+// The cycle-exact engine replaces every other core
+#ifdef M6502_CYCLE_EXACT
+#undef M6502_JIT
+#undef M6502_BLOCK_CACHE
+#undef M6502_IDLE_SKIP
+#endif
+
+// Native code runs whole blocks without going through dispatch, so there
+// would be nothing to count or trace
+#if defined(M6502_OPCODE_STATS) || defined(M6502_PROFILE) || defined(M6502_TRACE)
+#undef M6502_JIT
+#endif
+
+// Spin loops have to show up in profiles and traces as they really run
+#if defined(M6502_PROFILE) || defined(M6502_TRACE)
+#undef M6502_IDLE_SKIP
+#endif
+
+// Breakpoints are checked by the interpreters, before every instruction
+// and on every data access
+#ifdef M6502_DEBUG
+#undef M6502_JIT
+#undef M6502_BLOCK_CACHE
+#undef M6502_IDLE_SKIP
+#endif
+
+// The JIT compiles blocks found by the block cache
+#if defined(M6502_JIT) && !defined(M6502_BLOCK_CACHE)
+#define M6502_BLOCK_CACHE
+#endif
+
+#ifdef M6502_IDLE_SKIP
+#define IDLE_BUSY_SIZE 16
+#endif
+
+#ifdef M6502_OPCODE_STATS
+
+// Executions per opcode, and per opcode that directly followed another.
+// Counted at dispatch, so interrupts don't show up and don't break a pair.
+// Per addressing mode counts follow from the opcodes, see stats.h.
+typedef struct cpu_stats {
+    u64 opcodes[256];
+    u64 pairs[256][256];
+    // The opcode before, and whether there was one since the stats were cleared
+    u8 last;
+    u8 primed;
+} cpu_stats_t;
+
+#endif
+
+#ifdef M6502_PROFILE
+
+// Flat per-address counters for heat maps. They are 32 bits wide to keep
+// the arrays small and simply wrap around on very long runs.
+typedef struct cpu_profile {
+    // Instructions started at each PC, and the cycles they took
+    u32 exec[0x10000];
+    u32 cycles[0x10000];
+    // Data accesses to each address. Opcode and operand fetches are left
+    // out, the exec counts already cover code. Cycle-exact builds count
+    // their dummy reads and writes too, since those do hit the bus.
+    u32 reads[0x10000];
+    u32 writes[0x10000];
+#ifdef M6502_CYCLE_EXACT
+    // The instruction in flight, which each cycle is charged to
+    u16 pc;
+#endif
+} cpu_profile_t;
+
+#endif
+
+#ifdef M6502_DEBUG
+
+#define DEBUG_MAX_BREAKPOINTS 32
+
+// What a breakpoint stops on, or'd together. Execute breakpoints stop
+// before the instruction at their address runs, read and write ones after
+// the instruction that made the access. Opcode and operand fetches are
+// not reads.
+typedef enum debug_kind {
+    DEBUG_EXEC = 0x1,
+    DEBUG_READ = 0x2,
+    DEBUG_WRITE = 0x4,
+} debug_kind_t;
+
+// What a condition looks at
+typedef enum debug_operand {
+    DEBUG_ALWAYS,
+    DEBUG_A,
+    DEBUG_X,
+    DEBUG_Y,
+    DEBUG_SP,
+    // As cpu_get_status returns it
+    DEBUG_P,
+    // The byte at the condition's addr if it is mapped, 0 otherwise, so
+    // checking it never touches a device
+    DEBUG_MEM,
+    // The byte read or written, for read and write breakpoints
+    DEBUG_VALUE,
+} debug_operand_t;
+
+typedef enum debug_compare {
+    DEBUG_EQ,
+    DEBUG_NE,
+    DEBUG_LT,
+    DEBUG_GE,
+    // Any of the bits in value set
+    DEBUG_ANY,
+} debug_compare_t;
+
+typedef struct debug_cond {
+    u8 operand;
+    u8 compare;
+    u8 value;
+    u16 addr;
+} debug_cond_t;
+
+typedef struct cpu_breakpoint {
+    // Inclusive, so one breakpoint can cover all of memory. kinds is 0 for
+    // a free slot.
+    u16 start;
+    u16 end;
+    u8 kinds;
+    debug_cond_t cond;
+    // Matches to let through before stopping, and matches so far
+    u32 ignore;
+    u32 hits;
+} cpu_breakpoint_t;
+
+typedef struct cpu_debug {
+    // One bit per address covered by a breakpoint of each kind. The
+    // breakpoints themselves are only looked at when a bit is set.
+    u8 exec_bitmap[0x10000 / 8];
+    u8 read_bitmap[0x10000 / 8];
+    u8 write_bitmap[0x10000 / 8];
+
+    // What the interpreters test before every instruction: a copy of
+    // exec_bitmap, or all ones once a read or write breakpoint stopped the
+    // run, so that it ends at the next instruction without a test of its
+    // own. flooded says which.
+    u8 dispatch_bitmap[0x10000 / 8];
+    u1 flooded;
+
+    // The host's mapping of every page, as cpu_map set it. Pages with read
+    // or write breakpoints are left out of cpu_t::read_map and write_map,
+    // so that only their accesses take the path that checks the bitmaps.
+    u8* read_map[CPU_NUM_PAGES];
+    u8* write_map[CPU_NUM_PAGES];
+    u8 read_pages[CPU_NUM_PAGES];
+    u8 write_pages[CPU_NUM_PAGES];
+
+    cpu_breakpoint_t breakpoints[DEBUG_MAX_BREAKPOINTS];
+
+    // Set when a breakpoint stopped the last cpu_run_* call, with the one
+    // that did and the access that hit it
+    u1 stopped;
+    u8 stop_kind;
+    u8 stop_val;
+    u16 stop_addr;
+    u32 stop_index;
+
+    // The run resuming from an execute breakpoint steps over it once
+    u1 resume;
+} cpu_debug_t;
+
+#endif
+
+#ifdef M6502_BLOCK_CACHE
+
+#define BLOCK_CACHE_SIZE 1024
+#ifndef BLOCK_MAX_INSTRS
+#define BLOCK_MAX_INSTRS 16
+#endif
+
+struct cpu;
+
+// One instruction with its operand bytes already fetched
+typedef struct decoded_instr {
+    u8 (*exec)(struct cpu* cpu, u16 operand);
+    u16 operand;
+    u16 next_pc;
+    u8 opcode;
+    u8 cycles;
+} decoded_instr_t;
+
+// A straight-line run of instructions starting at `start`, ending at the
+// first control transfer. len == 0 marks an empty or invalidated slot.
+typedef struct block {
+    u16 start;
+    u16 size;
+    u8 len;
+#ifdef M6502_IDLE_SKIP
+    // The block is a spin loop that branches back to its own start
+    u1 idle;
+#endif
+#ifdef M6502_JIT
+    // Replays so far, and the compiled code once the block got hot.
+    // min_budget is the cycle budget the block needs to run to completion
+    // without stopping early, i.e. its total minus the last instruction.
+    u16 hits;
+    u16 min_budget;
+    void* native;
+#endif
+    decoded_instr_t instrs[BLOCK_MAX_INSTRS];
+} block_t;
+
+#endif
+
 typedef struct cpu {
     u8 a, x, y;
     u8 sp;
     u16 pc;
-    struct {
-        u1 c : 1;
-        u1 z : 1;
-        u1 i : 1;
-        u1 d : 1;
-        u1 v : 1;
-        u1 n : 1;
-    } sr;
+    // Status register in the layout it is pushed in. B only exists on the
+    // stack and U always reads as 1.
+    u8 p;
+
+#ifdef M6502_LAZY_FLAGS
+    // N/Z/C/V as their instructions left them, only turned into flags when
+    // read, so only I and D are kept in p. Z is set when the low byte of nz
+    // is zero and N when bit 7 or 8 of it is set. V is set when v is
+    // nonzero. Use cpu_get_status to read them from outside.
+    u16 nz;
+    u1 c;
+    u8 v;
+#endif
+
+    // In-flight execution state. The registers, this and the bus callbacks
+    // below fit in the first 64 bytes in every configuration. The page maps
+    // come after them and are indexed per access.
+    u8 cycles;
+
+#ifdef M6502_CYCLE_EXACT
+    // Micro-op engine state. uop points at what is left of the current
+    // instruction's sequence and is NULL between instructions. addr, base,
+    // ptr and data latch values from one cycle to the next, base being the
+    // address before an index carry got into the high byte. pending holds
+    // interrupts waiting for the next instruction boundary.
+    const u8* uop;
+    u16 addr;
+    u16 base;
+    u8 opcode;
+    u8 ptr;
+    u8 data;
+    u8 pending;
+#endif
 
     void* bus;
     u8 (*read_bus)(void* ctx, u16 addr);
     void (*write_bus)(void* ctx, u16 addr, u8 val);
+
+    // Cycles and instructions run since the CPU was zeroed, not cleared by
+    // cpu_reset. Brought up to date at the end of every cpu_run_* call and
+    // on every cpu_clock, rather than per instruction.
+    u64 total_cycles;
+    u64 total_instructions;
+
+#ifdef M6502_TRACE
+    // Records go to this trace.h ring while it is set. trace_base is the
+    // cycle the current cpu_run_* batch started on, trace_cycle the stamp
+    // of the instruction being traced.
+    struct trace* trace;
+    u64 trace_base;
+    u64 trace_cycle;
+#endif
+
+    // Host memory backing each 256-byte page, or NULL to go through
+    // read_bus/write_bus. Must start out zeroed or be filled in by cpu_map.
+    u8* read_map[CPU_NUM_PAGES];
+    u8* write_map[CPU_NUM_PAGES];
+
+#ifdef M6502_BLOCK_CACHE
+    // Direct-mapped by entry PC. code_bitmap has one bit per address that
+    // belongs to a cached block, so writes can cheaply tell if they hit code.
+    block_t blocks[BLOCK_CACHE_SIZE];
+    u8 code_bitmap[0x10000 / 8];
+#endif
+
+#ifdef M6502_JIT
+    // Created on first use, freed by cpu_release
+    struct jit* jit;
+#endif
+
+#ifdef M6502_IDLE_SKIP
+    // One bit per address that cpu_set_stable declared safe to poll.
+    // busy_pc remembers loop heads found not to be idle, direct-mapped by
+    // address with one valid bit each, so counted loops don't get analysed
+    // again on every iteration.
+    u8 stable_bitmap[0x10000 / 8];
+    u16 busy_pc[IDLE_BUSY_SIZE];
+    u16 busy_valid;
+#endif
+
+#ifdef M6502_OPCODE_STATS
+    // Cleared with cpu_stats_clear, not by cpu_reset
+    cpu_stats_t stats;
+#endif
+
+#ifdef M6502_PROFILE
+    // Cleared with cpu_profile_clear, not by cpu_reset
+    cpu_profile_t profile;
+#endif
+
+#ifdef M6502_DEBUG
+    // Set up through debug.h, not touched by cpu_reset
+    cpu_debug_t debug;
+#endif
 } cpu_t;
 
+// =================================================================================
+// SNAPSHOTS
+// =================================================================================
+
+#define CPU_SNAPSHOT_MAGIC 0x32303536 // "6502" in a little-endian dump
+#define CPU_SNAPSHOT_VERSION 1
+
+// The CPU's machine state in a flat layout without pointers, in host byte
+// order. What the host set up (maps, bus callbacks, the trace) and what is
+// derived from memory (blocks, native code, idle loops) is not part of it.
+typedef struct cpu_snapshot {
+    u32 magic;
+    u16 version;
+    u16 size;
+
+    u16 pc;
+    u8 a, x, y;
+    u8 sp;
+    // As pushed, so snapshots move between lazy and eager flag builds
+    u8 status;
+    u8 cycles;
+
+    // Cycle-exact engine only, zero elsewhere. uop_seq is 0 between
+    // instructions, 1 inside the current opcode's sequence and 2 inside an
+    // interrupt sequence, with uop_pos the micro-ops already done.
+    u8 uop_seq;
+    u8 uop_pos;
+    u8 opcode;
+    u8 ptr;
+    u8 data;
+    u8 pending;
+    u16 addr;
+    u16 base;
+
+    u64 total_cycles;
+    u64 total_instructions;
+} cpu_snapshot_t;
+
+#define CPU_SNAPSHOT_SIZE sizeof(cpu_snapshot_t)
+
+// Map [start, start + size) onto host memory, one 256-byte page at a time.
+// Passing NULL for read_mem/write_mem routes that direction to the bus
+// callbacks instead, e.g. write_mem = NULL for ROM or both NULL for MMIO.
+void cpu_map(cpu_t* cpu, u16 start, u32 size, u8* read_mem, u8* write_mem);
+
+// Tell the CPU that [start, start + size) was changed behind its back, e.g.
+// by the host loading a program, so any pre-decoded copy of it is dropped.
+// Writes made by the CPU itself are tracked automatically.
+void cpu_invalidate(cpu_t* cpu, u16 start, u32 size);
+
+// Declare that reading [start, start + size) through the bus has no side
+// effects and returns the same value until the current cpu_run_* call
+// returns, e.g. a status register that only changes on a device event.
+// With M6502_IDLE_SKIP, a spin loop of up to 8 instructions that writes
+// nothing, polls only such addresses or mapped memory and comes back to the
+// same registers and flags, e.g. JMP * or LDA flag / BEQ, is fast-forwarded
+// to the end of the cpu_run_cycles budget, ending in the same state as
+// running it would. Does nothing in other builds or with M6502_CYCLE_EXACT.
+void cpu_set_stable(cpu_t* cpu, u16 start, u32 size, _Bool stable);
+
+// Write the state into buf, which needs CPU_SNAPSHOT_SIZE bytes and no
+// particular alignment. Returns the bytes written, or 0 if size is short.
+size_t cpu_snapshot(cpu_t* cpu, void* buf, size_t size);
+
+// Load a cpu_snapshot, e.g. straight from a read-only mapped file. Memory
+// is the host's to restore, followed by cpu_invalidate as usual. Returns 0
+// and leaves the CPU alone if buf holds no snapshot this build can resume,
+// such as one the cycle-exact engine took in the middle of an instruction.
+_Bool cpu_restore(cpu_t* cpu, const void* buf, size_t size);
+
+// Free anything the CPU allocated for itself, such as JIT code memory.
+// The CPU can still be used afterwards and will allocate again as needed.
+void cpu_release(cpu_t* cpu);
+
+// Advance by one cycle. With M6502_CYCLE_EXACT that is exactly one bus
+// access, dummy reads and writes included; otherwise the whole instruction
+// runs on its first cycle and the rest are idle.
 void cpu_clock(cpu_t* cpu);
 
+// Batched execution. Both run whole instructions only, so the returned
+// cycle count can overshoot the budget by up to one instruction. With
+// M6502_IDLE_SKIP a spin loop fast-forwards to the end of the budget, so
+// pass the cycles left until the next interrupt or device event. With
+// M6502_DEBUG both return early when a breakpoint stops them, and the
+// next call steps over an execute breakpoint that was the cause.
+u32 cpu_run_cycles(cpu_t* cpu, u32 budget);
+u32 cpu_run_instructions(cpu_t* cpu, u32 n);
+
+// Cycles and instructions run so far, not cleared by cpu_reset
+u64 cpu_get_cycles(const cpu_t* cpu);
+u64 cpu_get_instructions(const cpu_t* cpu);
+
+// Emulated time in nanoseconds that cycles take at clock_hz, e.g.
+// cpu_cycles_to_ns(cpu_get_cycles(cpu), 1790000) for the NES
+u64 cpu_cycles_to_ns(u64 cycles, u32 clock_hz);
+
 _Bool cpu_is_complete(cpu_t* cpu);
 
+// The next instruction is one of the undocumented NMOS opcodes
 _Bool cpu_is_illegal(cpu_t* cpu);
 
+// The next instruction is KIL/JAM. With M6502_HALT_ON_KIL the CPU stays on
+// it until cpu_reset, otherwise it runs as a one-byte NOP.
+_Bool cpu_is_jammed(cpu_t* cpu);
+
 void cpu_reset(cpu_t* cpu);
+
+// Take an interrupt now. Its 7 cycles are added to whatever is left of the
+// current instruction. With M6502_CYCLE_EXACT it is taken at the next
+// instruction boundary instead, one bus access per cycle. To raise one at
+// a given cycle, call these from a scheduler.h event.
 void cpu_irq(cpu_t* cpu);
 void cpu_nmi(cpu_t* cpu);
 
@@ -0,0 +1,123 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "debug.h"
+
+#ifdef M6502_DEBUG
+
+#include <string.h>
+
+static void debug_mark(u8* bitmap, const cpu_breakpoint_t* breakpoint) {
+    for(u32 addr = breakpoint->start; addr <= breakpoint->end; ++addr)
+        bitmap[addr >> 3] |= 1 << (addr & 7);
+}
+
+static _Bool debug_page_marked(const u8* bitmap, u32 page) {
+    for(u32 i = page * (CPU_PAGE_SIZE / 8); i < (page + 1) * (CPU_PAGE_SIZE / 8); ++i) {
+        if(bitmap[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+// Removing one can't just clear its bits, others may share them
+static void debug_rebuild(cpu_t* cpu) {
+    cpu_debug_t* debug = &cpu->debug;
+
+    memset(debug->exec_bitmap, 0, sizeof(debug->exec_bitmap));
+    memset(debug->read_bitmap, 0, sizeof(debug->read_bitmap));
+    memset(debug->write_bitmap, 0, sizeof(debug->write_bitmap));
+
+    for(u32 i = 0; i < DEBUG_MAX_BREAKPOINTS; ++i) {
+        const cpu_breakpoint_t* breakpoint = &debug->breakpoints[i];
+
+        if(breakpoint->kinds & DEBUG_EXEC)
+            debug_mark(debug->exec_bitmap, breakpoint);
+        if(breakpoint->kinds & DEBUG_READ)
+            debug_mark(debug->read_bitmap, breakpoint);
+        if(breakpoint->kinds & DEBUG_WRITE)
+            debug_mark(debug->write_bitmap, breakpoint);
+    }
+
+    memcpy(debug->dispatch_bitmap, debug->exec_bitmap, sizeof(debug->dispatch_bitmap));
+    debug->flooded = 0;
+
+    // Take pages with watchpoints out of the maps the CPU uses, and put
+    // back the ones that have none left
+    for(u32 page = 0; page < CPU_NUM_PAGES; ++page) {
+        debug->read_pages[page] = debug_page_marked(debug->read_bitmap, page);
+        debug->write_pages[page] = debug_page_marked(debug->write_bitmap, page);
+
+        cpu->read_map[page] = debug->read_pages[page] ? NULL : debug->read_map[page];
+        cpu->write_map[page] = debug->write_pages[page] ? NULL : debug->write_map[page];
+    }
+}
+
+int cpu_debug_add(cpu_t* cpu, u8 kinds, u16 start, u32 size, const debug_cond_t* cond, u32 ignore) {
+    kinds &= DEBUG_EXEC | DEBUG_READ | DEBUG_WRITE;
+    if(kinds == 0 || size == 0)
+        return -1;
+
+    for(u32 i = 0; i < DEBUG_MAX_BREAKPOINTS; ++i) {
+        cpu_breakpoint_t* breakpoint = &cpu->debug.breakpoints[i];
+        if(breakpoint->kinds != 0)
+            continue;
+
+        const u32 end = (u32)start + size - 1;
+
+        *breakpoint = (cpu_breakpoint_t){
+            .start = start,
+            .end = end > 0xFFFF ? 0xFFFF : end,
+            .kinds = kinds,
+            .cond = cond ? *cond : (debug_cond_t){.operand = DEBUG_ALWAYS},
+            .ignore = ignore,
+        };
+
+        debug_rebuild(cpu);
+
+        return i;
+    }
+
+    return -1;
+}
+
+void cpu_debug_remove(cpu_t* cpu, int index) {
+    if(index < 0 || index >= DEBUG_MAX_BREAKPOINTS)
+        return;
+
+    cpu->debug.breakpoints[index].kinds = 0;
+
+    debug_rebuild(cpu);
+}
+
+void cpu_debug_clear(cpu_t* cpu) {
+    memset(cpu->debug.breakpoints, 0, sizeof(cpu->debug.breakpoints));
+
+    debug_rebuild(cpu);
+}
+
+int cpu_debug_find(const cpu_t* cpu, u8 kinds, u16 addr) {
+    for(u32 i = 0; i < DEBUG_MAX_BREAKPOINTS; ++i) {
+        const cpu_breakpoint_t* breakpoint = &cpu->debug.breakpoints[i];
+
+        if((breakpoint->kinds & kinds) && addr >= breakpoint->start && addr <= breakpoint->end)
+            return i;
+    }
+
+    return -1;
+}
+
+#endif
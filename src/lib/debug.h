@@ -0,0 +1,45 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Breakpoints for the cpu_t::debug that M6502_DEBUG builds check in the
+// interpreters. Each covers a range of addresses for any mix of execute,
+// read and write, with an optional condition over the registers, memory
+// or the value accessed, and a number of matches to let through first.
+// A run that hits one returns early with cpu_t::debug.stopped set. Only
+// the interpreters check them, so these builds leave out M6502_JIT,
+// M6502_BLOCK_CACHE and M6502_IDLE_SKIP.
+
+#ifndef M6502_DEBUG_H
+#define M6502_DEBUG_H
+
+#include "cpu.h"
+
+#ifdef M6502_DEBUG
+
+// Break on kinds, DEBUG_EXEC/READ/WRITE or'd together, anywhere in
+// [start, start + size). cond may be NULL to always stop, and the first
+// ignore matches only count as hits. Returns the breakpoint's index, or
+// -1 if size is 0 or all DEBUG_MAX_BREAKPOINTS are in use.
+int cpu_debug_add(cpu_t* cpu, u8 kinds, u16 start, u32 size, const debug_cond_t* cond, u32 ignore);
+
+void cpu_debug_remove(cpu_t* cpu, int index);
+void cpu_debug_clear(cpu_t* cpu);
+
+// Index of the first breakpoint with any of kinds that covers addr, or -1
+int cpu_debug_find(const cpu_t* cpu, u8 kinds, u16 addr);
+
+#endif
+
+#endif //M6502_DEBUG_H
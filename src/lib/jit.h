@@ -0,0 +1,59 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Interface between the interpreter and the x86-64 JIT. Internal to the
+// library, the public API is in cpu.h.
+
+#ifndef M6502_JIT_H
+#define M6502_JIT_H
+
+#include "cpu.h"
+
+#ifdef M6502_JIT
+
+// Replays before a block gets compiled
+#ifndef JIT_HOT_THRESHOLD
+#define JIT_HOT_THRESHOLD 32
+#endif
+
+typedef struct jit jit_t;
+
+// Returns NULL if executable memory is not available
+jit_t* jit_create(void);
+void jit_destroy(jit_t* jit);
+
+// Compile block and set block->native. Returns 0 when the code buffer is
+// full (or could not be made writable), after which the caller has to drop
+// all native code with jit_flush.
+_Bool jit_compile(jit_t* jit, cpu_t* cpu, block_t* block);
+
+// Forget all native code. Blocks still pointing at it must be cleared by
+// the caller.
+void jit_flush(jit_t* jit);
+
+// Stop entering block->native, e.g. because its code was overwritten
+void jit_unlink(jit_t* jit, block_t* block);
+
+// Run native code starting at block, following chained blocks until the
+// budget or the instruction count runs low or a block is not compiled.
+// Returns the cycles used and decrements *n by the instructions run.
+u32 jit_run(jit_t* jit, cpu_t* cpu, block_t* block, u32 budget, u32* n);
+
+// Memory access slow paths for native code, implemented by the interpreter
+u8 cpu_jit_read(cpu_t* cpu, u16 addr);
+void cpu_jit_write(cpu_t* cpu, u16 addr, u8 val);
+
+#endif
+
+#endif //M6502_JIT_H
@@ -0,0 +1,1129 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// x86-64 (System V, Linux) backend for hot blocks from the block cache.
+//
+// While native code runs, the 6502 registers and the N/Z/C/V flags live in
+// host registers. Blocks end by storing the next PC and jumping through a
+// 64K-entry table indexed by it, so compiled blocks chain into each other
+// without coming back to C. The table holds offsets into the code buffer.
+// The exit stub sits at offset 0, so the entries for code that is not
+// compiled are zero. The exit stub writes everything back and returns to
+// the dispatcher. Instructions that are not worth compiling (and every access
+// to unmapped memory) call back into the interpreter.
+
+#include "jit.h"
+
+#if defined(M6502_JIT) && defined(__x86_64__)
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define JIT_CODE_SIZE (4 << 20)
+#define JIT_PAGE_SIZE 4096
+#define JIT_ENTRIES_SIZE (0x10000 * sizeof(u32))
+
+// Generous upper bound for one compiled block
+#define JIT_MAX_BLOCK_CODE 0x2000
+
+// =================================================================================
+// OPCODES
+// =================================================================================
+
+typedef enum jit_instr {
+    JIT_adc, JIT_and, JIT_asl, JIT_asl_acc, JIT_bcc, JIT_bcs, JIT_beq, JIT_bit,
+    JIT_bmi, JIT_bne, JIT_bpl, JIT_brk, JIT_bvc, JIT_bvs, JIT_clc, JIT_cld,
+    JIT_cli, JIT_clv, JIT_cmp, JIT_cpx, JIT_cpy, JIT_dec, JIT_dex, JIT_dey,
+    JIT_eor, JIT_inc, JIT_inx, JIT_iny, JIT_jmp, JIT_jsr, JIT_lda, JIT_ldx,
+    JIT_ldy, JIT_lsr, JIT_lsr_acc, JIT_nop, JIT_ora, JIT_pha, JIT_php, JIT_pla,
+    JIT_plp, JIT_rol, JIT_rol_acc, JIT_ror, JIT_ror_acc, JIT_rti, JIT_rts, JIT_sbc,
+    JIT_sec, JIT_sed, JIT_sei, JIT_sta, JIT_stx, JIT_sty, JIT_tax, JIT_tay,
+    JIT_tsx, JIT_txa, JIT_txs, JIT_tya,
+
+    // Undocumented
+    JIT_alr, JIT_anc, JIT_ane, JIT_arr, JIT_dcp, JIT_isc, JIT_kil, JIT_las,
+    JIT_lax, JIT_lxa, JIT_rla, JIT_rra, JIT_sax, JIT_sbx, JIT_sha, JIT_shx,
+    JIT_shy, JIT_slo, JIT_sre, JIT_tas,
+} jit_instr_t;
+
+typedef enum jit_mode {
+    JIT_IMPLICIT,
+    JIT_ACCUMULATOR,
+    JIT_IMMEDIATE,
+    JIT_ZERO_PAGE,
+    JIT_ZERO_PAGE_X,
+    JIT_ZERO_PAGE_Y,
+    JIT_RELATIVE,
+    JIT_ABSOLUTE,
+    JIT_ABSOLUTE_X,
+    JIT_ABSOLUTE_Y,
+    JIT_INDIRECT,
+    JIT_INDEXED_INDIRECT,
+    JIT_INDIRECT_INDEXED,
+} jit_mode_t;
+
+typedef struct jit_opcode {
+    u8 instr;
+    u8 mode;
+} jit_opcode_t;
+
+#define OPCODE(code, instr, mode, access, cycles, legal) [code] = {JIT_##instr, JIT_##mode},
+static const jit_opcode_t jit_opcodes[256] = {
+#include "opcodes.h"
+};
+
+// =================================================================================
+// EMITTER
+// =================================================================================
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Condition codes for jcc/setcc
+enum { CC_O = 0x0, CC_NO = 0x1, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_LE = 0xE };
+
+// Group 1 /digit for the immediate forms, times 8 for the register forms
+enum { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+
+// Group 2 /digit
+enum { SHIFT_RCL = 2, SHIFT_RCR = 3, SHIFT_SHL = 4, SHIFT_SHR = 5 };
+
+// Where the 6502 lives while native code runs. rax, rcx, rdx, rsi and rdi
+// are scratch.
+#define R_CPU RBX
+#define R_BUDGET RBP
+#define R_A R12
+#define R_X R13
+#define R_Y R14
+#define R_SP R15
+#define R_N R8  // bit 7 is N
+#define R_Z R9  // zero when Z is set
+#define R_C R10 // 0 or 1
+#define R_V R11 // 0 or 1
+
+// Stack frame set up by the entry trampoline. It keeps rsp 16-byte aligned
+// for calls into C.
+#define FRAME_TEMP 0
+#define FRAME_ADDR 4
+#define FRAME_INSTRS 8
+#define FRAME_SIZE 24
+
+struct jit {
+    u8* code;
+    u8* cur;
+    u8* blocks_start;
+
+    void (*enter)(cpu_t* cpu, void* entry);
+    u8* exit_stub;
+
+    // Handed over between C and native code
+    int64_t budget;
+    u32 instrs_left;
+    u8 flags[4];
+    u8 dirty;
+
+    // Code offset per PC, mapped separately so that only the pages holding
+    // compiled entries are ever touched
+    u32* entries;
+};
+
+static inline void emit8(jit_t* jit, u8 byte) {
+    *jit->cur++ = byte;
+}
+
+static inline void emit16(jit_t* jit, u16 val) {
+    memcpy(jit->cur, &val, 2);
+    jit->cur += 2;
+}
+
+static inline void emit32(jit_t* jit, u32 val) {
+    memcpy(jit->cur, &val, 4);
+    jit->cur += 4;
+}
+
+static inline void emit64(jit_t* jit, u64 val) {
+    memcpy(jit->cur, &val, 8);
+    jit->cur += 8;
+}
+
+// Byte accesses to spl/bpl/sil/dil need a REX prefix, otherwise the same
+// encoding means ah/ch/dh/bh
+static inline _Bool is_byte_reg_needing_rex(int reg) {
+    return reg >= RSP && reg <= RDI;
+}
+
+static void emit_prefix(jit_t* jit, int size, int reg, int index, int base, _Bool force_rex) {
+    if(size == 16)
+        emit8(jit, 0x66);
+
+    const u8 rex = 0x40 | ((size == 64) << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+    if(rex != 0x40 || force_rex)
+        emit8(jit, rex);
+}
+
+static void emit_opcode(jit_t* jit, u16 op) {
+    if(op > 0xFF)
+        emit8(jit, op >> 8);
+    emit8(jit, op & 0xFF);
+}
+
+// [base + index + disp32], always with a 32-bit displacement
+static void emit_modrm_mem(jit_t* jit, int reg, int base, int index, int scale, int32_t disp) {
+    if(index < 0) {
+        emit8(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+        if((base & 7) == RSP)
+            emit8(jit, 0x24);
+    } else {
+        emit8(jit, 0x80 | ((reg & 7) << 3) | 4);
+        emit8(jit, (scale << 6) | ((index & 7) << 3) | (base & 7));
+    }
+    emit32(jit, disp);
+}
+
+// op with both operands in registers
+static void emit_rr(jit_t* jit, u16 op, int size, int reg, int rm) {
+    emit_prefix(jit, size, reg, 0, rm, size == 8 && (is_byte_reg_needing_rex(reg) || is_byte_reg_needing_rex(rm)));
+    emit_opcode(jit, op);
+    emit8(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op with an opcode extension in place of the reg operand
+static void emit_xr(jit_t* jit, u16 op, int size, int digit, int rm) {
+    emit_prefix(jit, size, 0, 0, rm, size == 8 && is_byte_reg_needing_rex(rm));
+    emit_opcode(jit, op);
+    emit8(jit, 0xC0 | (digit << 3) | (rm & 7));
+}
+
+// op with a register and a memory operand
+static void emit_rm(jit_t* jit, u16 op, int size, int reg, int base, int index, int scale, int32_t disp) {
+    emit_prefix(jit, size, reg, index < 0 ? 0 : index, base, size == 8 && is_byte_reg_needing_rex(reg));
+    emit_opcode(jit, op);
+    emit_modrm_mem(jit, reg, base, index, scale, disp);
+}
+
+// op with an opcode extension and a memory operand
+static void emit_xm(jit_t* jit, u16 op, int size, int digit, int base, int32_t disp) {
+    emit_prefix(jit, size, 0, 0, base, 0);
+    emit_opcode(jit, op);
+    emit_modrm_mem(jit, digit, base, -1, 0, disp);
+}
+
+static void emit_mov_ri32(jit_t* jit, int reg, u32 imm) {
+    emit_prefix(jit, 32, 0, 0, reg, 0);
+    emit8(jit, 0xB8 + (reg & 7));
+    emit32(jit, imm);
+}
+
+static void emit_mov_ri64(jit_t* jit, int reg, const void* ptr) {
+    emit_prefix(jit, 64, 0, 0, reg, 0);
+    emit8(jit, 0xB8 + (reg & 7));
+    emit64(jit, (u64)(uintptr_t)ptr);
+}
+
+static void emit_mov_rr32(jit_t* jit, int dst, int src) {
+    emit_rr(jit, 0x89, 32, src, dst);
+}
+
+// Zero-extend the low byte of src into dst
+static void emit_movzx_rr8(jit_t* jit, int dst, int src) {
+    emit_rr(jit, 0x0FB6, 8, dst, src);
+}
+
+static void emit_load8(jit_t* jit, int dst, int base, int index, int32_t disp) {
+    emit_rm(jit, 0x0FB6, 32, dst, base, index, 0, disp);
+}
+
+static void emit_store8(jit_t* jit, int base, int index, int32_t disp, int src) {
+    emit_rm(jit, 0x88, 8, src, base, index, 0, disp);
+}
+
+static void emit_alu8_rr(jit_t* jit, int alu, int dst, int src) {
+    emit_rr(jit, alu * 8, 8, src, dst);
+}
+
+static void emit_alu32_rr(jit_t* jit, int alu, int dst, int src) {
+    emit_rr(jit, alu * 8 + 1, 32, src, dst);
+}
+
+static void emit_lea32(jit_t* jit, int dst, int base, int32_t disp) {
+    emit_rm(jit, 0x8D, 32, dst, base, -1, 0, disp);
+}
+
+static void emit_setcc(jit_t* jit, int cc, int reg) {
+    emit_xr(jit, 0x0F90 | cc, 8, 0, reg);
+}
+
+// CF = bit 0 of reg
+static void emit_bt0(jit_t* jit, int reg) {
+    emit_xr(jit, 0x0FBA, 32, 4, reg);
+    emit8(jit, 0);
+}
+
+static void emit_shift32_ri(jit_t* jit, int shift, int reg, u8 imm) {
+    emit_xr(jit, 0xC1, 32, shift, reg);
+    emit8(jit, imm);
+}
+
+static void emit_call_ptr(jit_t* jit, const void* fn) {
+    emit_mov_ri64(jit, RAX, fn);
+    emit_xr(jit, 0xFF, 32, 2, RAX);
+}
+
+// Branches are always rel32 and patched once the target is known
+static u8* emit_jcc(jit_t* jit, int cc) {
+    emit8(jit, 0x0F);
+    emit8(jit, 0x80 | cc);
+    emit32(jit, 0);
+    return jit->cur - 4;
+}
+
+static u8* emit_jmp(jit_t* jit) {
+    emit8(jit, 0xE9);
+    emit32(jit, 0);
+    return jit->cur - 4;
+}
+
+static void patch_rel32(u8* field, const u8* target) {
+    const int32_t rel = (int32_t)(target - (field + 4));
+    memcpy(field, &rel, 4);
+}
+
+static void emit_push(jit_t* jit, int reg) {
+    if(reg >= R8)
+        emit8(jit, 0x41);
+    emit8(jit, 0x50 + (reg & 7));
+}
+
+static void emit_pop(jit_t* jit, int reg) {
+    if(reg >= R8)
+        emit8(jit, 0x41);
+    emit8(jit, 0x58 + (reg & 7));
+}
+
+// =================================================================================
+// STATE TRANSFER
+// =================================================================================
+
+static const int flag_regs[4] = {R_N, R_Z, R_C, R_V};
+
+static const struct {
+    int reg;
+    size_t offset;
+} cpu_regs[4] = {
+    {R_A, offsetof(cpu_t, a)},
+    {R_X, offsetof(cpu_t, x)},
+    {R_Y, offsetof(cpu_t, y)},
+    {R_SP, offsetof(cpu_t, sp)},
+};
+
+static void emit_save_flags(jit_t* jit, int scratch) {
+    emit_mov_ri64(jit, scratch, jit->flags);
+    for(int i = 0; i < 4; ++i)
+        emit_store8(jit, scratch, -1, i, flag_regs[i]);
+}
+
+static void emit_load_flags(jit_t* jit, int scratch) {
+    emit_mov_ri64(jit, scratch, jit->flags);
+    for(int i = 0; i < 4; ++i)
+        emit_load8(jit, flag_regs[i], scratch, -1, i);
+}
+
+static void emit_save_regs(jit_t* jit) {
+    for(int i = 0; i < 4; ++i)
+        emit_store8(jit, R_CPU, -1, cpu_regs[i].offset, cpu_regs[i].reg);
+}
+
+static void emit_load_regs(jit_t* jit) {
+    for(int i = 0; i < 4; ++i)
+        emit_load8(jit, cpu_regs[i].reg, R_CPU, -1, cpu_regs[i].offset);
+}
+
+// The flag registers are caller-saved, so they are parked in jit->flags
+// around every call. Helpers that need the status register read them there.
+static void emit_call(jit_t* jit, const void* fn) {
+    emit_save_flags(jit, RAX);
+    emit_call_ptr(jit, fn);
+    emit_load_flags(jit, RCX);
+}
+
+static void jit_store_status(jit_t* jit, cpu_t* cpu) {
+    const u8 kept = cpu_get_status(cpu) & (STATUS_I | STATUS_D);
+
+    cpu_set_status(cpu, kept | (jit->flags[0] & STATUS_N) | (jit->flags[1] == 0) << 1 | jit->flags[2] | jit->flags[3] << 6);
+}
+
+static void jit_load_status(jit_t* jit, cpu_t* cpu) {
+    const u8 status = cpu_get_status(cpu);
+
+    jit->flags[0] = status;
+    jit->flags[1] = (status & STATUS_Z) ^ STATUS_Z;
+    jit->flags[2] = status & STATUS_C;
+    jit->flags[3] = (status >> 6) & 1;
+}
+
+// Run one instruction through the interpreter from native code
+static void jit_exec(cpu_t* cpu, u8 (*exec)(cpu_t* cpu, u16 operand), u16 operand) {
+    jit_store_status(cpu->jit, cpu);
+    exec(cpu, operand);
+    jit_load_status(cpu->jit, cpu);
+}
+
+// =================================================================================
+// MEMORY ACCESS
+// =================================================================================
+
+typedef struct jit_block {
+    jit_t* jit;
+    cpu_t* cpu;
+
+    // Totals including the instruction being compiled, used by exits
+    u32 cycles;
+    u32 instrs;
+
+    // Set when the instruction may have run C code that invalidated blocks
+    _Bool called_out;
+
+    // Set when the instruction went through the interpreter, which leaves
+    // the next PC in cpu->pc
+    _Bool fallback;
+} jit_block_t;
+
+static void emit_read_slow(jit_block_t* jb) {
+    emit_rr(jb->jit, 0x89, 64, R_CPU, RDI);
+    emit_mov_rr32(jb->jit, RSI, RCX);
+    emit_call(jb->jit, (const void*)cpu_jit_read);
+    emit_movzx_rr8(jb->jit, RAX, RAX);
+    jb->called_out = 1;
+}
+
+static void emit_write_slow(jit_block_t* jb) {
+    emit_rr(jb->jit, 0x89, 64, R_CPU, RDI);
+    emit_mov_rr32(jb->jit, RSI, RCX);
+    emit_mov_rr32(jb->jit, RDX, RAX);
+    emit_call(jb->jit, (const void*)cpu_jit_write);
+    jb->called_out = 1;
+}
+
+// eax = mem[ecx]
+static void emit_read(jit_block_t* jb) {
+    jit_t* jit = jb->jit;
+
+    emit_mov_rr32(jit, RAX, RCX);
+    emit_shift32_ri(jit, SHIFT_SHR, RAX, 8);
+    emit_rm(jit, 0x8B, 64, RDX, R_CPU, RAX, 3, offsetof(cpu_t, read_map));
+    emit_rr(jit, 0x85, 64, RDX, RDX);
+    u8* slow = emit_jcc(jit, CC_E);
+    emit_movzx_rr8(jit, RSI, RCX);
+    emit_load8(jit, RAX, RDX, RSI, 0);
+    u8* done = emit_jmp(jit);
+
+    patch_rel32(slow, jit->cur);
+    emit_read_slow(jb);
+    patch_rel32(done, jit->cur);
+}
+
+// eax = mem[addr]. The page map only changes through cpu_map, which drops
+// all native code, so mapped pages can be baked in.
+static void emit_read_const(jit_block_t* jb, u16 addr) {
+    const u8* page = jb->cpu->read_map[addr >> 8];
+
+    if(page) {
+        emit_mov_ri64(jb->jit, RAX, page + (addr & 0xFF));
+        emit_load8(jb->jit, RAX, RAX, -1, 0);
+    } else {
+        emit_mov_ri32(jb->jit, RCX, addr);
+        emit_read_slow(jb);
+    }
+}
+
+// mem[ecx] = al. Writes that hit cached code take the slow path so the
+// interpreter can invalidate it.
+static void emit_write(jit_block_t* jb) {
+    jit_t* jit = jb->jit;
+
+    emit_mov_rr32(jit, RDX, RCX);
+    emit_shift32_ri(jit, SHIFT_SHR, RDX, 3);
+    emit_load8(jit, RDX, R_CPU, RDX, offsetof(cpu_t, code_bitmap));
+    emit_mov_rr32(jit, RSI, RCX);
+    emit_xr(jit, 0x83, 32, ALU_AND, RSI);
+    emit8(jit, 7);
+    emit_rr(jit, 0x0FA3, 32, RSI, RDX);
+    u8* code = emit_jcc(jit, CC_B);
+
+    emit_mov_rr32(jit, RDX, RCX);
+    emit_shift32_ri(jit, SHIFT_SHR, RDX, 8);
+    emit_rm(jit, 0x8B, 64, RDX, R_CPU, RDX, 3, offsetof(cpu_t, write_map));
+    emit_rr(jit, 0x85, 64, RDX, RDX);
+    u8* unmapped = emit_jcc(jit, CC_E);
+    emit_movzx_rr8(jit, RSI, RCX);
+    emit_store8(jit, RDX, RSI, 0, RAX);
+    u8* done = emit_jmp(jit);
+
+    patch_rel32(code, jit->cur);
+    patch_rel32(unmapped, jit->cur);
+    emit_write_slow(jb);
+    patch_rel32(done, jit->cur);
+}
+
+// mem[addr] = al
+static void emit_write_const(jit_block_t* jb, u16 addr) {
+    jit_t* jit = jb->jit;
+    u8* page = jb->cpu->write_map[addr >> 8];
+
+    if(!page) {
+        emit_mov_ri32(jit, RCX, addr);
+        emit_write_slow(jb);
+        return;
+    }
+
+    emit_xm(jit, 0xF6, 8, 0, R_CPU, offsetof(cpu_t, code_bitmap) + (addr >> 3));
+    emit8(jit, 1 << (addr & 7));
+    u8* code = emit_jcc(jit, CC_NE);
+    emit_mov_ri64(jit, RDX, page + (addr & 0xFF));
+    emit_store8(jit, RDX, -1, 0, RAX);
+    u8* done = emit_jmp(jit);
+
+    patch_rel32(code, jit->cur);
+    emit_mov_ri32(jit, RCX, addr);
+    emit_write_slow(jb);
+    patch_rel32(done, jit->cur);
+}
+
+// ecx = (lo | hi << 8) from the bytes at FRAME_TEMP and in al
+static void emit_combine_word(jit_t* jit) {
+    emit_shift32_ri(jit, SHIFT_SHL, RAX, 8);
+    emit_load8(jit, RCX, RSP, -1, FRAME_TEMP);
+    emit_alu32_rr(jit, ALU_OR, RCX, RAX);
+}
+
+// Leave the effective address in ecx, or return 1 with *addr set if it is
+// known at compile time
+static _Bool emit_address(jit_block_t* jb, jit_mode_t mode, u16 operand, u16* addr) {
+    jit_t* jit = jb->jit;
+
+    switch(mode) {
+        case JIT_ZERO_PAGE:
+        case JIT_ABSOLUTE:
+            *addr = operand;
+            return 1;
+        case JIT_ZERO_PAGE_X:
+        case JIT_ZERO_PAGE_Y:
+            emit_lea32(jit, RCX, mode == JIT_ZERO_PAGE_X ? R_X : R_Y, operand);
+            emit_movzx_rr8(jit, RCX, RCX);
+            return 0;
+        case JIT_ABSOLUTE_X:
+        case JIT_ABSOLUTE_Y:
+            emit_lea32(jit, RCX, mode == JIT_ABSOLUTE_X ? R_X : R_Y, operand);
+            emit_rr(jit, 0x0FB7, 32, RCX, RCX);
+            return 0;
+        case JIT_INDEXED_INDIRECT:
+            emit_lea32(jit, RCX, R_X, operand);
+            emit_movzx_rr8(jit, RCX, RCX);
+            emit_rm(jit, 0x89, 32, RCX, RSP, -1, 0, FRAME_ADDR);
+            emit_read(jb);
+            emit_store8(jit, RSP, -1, FRAME_TEMP, RAX);
+            emit_rm(jit, 0x8B, 32, RCX, RSP, -1, 0, FRAME_ADDR);
+            emit_xr(jit, 0xFE, 8, 0, RCX);
+            emit_read(jb);
+            emit_combine_word(jit);
+            return 0;
+        case JIT_INDIRECT_INDEXED:
+            emit_read_const(jb, operand & 0xFF);
+            emit_store8(jit, RSP, -1, FRAME_TEMP, RAX);
+            emit_read_const(jb, (operand + 1) & 0xFF);
+            emit_combine_word(jit);
+            emit_alu32_rr(jit, ALU_ADD, RCX, R_Y);
+            emit_rr(jit, 0x0FB7, 32, RCX, RCX);
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// eax = operand value
+static void emit_load_operand(jit_block_t* jb, jit_mode_t mode, u16 operand) {
+    u16 addr;
+
+    if(mode == JIT_IMMEDIATE)
+        emit_mov_ri32(jb->jit, RAX, operand & 0xFF);
+    else if(emit_address(jb, mode, operand, &addr))
+        emit_read_const(jb, addr);
+    else
+        emit_read(jb);
+}
+
+static void emit_store_operand(jit_block_t* jb, jit_mode_t mode, u16 operand, int src) {
+    u16 addr;
+    const _Bool known = emit_address(jb, mode, operand, &addr);
+
+    emit_mov_rr32(jb->jit, RAX, src);
+
+    if(known)
+        emit_write_const(jb, addr);
+    else
+        emit_write(jb);
+}
+
+// ecx = 0x100 + SP
+static void emit_stack_addr(jit_t* jit) {
+    emit_lea32(jit, RCX, R_SP, 0x100);
+}
+
+static void emit_push_value(jit_block_t* jb) {
+    emit_stack_addr(jb->jit);
+    emit_write(jb);
+    emit_xr(jb->jit, 0xFE, 8, 1, R_SP);
+}
+
+static void emit_pull_value(jit_block_t* jb) {
+    emit_xr(jb->jit, 0xFE, 8, 0, R_SP);
+    emit_stack_addr(jb->jit);
+    emit_read(jb);
+}
+
+static void emit_set_nz(jit_t* jit, int reg) {
+    emit_mov_rr32(jit, R_N, reg);
+    emit_mov_rr32(jit, R_Z, reg);
+}
+
+// =================================================================================
+// EXITS
+// =================================================================================
+
+static void emit_account(jit_block_t* jb) {
+    emit_xr(jb->jit, 0x81, 64, ALU_SUB, R_BUDGET);
+    emit32(jb->jit, jb->cycles);
+    emit_xm(jb->jit, 0x81, 32, ALU_SUB, RSP, FRAME_INSTRS);
+    emit32(jb->jit, jb->instrs);
+}
+
+// Jump to the code offset in eax. Clobbers rcx.
+static void emit_jump_entry(jit_t* jit) {
+    // lea rcx, [rip + code]
+    emit_prefix(jit, 64, RCX, 0, 0, 0);
+    emit8(jit, 0x8D);
+    emit8(jit, ((RCX & 7) << 3) | 5);
+    emit32(jit, (u32)(jit->code - (jit->cur + 4)));
+    emit_rr(jit, 0x01, 64, RCX, RAX);
+    emit_xr(jit, 0xFF, 32, 4, RAX);
+}
+
+// Continue at a PC known at compile time
+static void emit_exit_const(jit_block_t* jb, u16 pc) {
+    jit_t* jit = jb->jit;
+
+    emit_account(jb);
+    emit_xm(jit, 0xC7, 16, 0, R_CPU, offsetof(cpu_t, pc));
+    emit16(jit, pc);
+    emit_mov_ri64(jit, RAX, &jit->entries[pc]);
+    emit_rm(jit, 0x8B, 32, RAX, RAX, -1, 0, 0);
+    emit_jump_entry(jit);
+}
+
+// Continue at the PC in ecx
+static void emit_exit_dynamic(jit_block_t* jb) {
+    jit_t* jit = jb->jit;
+
+    emit_account(jb);
+    emit_rm(jit, 0x89, 16, RCX, R_CPU, -1, 0, offsetof(cpu_t, pc));
+    emit_mov_ri64(jit, RAX, jit->entries);
+    emit_rm(jit, 0x8B, 32, RAX, RAX, RCX, 2, 0);
+    emit_jump_entry(jit);
+}
+
+// Leave if C code called by this instruction dropped native code, which
+// may include the rest of this block
+static void emit_check_dirty(jit_block_t* jb, u16 next_pc) {
+    if(!jb->called_out)
+        return;
+
+    emit_mov_ri64(jb->jit, RAX, &jb->jit->dirty);
+    emit_xm(jb->jit, 0x80, 8, ALU_CMP, RAX, 0);
+    emit8(jb->jit, 0);
+    u8* clean = emit_jcc(jb->jit, CC_E);
+    emit_exit_const(jb, next_pc);
+    patch_rel32(clean, jb->jit->cur);
+}
+
+// =================================================================================
+// TRANSLATION
+// =================================================================================
+
+static void emit_fallback(jit_block_t* jb, const decoded_instr_t* decoded) {
+    jit_t* jit = jb->jit;
+
+    emit_save_regs(jit);
+    emit_xm(jit, 0xC7, 16, 0, R_CPU, offsetof(cpu_t, pc));
+    emit16(jit, decoded->next_pc);
+    emit_rr(jit, 0x89, 64, R_CPU, RDI);
+    emit_mov_ri64(jit, RSI, (const void*)decoded->exec);
+    emit_mov_ri32(jit, RDX, decoded->operand);
+    emit_call(jit, (const void*)jit_exec);
+    emit_load_regs(jit);
+    jb->called_out = 1;
+    jb->fallback = 1;
+}
+
+// Decimal ADC and SBC run through the interpreter. Returns the jump over
+// the binary version that follows, for the caller to patch.
+static u8* emit_decimal_check(jit_block_t* jb, const decoded_instr_t* decoded) {
+#ifdef M6502_NO_DECIMAL
+    return NULL;
+#else
+    jit_t* jit = jb->jit;
+
+    emit_xm(jit, 0xF6, 8, 0, R_CPU, offsetof(cpu_t, p));
+    emit8(jit, STATUS_D);
+    u8* binary = emit_jcc(jit, CC_E);
+
+    emit_fallback(jb, decoded);
+    // Neither moves the PC, so the next one is still known
+    jb->fallback = 0;
+    u8* done = emit_jmp(jit);
+
+    patch_rel32(binary, jit->cur);
+    return done;
+#endif
+}
+
+// Read-modify-write on memory, applying op to al
+static void emit_rmw(jit_block_t* jb, jit_mode_t mode, u16 operand, void (*op)(jit_t* jit)) {
+    jit_t* jit = jb->jit;
+    u16 addr;
+
+    // N and Z are set before the write, whose slow path clobbers eax
+    if(emit_address(jb, mode, operand, &addr)) {
+        emit_read_const(jb, addr);
+        op(jit);
+        emit_set_nz(jit, RAX);
+        emit_write_const(jb, addr);
+    } else {
+        emit_rm(jit, 0x89, 32, RCX, RSP, -1, 0, FRAME_ADDR);
+        emit_read(jb);
+        op(jit);
+        emit_set_nz(jit, RAX);
+        emit_rm(jit, 0x8B, 32, RCX, RSP, -1, 0, FRAME_ADDR);
+        emit_write(jb);
+    }
+}
+
+static void op_asl(jit_t* jit) {
+    emit_xr(jit, 0xD0, 8, SHIFT_SHL, RAX);
+    emit_setcc(jit, CC_B, R_C);
+}
+
+static void op_lsr(jit_t* jit) {
+    emit_xr(jit, 0xD0, 8, SHIFT_SHR, RAX);
+    emit_setcc(jit, CC_B, R_C);
+}
+
+static void op_rol(jit_t* jit) {
+    emit_bt0(jit, R_C);
+    emit_xr(jit, 0xD0, 8, SHIFT_RCL, RAX);
+    emit_setcc(jit, CC_B, R_C);
+}
+
+static void op_ror(jit_t* jit) {
+    emit_bt0(jit, R_C);
+    emit_xr(jit, 0xD0, 8, SHIFT_RCR, RAX);
+    emit_setcc(jit, CC_B, R_C);
+}
+
+static void op_inc(jit_t* jit) {
+    emit_xr(jit, 0xFE, 8, 0, RAX);
+}
+
+static void op_dec(jit_t* jit) {
+    emit_xr(jit, 0xFE, 8, 1, RAX);
+}
+
+// Same operations on the accumulator
+static void emit_acc(jit_t* jit, void (*op)(jit_t* jit)) {
+    emit_mov_rr32(jit, RAX, R_A);
+    op(jit);
+    emit_mov_rr32(jit, R_A, RAX);
+    emit_set_nz(jit, R_A);
+}
+
+static void emit_compare(jit_block_t* jb, jit_mode_t mode, u16 operand, int reg) {
+    emit_load_operand(jb, mode, operand);
+    emit_mov_rr32(jb->jit, RCX, reg);
+    emit_alu8_rr(jb->jit, ALU_SUB, RCX, RAX);
+    emit_setcc(jb->jit, CC_AE, R_C);
+    emit_set_nz(jb->jit, RCX);
+}
+
+static void emit_transfer(jit_t* jit, int dst, int src) {
+    emit_mov_rr32(jit, dst, src);
+    emit_set_nz(jit, dst);
+}
+
+static void emit_branch(jit_block_t* jb, const decoded_instr_t* decoded, int reg, u8 mask, _Bool taken_if_set) {
+    jit_t* jit = jb->jit;
+
+    if(mask == 0xFF) {
+        emit_rr(jit, 0x84, 8, reg, reg);
+    } else {
+        emit_xr(jit, 0xF6, 8, 0, reg);
+        emit8(jit, mask);
+    }
+
+    u8* taken = emit_jcc(jit, taken_if_set ? CC_NE : CC_E);
+    emit_exit_const(jb, decoded->next_pc);
+    patch_rel32(taken, jit->cur);
+    emit_exit_const(jb, decoded->next_pc + (int8_t)decoded->operand);
+}
+
+// Returns 1 if the instruction ended the block with its own exit
+static _Bool emit_instr(jit_block_t* jb, const decoded_instr_t* decoded) {
+    jit_t* jit = jb->jit;
+    const jit_opcode_t* opcode = &jit_opcodes[decoded->opcode];
+    const jit_mode_t mode = opcode->mode;
+    const u16 operand = decoded->operand;
+
+    switch(opcode->instr) {
+        case JIT_lda: emit_load_operand(jb, mode, operand); emit_transfer(jit, R_A, RAX); break;
+        case JIT_ldx: emit_load_operand(jb, mode, operand); emit_transfer(jit, R_X, RAX); break;
+        case JIT_ldy: emit_load_operand(jb, mode, operand); emit_transfer(jit, R_Y, RAX); break;
+        case JIT_lax:
+            emit_load_operand(jb, mode, operand);
+            emit_transfer(jit, R_A, RAX);
+            emit_mov_rr32(jit, R_X, RAX);
+            break;
+        case JIT_sta: emit_store_operand(jb, mode, operand, R_A); break;
+        case JIT_stx: emit_store_operand(jb, mode, operand, R_X); break;
+        case JIT_sty: emit_store_operand(jb, mode, operand, R_Y); break;
+        case JIT_sax: {
+            u16 addr;
+            const _Bool known = emit_address(jb, mode, operand, &addr);
+
+            emit_mov_rr32(jit, RAX, R_A);
+            emit_alu32_rr(jit, ALU_AND, RAX, R_X);
+
+            if(known)
+                emit_write_const(jb, addr);
+            else
+                emit_write(jb);
+            break;
+        }
+
+        case JIT_nop:
+            // The multi-byte NOPs still read their operand
+            if(mode != JIT_IMPLICIT)
+                emit_load_operand(jb, mode, operand);
+            break;
+
+        case JIT_and:
+        case JIT_ora:
+        case JIT_eor:
+            emit_load_operand(jb, mode, operand);
+            emit_alu8_rr(jit, opcode->instr == JIT_and ? ALU_AND : opcode->instr == JIT_ora ? ALU_OR : ALU_XOR, R_A, RAX);
+            emit_set_nz(jit, R_A);
+            break;
+        case JIT_adc: {
+            u8* done = emit_decimal_check(jb, decoded);
+            emit_load_operand(jb, mode, operand);
+            emit_bt0(jit, R_C);
+            emit_alu8_rr(jit, ALU_ADC, R_A, RAX);
+            emit_setcc(jit, CC_B, R_C);
+            emit_setcc(jit, CC_O, R_V);
+            emit_set_nz(jit, R_A);
+            if(done)
+                patch_rel32(done, jit->cur);
+            break;
+        }
+        case JIT_sbc: {
+            // x86 borrows where the 6502 carries, so the carry goes in and
+            // comes out inverted
+            u8* done = emit_decimal_check(jb, decoded);
+            emit_load_operand(jb, mode, operand);
+            emit_bt0(jit, R_C);
+            emit8(jit, 0xF5);
+            emit_alu8_rr(jit, ALU_SBB, R_A, RAX);
+            emit_setcc(jit, CC_AE, R_C);
+            emit_setcc(jit, CC_O, R_V);
+            emit_set_nz(jit, R_A);
+            if(done)
+                patch_rel32(done, jit->cur);
+            break;
+        }
+        case JIT_cmp: emit_compare(jb, mode, operand, R_A); break;
+        case JIT_cpx: emit_compare(jb, mode, operand, R_X); break;
+        case JIT_cpy: emit_compare(jb, mode, operand, R_Y); break;
+        case JIT_bit:
+            emit_load_operand(jb, mode, operand);
+            emit_mov_rr32(jit, R_N, RAX);
+            emit_mov_rr32(jit, R_V, RAX);
+            emit_shift32_ri(jit, SHIFT_SHR, R_V, 6);
+            emit_xr(jit, 0x83, 32, ALU_AND, R_V);
+            emit8(jit, 1);
+            emit_mov_rr32(jit, R_Z, R_A);
+            emit_alu32_rr(jit, ALU_AND, R_Z, RAX);
+            break;
+
+        case JIT_inc: emit_rmw(jb, mode, operand, op_inc); break;
+        case JIT_dec: emit_rmw(jb, mode, operand, op_dec); break;
+        case JIT_asl: emit_rmw(jb, mode, operand, op_asl); break;
+        case JIT_lsr: emit_rmw(jb, mode, operand, op_lsr); break;
+        case JIT_rol: emit_rmw(jb, mode, operand, op_rol); break;
+        case JIT_ror: emit_rmw(jb, mode, operand, op_ror); break;
+        case JIT_asl_acc: emit_acc(jit, op_asl); break;
+        case JIT_lsr_acc: emit_acc(jit, op_lsr); break;
+        case JIT_rol_acc: emit_acc(jit, op_rol); break;
+        case JIT_ror_acc: emit_acc(jit, op_ror); break;
+
+        case JIT_inx: emit_xr(jit, 0xFE, 8, 0, R_X); emit_set_nz(jit, R_X); break;
+        case JIT_iny: emit_xr(jit, 0xFE, 8, 0, R_Y); emit_set_nz(jit, R_Y); break;
+        case JIT_dex: emit_xr(jit, 0xFE, 8, 1, R_X); emit_set_nz(jit, R_X); break;
+        case JIT_dey: emit_xr(jit, 0xFE, 8, 1, R_Y); emit_set_nz(jit, R_Y); break;
+        case JIT_tax: emit_transfer(jit, R_X, R_A); break;
+        case JIT_tay: emit_transfer(jit, R_Y, R_A); break;
+        case JIT_txa: emit_transfer(jit, R_A, R_X); break;
+        case JIT_tya: emit_transfer(jit, R_A, R_Y); break;
+        case JIT_tsx: emit_transfer(jit, R_X, R_SP); break;
+        case JIT_txs: emit_mov_rr32(jit, R_SP, R_X); break;
+
+        case JIT_clc: emit_alu32_rr(jit, ALU_XOR, R_C, R_C); break;
+        case JIT_sec: emit_mov_ri32(jit, R_C, 1); break;
+        case JIT_clv: emit_alu32_rr(jit, ALU_XOR, R_V, R_V); break;
+
+        case JIT_pha:
+            emit_mov_rr32(jit, RAX, R_A);
+            emit_push_value(jb);
+            break;
+        case JIT_pla:
+            emit_pull_value(jb);
+            emit_transfer(jit, R_A, RAX);
+            break;
+
+        case JIT_bpl: emit_branch(jb, decoded, R_N, 0x80, 0); return 1;
+        case JIT_bmi: emit_branch(jb, decoded, R_N, 0x80, 1); return 1;
+        case JIT_bvc: emit_branch(jb, decoded, R_V, 0xFF, 0); return 1;
+        case JIT_bvs: emit_branch(jb, decoded, R_V, 0xFF, 1); return 1;
+        case JIT_bcc: emit_branch(jb, decoded, R_C, 0xFF, 0); return 1;
+        case JIT_bcs: emit_branch(jb, decoded, R_C, 0xFF, 1); return 1;
+        case JIT_bne: emit_branch(jb, decoded, R_Z, 0xFF, 1); return 1;
+        case JIT_beq: emit_branch(jb, decoded, R_Z, 0xFF, 0); return 1;
+
+        case JIT_jmp:
+            if(mode == JIT_ABSOLUTE) {
+                emit_exit_const(jb, operand);
+            } else {
+                // JMP ($xxFF) takes the high byte from $xx00
+                emit_read_const(jb, operand);
+                emit_store8(jit, RSP, -1, FRAME_TEMP, RAX);
+                emit_read_const(jb, (operand & 0xFF00) | ((operand + 1) & 0xFF));
+                emit_combine_word(jit);
+                emit_exit_dynamic(jb);
+            }
+            return 1;
+        case JIT_jsr: {
+            const u16 ret = decoded->next_pc - 1;
+
+            emit_mov_ri32(jit, RAX, ret >> 8);
+            emit_push_value(jb);
+            emit_mov_ri32(jit, RAX, ret & 0xFF);
+            emit_push_value(jb);
+            emit_exit_const(jb, operand);
+            return 1;
+        }
+        case JIT_rts:
+            emit_pull_value(jb);
+            emit_store8(jit, RSP, -1, FRAME_TEMP, RAX);
+            emit_pull_value(jb);
+            emit_combine_word(jit);
+            emit_xr(jit, 0xFF, 32, 0, RCX);
+            emit_rr(jit, 0x0FB7, 32, RCX, RCX);
+            emit_exit_dynamic(jb);
+            return 1;
+
+        default:
+            emit_fallback(jb, decoded);
+            break;
+    }
+
+    return 0;
+}
+
+// Only the pages a block is being emitted into are ever writable, and
+// only while it is. Everything else stays read and execute.
+static _Bool jit_protect(jit_t* jit, u8* at, _Bool writable) {
+    u8* start = jit->code + ((at - jit->code) & ~(JIT_PAGE_SIZE - 1));
+    u8* end = jit->code + ((at - jit->code + JIT_MAX_BLOCK_CODE + JIT_PAGE_SIZE - 1) & ~(JIT_PAGE_SIZE - 1));
+
+    return mprotect(start, end - start, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+_Bool jit_compile(jit_t* jit, cpu_t* cpu, block_t* block) {
+    if(jit->code + JIT_CODE_SIZE - jit->cur < JIT_MAX_BLOCK_CODE)
+        return 0;
+
+    jit_block_t jb = {jit, cpu, 0, 0, 0, 0};
+    u8* entry = jit->cur;
+
+    if(!jit_protect(jit, entry, 1))
+        return 0;
+
+    u32 total = 0;
+    for(u8 i = 0; i < block->len; ++i)
+        total += block->instrs[i].cycles;
+    block->min_budget = total - block->instrs[block->len - 1].cycles;
+
+    // Bail out unless the whole block fits in what is left, so that it
+    // stops exactly where the interpreter would. Whoever jumped here has
+    // already stored the PC.
+    emit_xr(jit, 0x81, 64, ALU_CMP, R_BUDGET);
+    emit32(jit, block->min_budget);
+    patch_rel32(emit_jcc(jit, CC_LE), jit->exit_stub);
+    emit_xm(jit, 0x81, 32, ALU_CMP, RSP, FRAME_INSTRS);
+    emit32(jit, block->len);
+    patch_rel32(emit_jcc(jit, CC_B), jit->exit_stub);
+
+    for(u8 i = 0; i < block->len; ++i) {
+        const decoded_instr_t* decoded = &block->instrs[i];
+
+        jb.cycles += decoded->cycles;
+        jb.instrs++;
+        jb.called_out = 0;
+        jb.fallback = 0;
+
+        if(emit_instr(&jb, decoded))
+            break;
+
+        if(i != block->len - 1) {
+            emit_check_dirty(&jb, decoded->next_pc);
+        } else if(jb.fallback) {
+            // Go wherever the interpreter left the PC
+            emit_rm(jit, 0x0FB7, 32, RCX, R_CPU, -1, 0, offsetof(cpu_t, pc));
+            emit_exit_dynamic(&jb);
+        } else {
+            // The block was cut short by its size limit or unmapped memory
+            emit_exit_const(&jb, decoded->next_pc);
+        }
+    }
+
+    jit_protect(jit, entry, 0);
+
+    block->native = entry;
+    jit->entries[block->start] = (u32)(entry - jit->code);
+
+    return 1;
+}
+
+// =================================================================================
+// RUNTIME
+// =================================================================================
+
+static void jit_emit_stubs(jit_t* jit) {
+    static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+
+    // Has to come first, a zero entry means no native code
+    jit->exit_stub = jit->cur;
+    emit_mov_ri64(jit, RAX, jit);
+    emit_rm(jit, 0x89, 64, R_BUDGET, RAX, -1, 0, offsetof(jit_t, budget));
+    emit_rm(jit, 0x8B, 32, RCX, RSP, -1, 0, FRAME_INSTRS);
+    emit_rm(jit, 0x89, 32, RCX, RAX, -1, 0, offsetof(jit_t, instrs_left));
+    emit_save_flags(jit, RAX);
+    emit_save_regs(jit);
+    emit_xr(jit, 0x83, 64, ALU_ADD, RSP);
+    emit8(jit, FRAME_SIZE);
+    for(int i = 5; i >= 0; --i)
+        emit_pop(jit, saved[i]);
+    emit8(jit, 0xC3);
+
+    // void enter(cpu_t* cpu, void* entry)
+    jit->enter = (void (*)(cpu_t*, void*))(uintptr_t)jit->cur;
+    for(int i = 0; i < 6; ++i)
+        emit_push(jit, saved[i]);
+    emit_xr(jit, 0x83, 64, ALU_SUB, RSP);
+    emit8(jit, FRAME_SIZE);
+    emit_rr(jit, 0x89, 64, RDI, R_CPU);
+    emit_mov_ri64(jit, RAX, jit);
+    emit_rm(jit, 0x8B, 64, R_BUDGET, RAX, -1, 0, offsetof(jit_t, budget));
+    emit_rm(jit, 0x8B, 32, RCX, RAX, -1, 0, offsetof(jit_t, instrs_left));
+    emit_rm(jit, 0x89, 32, RCX, RSP, -1, 0, FRAME_INSTRS);
+    emit_load_flags(jit, RAX);
+    emit_load_regs(jit);
+    emit_xr(jit, 0xFF, 32, 4, RSI);
+
+    jit->blocks_start = jit->cur;
+}
+
+jit_t* jit_create(void) {
+    jit_t* jit = calloc(1, sizeof(jit_t));
+    if(!jit)
+        return NULL;
+
+    // Never writable and executable at the same time. Blocks open up the
+    // pages they are emitted into with jit_protect.
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->code == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+
+    jit->entries = mmap(NULL, JIT_ENTRIES_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->entries == MAP_FAILED) {
+        munmap(jit->code, JIT_CODE_SIZE);
+        free(jit);
+        return NULL;
+    }
+
+    jit->cur = jit->code;
+    jit_emit_stubs(jit);
+
+    if(mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        jit_destroy(jit);
+        return NULL;
+    }
+
+    return jit;
+}
+
+void jit_destroy(jit_t* jit) {
+    munmap(jit->entries, JIT_ENTRIES_SIZE);
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+}
+
+void jit_flush(jit_t* jit) {
+    // Hands the pages back, they read as zero again on the next access
+    madvise(jit->entries, JIT_ENTRIES_SIZE, MADV_DONTNEED);
+
+    jit->cur = jit->blocks_start;
+    jit->dirty = 1;
+}
+
+void jit_unlink(jit_t* jit, block_t* block) {
+    jit->entries[block->start] = 0;
+    block->native = NULL;
+    jit->dirty = 1;
+}
+
+u32 jit_run(jit_t* jit, cpu_t* cpu, block_t* block, u32 budget, u32* n) {
+    jit->budget = budget;
+    jit->instrs_left = *n;
+    jit->dirty = 0;
+    jit_load_status(jit, cpu);
+
+    cpu->pc = block->start;
+    jit->enter(cpu, block->native);
+
+    jit_store_status(jit, cpu);
+    *n = jit->instrs_left;
+
+    return (u32)((int64_t)budget - jit->budget);
+}
+
+#endif
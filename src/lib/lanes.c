@@ -0,0 +1,793 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lanes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define STACK_START 0x0100
+
+// =================================================================================
+// VECTORS
+// =================================================================================
+
+// One byte per lane, including the PC, which is split into a low and a high
+// half. Staying at one element width keeps every operation a plain vector
+// instruction; GCC breaks conversions between widths up into single lanes.
+// Comparisons give masks of all ones or all zeros.
+typedef u8 vec8_t __attribute__((vector_size(LANES_WIDTH)));
+typedef int8_t mask8_t __attribute__((vector_size(LANES_WIDTH)));
+
+static ALWAYS_INLINE vec8_t splat8(u8 val) {
+    return (vec8_t){0} + val;
+}
+
+static ALWAYS_INLINE vec8_t select8(mask8_t mask, vec8_t a, vec8_t b) {
+    return b ^ ((a ^ b) & (vec8_t)mask);
+}
+
+static ALWAYS_INLINE _Bool any(mask8_t mask) {
+    u64 words[LANES_WIDTH / 8];
+    memcpy(words, &mask, sizeof(words));
+
+    u64 all = 0;
+    for(u32 i = 0; i < LANES_WIDTH / 8; ++i)
+        all |= words[i];
+
+    return all != 0;
+}
+
+// Index of the first lane in mask, which must have one
+static ALWAYS_INLINE u32 first(mask8_t mask) {
+    u64 words[LANES_WIDTH / 8];
+    memcpy(words, &mask, sizeof(words));
+
+    u32 i = 0;
+    while(words[i] == 0)
+        ++i;
+
+    return i * 8 + __builtin_ctzll(words[i]) / 8;
+}
+
+static ALWAYS_INLINE u8 smallest(vec8_t val) {
+    u8 elems[LANES_WIDTH];
+    memcpy(elems, &val, sizeof(elems));
+
+    u8 min = 0xFF;
+    for(u32 i = 0; i < LANES_WIDTH; ++i)
+        min = elems[i] < min ? elems[i] : min;
+
+    return min;
+}
+
+// lo:hi + val, carrying into hi
+static ALWAYS_INLINE void add16(vec8_t* lo, vec8_t* hi, vec8_t val) {
+    *lo += val;
+    *hi -= (vec8_t)(*lo < val);
+}
+
+// =================================================================================
+// OPCODES
+// =================================================================================
+
+typedef enum lanes_instr {
+    LANES_adc, LANES_and, LANES_asl, LANES_asl_acc, LANES_bcc, LANES_bcs, LANES_beq, LANES_bit,
+    LANES_bmi, LANES_bne, LANES_bpl, LANES_brk, LANES_bvc, LANES_bvs, LANES_clc, LANES_cld,
+    LANES_cli, LANES_clv, LANES_cmp, LANES_cpx, LANES_cpy, LANES_dec, LANES_dex, LANES_dey,
+    LANES_eor, LANES_inc, LANES_inx, LANES_iny, LANES_jmp, LANES_jsr, LANES_lda, LANES_ldx,
+    LANES_ldy, LANES_lsr, LANES_lsr_acc, LANES_nop, LANES_ora, LANES_pha, LANES_php, LANES_pla,
+    LANES_plp, LANES_rol, LANES_rol_acc, LANES_ror, LANES_ror_acc, LANES_rti, LANES_rts, LANES_sbc,
+    LANES_sec, LANES_sed, LANES_sei, LANES_sta, LANES_stx, LANES_sty, LANES_tax, LANES_tay,
+    LANES_tsx, LANES_txa, LANES_txs, LANES_tya,
+
+    // Undocumented
+    LANES_alr, LANES_anc, LANES_ane, LANES_arr, LANES_dcp, LANES_isc, LANES_kil, LANES_las,
+    LANES_lax, LANES_lxa, LANES_rla, LANES_rra, LANES_sax, LANES_sbx, LANES_sha, LANES_shx,
+    LANES_shy, LANES_slo, LANES_sre, LANES_tas,
+} lanes_instr_t;
+
+typedef enum lanes_mode {
+    LANES_IMPLICIT,
+    LANES_ACCUMULATOR,
+    LANES_IMMEDIATE,
+    LANES_ZERO_PAGE,
+    LANES_ZERO_PAGE_X,
+    LANES_ZERO_PAGE_Y,
+    LANES_RELATIVE,
+    LANES_ABSOLUTE,
+    LANES_ABSOLUTE_X,
+    LANES_ABSOLUTE_Y,
+    LANES_INDIRECT,
+    LANES_INDEXED_INDIRECT,
+    LANES_INDIRECT_INDEXED,
+} lanes_mode_t;
+
+typedef struct lanes_opcode {
+    u8 instr;
+    u8 mode;
+    u8 cycles;
+} lanes_opcode_t;
+
+#define OPCODE(code, instr, mode, access, cycles, legal) [code] = {LANES_##instr, LANES_##mode, cycles},
+static const lanes_opcode_t lanes_opcodes[256] = {
+#include "opcodes.h"
+};
+
+// Operand bytes after the opcode
+static const u8 lanes_operand_size[LANES_INDIRECT_INDEXED + 1] = {
+    [LANES_IMMEDIATE] = 1,
+    [LANES_ZERO_PAGE] = 1,
+    [LANES_ZERO_PAGE_X] = 1,
+    [LANES_ZERO_PAGE_Y] = 1,
+    [LANES_RELATIVE] = 1,
+    [LANES_ABSOLUTE] = 2,
+    [LANES_ABSOLUTE_X] = 2,
+    [LANES_ABSOLUTE_Y] = 2,
+    [LANES_INDIRECT] = 2,
+    [LANES_INDEXED_INDIRECT] = 1,
+    [LANES_INDIRECT_INDEXED] = 1,
+};
+
+// =================================================================================
+// MEMORY
+// =================================================================================
+
+static ALWAYS_INLINE vec8_t lanes_row(const lanes_t* lanes, u16 addr) {
+    vec8_t row;
+    memcpy(&row, lanes->mem[addr], sizeof(row));
+    return row;
+}
+
+static ALWAYS_INLINE void lanes_set_row(lanes_t* lanes, u16 addr, vec8_t row) {
+    memcpy(lanes->mem[addr], &row, sizeof(row));
+}
+
+// Where an instruction's operand is in each lane. Lanes usually agree, in
+// which case the whole access is one row.
+typedef struct lanes_addr {
+    vec8_t lo, hi;
+    u16 first;
+    _Bool uniform;
+} lanes_addr_t;
+
+static ALWAYS_INLINE lanes_addr_t lanes_uniform(u16 addr) {
+    return (lanes_addr_t){.lo = splat8(addr & 0xFF), .hi = splat8(addr >> 8), .first = addr, .uniform = 1};
+}
+
+// lead is any active lane
+static ALWAYS_INLINE lanes_addr_t lanes_indexed(vec8_t lo, vec8_t hi, mask8_t active, u32 lead) {
+    const u16 first = lo[lead] | (hi[lead] << 8);
+    const mask8_t differs = ((lo != (u8)first) | (hi != (u8)(first >> 8))) & active;
+
+    return (lanes_addr_t){.lo = lo, .hi = hi, .first = first, .uniform = !any(differs)};
+}
+
+static ALWAYS_INLINE vec8_t lanes_read(const lanes_t* lanes, const lanes_addr_t* at, mask8_t active) {
+    if(at->uniform)
+        return lanes_row(lanes, at->first);
+
+    vec8_t val = {0};
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        if(active[lane])
+            val[lane] = lanes->mem[at->lo[lane] | (at->hi[lane] << 8)][lane];
+    }
+
+    return val;
+}
+
+static ALWAYS_INLINE void lanes_write(lanes_t* lanes, const lanes_addr_t* at, vec8_t val, mask8_t active) {
+    if(at->uniform) {
+        lanes_set_row(lanes, at->first, select8(active, val, lanes_row(lanes, at->first)));
+        return;
+    }
+
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        if(active[lane])
+            lanes->mem[at->lo[lane] | (at->hi[lane] << 8)][lane] = val[lane];
+    }
+}
+
+static ALWAYS_INLINE lanes_addr_t lanes_stack(vec8_t sp, mask8_t active, u32 lead) {
+    return lanes_indexed(sp, splat8(STACK_START >> 8), active, lead);
+}
+
+// =================================================================================
+// SCALAR FALLBACK
+// =================================================================================
+
+static u8 lanes_read_bus(void* bus, const u16 addr) {
+    lanes_t* lanes = bus;
+    return lanes->mem[addr][lanes->lane];
+}
+
+static void lanes_write_bus(void* bus, const u16 addr, const u8 val) {
+    lanes_t* lanes = bus;
+    lanes->mem[addr][lanes->lane] = val;
+}
+
+// Run one instruction of lane on the scalar CPU. Nothing is mapped, so it
+// caches no code and every access reaches the lane's column.
+static void lanes_step_scalar(lanes_t* lanes, u32 lane) {
+    cpu_t* cpu = &lanes->scalar;
+
+    lanes->lane = lane;
+
+    cpu->pc = lanes->pc[lane];
+    cpu->a = lanes->a[lane];
+    cpu->x = lanes->x[lane];
+    cpu->y = lanes->y[lane];
+    cpu->sp = lanes->sp[lane];
+    cpu_set_status(cpu, lanes->p[lane]);
+    cpu->cycles = 0;
+
+    cpu_run_instructions(cpu, 1);
+
+    lanes->pc[lane] = cpu->pc;
+    lanes->a[lane] = cpu->a;
+    lanes->x[lane] = cpu->x;
+    lanes->y[lane] = cpu->y;
+    lanes->sp[lane] = cpu->sp;
+    lanes->p[lane] = cpu_get_status(cpu);
+
+    ++lanes->fallbacks;
+}
+
+// =================================================================================
+// EXECUTION
+// =================================================================================
+
+typedef struct lanes_regs {
+    vec8_t pcl, pch;
+    vec8_t a, x, y, sp, p;
+} lanes_regs_t;
+
+static ALWAYS_INLINE vec8_t lanes_nz(vec8_t p, vec8_t res) {
+    return (p & (u8)~(STATUS_N | STATUS_Z)) | (res & STATUS_N) | ((vec8_t)(res == 0) & STATUS_Z);
+}
+
+static ALWAYS_INLINE vec8_t lanes_c(vec8_t p, mask8_t carry) {
+    return (p & (u8)~STATUS_C) | ((vec8_t)carry & STATUS_C);
+}
+
+static ALWAYS_INLINE vec8_t lanes_carry(vec8_t p) {
+    return p & STATUS_C;
+}
+
+// Binary ADC, and SBC with val inverted
+static ALWAYS_INLINE void lanes_adc(lanes_regs_t* r, vec8_t val, vec8_t* a, vec8_t* p) {
+    const vec8_t sum = r->a + val;
+    const vec8_t res = sum + lanes_carry(r->p);
+    const mask8_t carry = (sum < r->a) | (res < sum);
+    const vec8_t overflow = ~(r->a ^ val) & (r->a ^ res) & 0x80;
+
+    *a = res;
+    *p = lanes_nz(lanes_c(r->p, carry), res);
+    *p = (*p & (u8)~STATUS_V) | (overflow >> 1);
+}
+
+// Run the instruction for the active lanes. Lanes it can't do as vectors
+// are taken out of active and returned, for the scalar CPU.
+static ALWAYS_INLINE mask8_t lanes_exec(lanes_t* lanes, lanes_regs_t* r, u8 opcode, u16 pc, u16 operand, mask8_t* active, u32 lead) {
+    const lanes_opcode_t* op = &lanes_opcodes[opcode];
+    const u16 next = pc + 1 + lanes_operand_size[op->mode];
+
+    mask8_t on = *active;
+
+    lanes_addr_t at = lanes_uniform(operand);
+    switch(op->mode) {
+        case LANES_ZERO_PAGE_X:
+            at = lanes_indexed(r->x + (u8)operand, splat8(0), on, lead);
+            break;
+        case LANES_ZERO_PAGE_Y:
+            at = lanes_indexed(r->y + (u8)operand, splat8(0), on, lead);
+            break;
+        case LANES_ABSOLUTE_X:
+        case LANES_ABSOLUTE_Y: {
+            vec8_t lo = splat8(operand & 0xFF), hi = splat8(operand >> 8);
+            add16(&lo, &hi, op->mode == LANES_ABSOLUTE_X ? r->x : r->y);
+            at = lanes_indexed(lo, hi, on, lead);
+            break;
+        }
+        case LANES_INDEXED_INDIRECT: {
+            const vec8_t ptr = r->x + (u8)operand;
+            const lanes_addr_t lo = lanes_indexed(ptr, splat8(0), on, lead);
+            const lanes_addr_t hi = lanes_indexed(ptr + 1, splat8(0), on, lead);
+            at = lanes_indexed(lanes_read(lanes, &lo, on), lanes_read(lanes, &hi, on), on, lead);
+            break;
+        }
+        case LANES_INDIRECT_INDEXED: {
+            vec8_t lo = lanes_row(lanes, operand), hi = lanes_row(lanes, (u8)(operand + 1));
+            add16(&lo, &hi, r->y);
+            at = lanes_indexed(lo, hi, on, lead);
+            break;
+        }
+        default:
+            break;
+    }
+
+    vec8_t a = r->a, x = r->x, y = r->y, sp = r->sp, p = r->p;
+    vec8_t pcl = splat8(next & 0xFF), pch = splat8(next >> 8);
+    mask8_t fallback = {0};
+
+    // The operand for instructions that read one
+    const vec8_t val = op->mode == LANES_IMMEDIATE ? splat8(operand) : lanes_read(lanes, &at, on);
+
+    switch(op->instr) {
+        case LANES_lda:
+            a = val;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_ldx:
+            x = val;
+            p = lanes_nz(p, x);
+            break;
+        case LANES_ldy:
+            y = val;
+            p = lanes_nz(p, y);
+            break;
+        case LANES_sta:
+            lanes_write(lanes, &at, r->a, on);
+            break;
+        case LANES_stx:
+            lanes_write(lanes, &at, r->x, on);
+            break;
+        case LANES_sty:
+            lanes_write(lanes, &at, r->y, on);
+            break;
+
+        case LANES_tax:
+            x = r->a;
+            p = lanes_nz(p, x);
+            break;
+        case LANES_tay:
+            y = r->a;
+            p = lanes_nz(p, y);
+            break;
+        case LANES_txa:
+            a = r->x;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_tya:
+            a = r->y;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_tsx:
+            x = r->sp;
+            p = lanes_nz(p, x);
+            break;
+        case LANES_txs:
+            sp = r->x;
+            break;
+
+        case LANES_inx:
+            x = r->x + 1;
+            p = lanes_nz(p, x);
+            break;
+        case LANES_iny:
+            y = r->y + 1;
+            p = lanes_nz(p, y);
+            break;
+        case LANES_dex:
+            x = r->x - 1;
+            p = lanes_nz(p, x);
+            break;
+        case LANES_dey:
+            y = r->y - 1;
+            p = lanes_nz(p, y);
+            break;
+        case LANES_inc: {
+            const vec8_t res = val + 1;
+            lanes_write(lanes, &at, res, on);
+            p = lanes_nz(p, res);
+            break;
+        }
+        case LANES_dec: {
+            const vec8_t res = val - 1;
+            lanes_write(lanes, &at, res, on);
+            p = lanes_nz(p, res);
+            break;
+        }
+
+        case LANES_and:
+            a = r->a & val;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_ora:
+            a = r->a | val;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_eor:
+            a = r->a ^ val;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_bit:
+            p = (p & (u8)~(STATUS_N | STATUS_V | STATUS_Z)) | (val & (STATUS_N | STATUS_V)) | ((vec8_t)((r->a & val) == 0) & STATUS_Z);
+            break;
+
+        case LANES_adc:
+        case LANES_sbc:
+#ifndef M6502_NO_DECIMAL
+            // Decimal mode is left to the scalar CPU
+            fallback = on & (mask8_t)((r->p & STATUS_D) != 0);
+            on &= ~fallback;
+#endif
+            lanes_adc(r, op->instr == LANES_sbc ? ~val : val, &a, &p);
+            break;
+        case LANES_cmp:
+            p = lanes_nz(lanes_c(p, r->a >= val), r->a - val);
+            break;
+        case LANES_cpx:
+            p = lanes_nz(lanes_c(p, r->x >= val), r->x - val);
+            break;
+        case LANES_cpy:
+            p = lanes_nz(lanes_c(p, r->y >= val), r->y - val);
+            break;
+
+        case LANES_asl_acc:
+            p = lanes_c(p, (mask8_t)(r->a >= 0x80));
+            a = r->a << 1;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_lsr_acc:
+            p = lanes_c(p, (mask8_t)((r->a & 1) != 0));
+            a = r->a >> 1;
+            p = lanes_nz(p, a);
+            break;
+        case LANES_rol_acc:
+            p = lanes_c(p, (mask8_t)(r->a >= 0x80));
+            a = (r->a << 1) | lanes_carry(r->p);
+            p = lanes_nz(p, a);
+            break;
+        case LANES_ror_acc:
+            p = lanes_c(p, (mask8_t)((r->a & 1) != 0));
+            a = (r->a >> 1) | (lanes_carry(r->p) << 7);
+            p = lanes_nz(p, a);
+            break;
+        case LANES_asl:
+        case LANES_lsr:
+        case LANES_rol:
+        case LANES_ror: {
+            const _Bool left = op->instr == LANES_asl || op->instr == LANES_rol;
+            const vec8_t in = op->instr == LANES_rol ? lanes_carry(r->p) : op->instr == LANES_ror ? lanes_carry(r->p) << 7 : splat8(0);
+            const vec8_t res = (left ? val << 1 : val >> 1) | in;
+
+            p = lanes_c(p, left ? (mask8_t)(val >= 0x80) : (mask8_t)((val & 1) != 0));
+            lanes_write(lanes, &at, res, on);
+            p = lanes_nz(p, res);
+            break;
+        }
+
+        case LANES_bpl:
+        case LANES_bmi:
+        case LANES_bvc:
+        case LANES_bvs:
+        case LANES_bcc:
+        case LANES_bcs:
+        case LANES_bne:
+        case LANES_beq: {
+            // Bits 7-6 pick N, V, C or Z and bit 5 is the value that takes
+            // the branch
+            static const u8 flags[4] = {STATUS_N, STATUS_V, STATUS_C, STATUS_Z};
+            const mask8_t set = (r->p & flags[opcode >> 6]) != 0;
+            const mask8_t taken = (opcode & 0x20) ? set : ~set;
+
+            const u16 target = next + (int8_t)operand;
+            pcl = select8(taken, splat8(target & 0xFF), pcl);
+            pch = select8(taken, splat8(target >> 8), pch);
+            break;
+        }
+
+        case LANES_jmp:
+            if(op->mode == LANES_ABSOLUTE) {
+                pcl = splat8(operand & 0xFF);
+                pch = splat8(operand >> 8);
+            } else {
+                // The pointer's high byte doesn't carry into the next page
+                pcl = lanes_row(lanes, operand);
+                pch = lanes_row(lanes, (operand & 0xFF00) | ((operand + 1) & 0xFF));
+            }
+            break;
+        case LANES_jsr: {
+            const lanes_addr_t hi = lanes_stack(r->sp, on, lead);
+            const lanes_addr_t lo = lanes_stack(r->sp - 1, on, lead);
+            lanes_write(lanes, &hi, splat8((next - 1) >> 8), on);
+            lanes_write(lanes, &lo, splat8((next - 1) & 0xFF), on);
+            sp = r->sp - 2;
+            pcl = splat8(operand & 0xFF);
+            pch = splat8(operand >> 8);
+            break;
+        }
+        case LANES_rts: {
+            const lanes_addr_t lo = lanes_stack(r->sp + 1, on, lead);
+            const lanes_addr_t hi = lanes_stack(r->sp + 2, on, lead);
+            pcl = lanes_read(lanes, &lo, on);
+            pch = lanes_read(lanes, &hi, on);
+            add16(&pcl, &pch, splat8(1));
+            sp = r->sp + 2;
+            break;
+        }
+        case LANES_brk: {
+            // Skips the byte after the opcode
+            const u16 ret = next + 1;
+            const lanes_addr_t hi = lanes_stack(r->sp, on, lead);
+            const lanes_addr_t lo = lanes_stack(r->sp - 1, on, lead);
+            const lanes_addr_t status = lanes_stack(r->sp - 2, on, lead);
+            lanes_write(lanes, &hi, splat8(ret >> 8), on);
+            lanes_write(lanes, &lo, splat8(ret & 0xFF), on);
+            lanes_write(lanes, &status, r->p | STATUS_B | STATUS_U, on);
+            sp = r->sp - 3;
+            p |= STATUS_I;
+            pcl = lanes_row(lanes, IRQ_START);
+            pch = lanes_row(lanes, IRQ_START + 1);
+            break;
+        }
+        case LANES_rti: {
+            const lanes_addr_t status = lanes_stack(r->sp + 1, on, lead);
+            const lanes_addr_t lo = lanes_stack(r->sp + 2, on, lead);
+            const lanes_addr_t hi = lanes_stack(r->sp + 3, on, lead);
+            p = (lanes_read(lanes, &status, on) | STATUS_U) & (u8)~STATUS_B;
+            pcl = lanes_read(lanes, &lo, on);
+            pch = lanes_read(lanes, &hi, on);
+            sp = r->sp + 3;
+            break;
+        }
+        case LANES_pha: {
+            const lanes_addr_t top = lanes_stack(r->sp, on, lead);
+            lanes_write(lanes, &top, r->a, on);
+            sp = r->sp - 1;
+            break;
+        }
+        case LANES_php: {
+            const lanes_addr_t top = lanes_stack(r->sp, on, lead);
+            lanes_write(lanes, &top, r->p | STATUS_B | STATUS_U, on);
+            sp = r->sp - 1;
+            break;
+        }
+        case LANES_pla: {
+            sp = r->sp + 1;
+            const lanes_addr_t top = lanes_stack(sp, on, lead);
+            a = lanes_read(lanes, &top, on);
+            p = lanes_nz(p, a);
+            break;
+        }
+        case LANES_plp: {
+            sp = r->sp + 1;
+            const lanes_addr_t top = lanes_stack(sp, on, lead);
+            p = (lanes_read(lanes, &top, on) | STATUS_U) & (u8)~STATUS_B;
+            break;
+        }
+
+        case LANES_clc:
+            p &= (u8)~STATUS_C;
+            break;
+        case LANES_sec:
+            p |= STATUS_C;
+            break;
+        case LANES_cli:
+            p &= (u8)~STATUS_I;
+            break;
+        case LANES_sei:
+            p |= STATUS_I;
+            break;
+        case LANES_cld:
+            p &= (u8)~STATUS_D;
+            break;
+        case LANES_sed:
+            p |= STATUS_D;
+            break;
+        case LANES_clv:
+            p &= (u8)~STATUS_V;
+            break;
+
+        // Operand reads have no side effects in RAM, so every NOP is a skip
+        case LANES_nop:
+            break;
+        case LANES_kil:
+#ifdef M6502_HALT_ON_KIL
+            pcl = splat8(pc & 0xFF);
+            pch = splat8(pc >> 8);
+#endif
+            break;
+
+        // The rest of the undocumented opcodes are rare enough
+        default:
+            fallback = on;
+            on = (mask8_t){0};
+            break;
+    }
+
+    r->pcl = select8(on, pcl, r->pcl);
+    r->pch = select8(on, pch, r->pch);
+    r->a = select8(on, a, r->a);
+    r->x = select8(on, x, r->x);
+    r->y = select8(on, y, r->y);
+    r->sp = select8(on, sp, r->sp);
+    r->p = select8(on, p, r->p);
+
+    *active = on;
+
+    return fallback;
+}
+
+// Cycles and instructions are counted per lane in bytes, which are moved to
+// the 32-bit counts every LANES_FLUSH steps, before they can wrap: no
+// instruction takes more than 8 cycles. room is how much further each lane
+// may go until then, capped to a byte as well.
+#define LANES_FLUSH 31
+
+typedef struct lanes_clock {
+    u32 budget;
+    u32 elapsed[LANES_WIDTH];
+    u32 instructions[LANES_WIDTH];
+
+    vec8_t used, count, room;
+} lanes_clock_t;
+
+static void lanes_flush(lanes_clock_t* clock) {
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        clock->elapsed[lane] += clock->used[lane];
+        clock->instructions[lane] += clock->count[lane];
+
+        const u32 left = clock->elapsed[lane] < clock->budget ? clock->budget - clock->elapsed[lane] : 0;
+        clock->room[lane] = left < 0xFF ? left : 0xFF;
+    }
+
+    clock->used = clock->count = splat8(0);
+}
+
+static void lanes_get_regs(const lanes_t* lanes, lanes_regs_t* r) {
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        r->pcl[lane] = lanes->pc[lane] & 0xFF;
+        r->pch[lane] = lanes->pc[lane] >> 8;
+    }
+
+    memcpy(&r->a, lanes->a, sizeof(r->a));
+    memcpy(&r->x, lanes->x, sizeof(r->x));
+    memcpy(&r->y, lanes->y, sizeof(r->y));
+    memcpy(&r->sp, lanes->sp, sizeof(r->sp));
+    memcpy(&r->p, lanes->p, sizeof(r->p));
+}
+
+static void lanes_set_regs(lanes_t* lanes, const lanes_regs_t* r) {
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane)
+        lanes->pc[lane] = r->pcl[lane] | (r->pch[lane] << 8);
+
+    memcpy(lanes->a, &r->a, sizeof(r->a));
+    memcpy(lanes->x, &r->x, sizeof(r->x));
+    memcpy(lanes->y, &r->y, sizeof(r->y));
+    memcpy(lanes->sp, &r->sp, sizeof(r->sp));
+    memcpy(lanes->p, &r->p, sizeof(r->p));
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+_Bool lanes_init(lanes_t* lanes) {
+    memset(lanes, 0, sizeof(lanes_t));
+
+    void* mem;
+    if(posix_memalign(&mem, LANES_ALIGN, 0x10000 * sizeof(*lanes->mem)) != 0)
+        return 0;
+
+    lanes->mem = mem;
+
+    memset(lanes->mem, 0, 0x10000 * sizeof(*lanes->mem));
+
+    lanes->scalar.bus = lanes;
+    lanes->scalar.read_bus = lanes_read_bus;
+    lanes->scalar.write_bus = lanes_write_bus;
+
+    return 1;
+}
+
+void lanes_free(lanes_t* lanes) {
+    cpu_release(&lanes->scalar);
+    free(lanes->mem);
+    lanes->mem = NULL;
+}
+
+void lanes_load(lanes_t* lanes, u16 addr, const void* data, u32 size) {
+    const u8* bytes = data;
+
+    for(u32 i = 0; i < size && addr + i < 0x10000; ++i)
+        memset(lanes->mem[addr + i], bytes[i], LANES_WIDTH);
+}
+
+void lanes_reset(lanes_t* lanes) {
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        lanes->pc[lane] = lanes->mem[RST_START][lane] | (lanes->mem[RST_START + 1][lane] << 8);
+        lanes->a[lane] = lanes->x[lane] = lanes->y[lane] = 0;
+        lanes->sp[lane] = 0xFD;
+        lanes->p[lane] = STATUS_U;
+    }
+}
+
+void lanes_run(lanes_t* lanes, u32 budget) {
+    lanes_regs_t r;
+    lanes_get_regs(lanes, &r);
+
+    lanes_clock_t clock = {.budget = budget};
+    lanes_flush(&clock);
+
+    u32 lead = 0;
+
+    for(u32 steps = 0;; ++steps) {
+        if(steps == LANES_FLUSH) {
+            lanes_flush(&clock);
+            steps = 0;
+        }
+
+        const mask8_t live = clock.used < clock.room;
+        if(!any(live))
+            break;
+
+        // The live lane furthest behind in the code leads. Usually all of
+        // them are still together where the last leader went.
+        u8 pcl = r.pcl[lead], pch = r.pch[lead];
+        if(!live[lead] || any(live & ((r.pcl != pcl) | (r.pch != pch)))) {
+            pch = smallest(select8(live, r.pch, splat8(0xFF)));
+            pcl = smallest(select8(live & (r.pch == pch), r.pcl, splat8(0xFF)));
+            lead = first(live & (r.pch == pch) & (r.pcl == pcl));
+        }
+
+        const u16 pc = pcl | (pch << 8);
+
+        // Lanes at the same PC join in if their code there is the same
+        const u8 opcode = lanes->mem[pc][lead];
+        const u8 size = lanes_operand_size[lanes_opcodes[opcode].mode];
+
+        mask8_t active = live & (r.pcl == pcl) & (r.pch == pch) & (lanes_row(lanes, pc) == opcode);
+
+        u16 operand = 0;
+        if(size >= 1) {
+            operand = lanes->mem[(u16)(pc + 1)][lead];
+            active &= lanes_row(lanes, pc + 1) == (u8)operand;
+        }
+        if(size == 2) {
+            operand |= lanes->mem[(u16)(pc + 2)][lead] << 8;
+            active &= lanes_row(lanes, pc + 2) == (u8)(operand >> 8);
+        }
+
+        const mask8_t fallback = lanes_exec(lanes, &r, opcode, pc, operand, &active, lead);
+
+        if(any(fallback)) {
+            lanes_set_regs(lanes, &r);
+
+            for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+                if(fallback[lane])
+                    lanes_step_scalar(lanes, lane);
+            }
+
+            lanes_get_regs(lanes, &r);
+        }
+
+        const vec8_t ran = (vec8_t)(active | fallback);
+        clock.used += ran & lanes_opcodes[opcode].cycles;
+        clock.count -= ran;
+
+        ++lanes->steps;
+    }
+
+    lanes_flush(&clock);
+    lanes_set_regs(lanes, &r);
+
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        lanes->total_cycles[lane] += clock.elapsed[lane];
+        lanes->total_instructions[lane] += clock.instructions[lane];
+    }
+}
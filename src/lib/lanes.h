@@ -0,0 +1,98 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// LANES_WIDTH independent 6502s stepped in lockstep. Registers are kept in
+// struct-of-arrays form and memory is interleaved, mem[addr][lane], so one
+// address across all lanes is a single contiguous row. Every step runs the
+// instruction at the lowest PC for all lanes that are there and agree on
+// its bytes, as vector operations over the lanes; the others are masked out
+// and catch up in later steps. Lowest PC first makes lanes that split at a
+// branch meet again where the paths join.
+//
+// Lanes only have RAM: no bus callbacks, maps or interrupts. Cycles are
+// counted like the non-exact engines, without page crossing penalties.
+// Decimal ADC/SBC and the undocumented opcodes other than NOP and KIL are
+// run one lane at a time by a regular cpu_t, with identical results.
+
+#ifndef M6502_LANES_H
+#define M6502_LANES_H
+
+#include "cpu.h"
+
+// Lanes per group: one byte per lane, so one register of the vector unit
+// lanes.c is built for. The code uses GCC vector extensions, which split
+// anything wider than the hardware into single lanes. Only lanes.c gets
+// the AVX2 or AVX-512BW instructions, so the rest of the build runs on any
+// x86-64, but the lanes need a CPU that has them.
+#ifndef LANES_WIDTH
+#if defined(M6502_LANES_AVX512)
+#define LANES_WIDTH 64
+#elif defined(M6502_LANES_AVX2)
+#define LANES_WIDTH 32
+#else
+#define LANES_WIDTH 16
+#endif
+#endif
+
+#define LANES_ALIGN 64
+
+typedef struct lanes {
+    u16 pc[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+    u8 a[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+    u8 x[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+    u8 y[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+    u8 sp[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+    // As cpu_get_status returns it
+    u8 p[LANES_WIDTH] __attribute__((aligned(LANES_ALIGN)));
+
+    u64 total_cycles[LANES_WIDTH];
+    u64 total_instructions[LANES_WIDTH];
+
+    // 64K rows of LANES_WIDTH bytes
+    u8 (*mem)[LANES_WIDTH];
+
+    // Steps run as vectors, and instructions run by the scalar CPU
+    u64 steps;
+    u64 fallbacks;
+
+    // Runs one lane's instruction when it can't be vectorized. Its bus
+    // callbacks read and write the column of lane.
+    cpu_t scalar;
+    u32 lane;
+} lanes_t;
+
+// Allocate the memory, all zero. Returns 0 on failure.
+_Bool lanes_init(lanes_t* lanes);
+void lanes_free(lanes_t* lanes);
+
+// Copy data to addr in every lane
+void lanes_load(lanes_t* lanes, u16 addr, const void* data, u32 size);
+
+static inline u8 lanes_peek(const lanes_t* lanes, u32 lane, u16 addr) {
+    return lanes->mem[addr][lane];
+}
+
+static inline void lanes_poke(lanes_t* lanes, u32 lane, u16 addr, u8 val) {
+    lanes->mem[addr][lane] = val;
+}
+
+// Like cpu_reset for every lane, each from its own reset vector. The
+// reset sequence's cycles are not counted.
+void lanes_reset(lanes_t* lanes);
+
+// Run every lane until it has run at least budget cycles, like
+// cpu_run_cycles does for one CPU
+void lanes_run(lanes_t* lanes, u32 budget);
+
+#endif //M6502_LANES_H
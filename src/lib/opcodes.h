@@ -0,0 +1,280 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Opcode table, expanded with X-macros by cpu.c. Every user defines
+// OPCODE(code, instruction, addressing mode, access, cycles, legal) before
+// including this file, which is why there is no include guard.
+//
+// The access column says what the instruction does with its operand, so
+// the generated handlers only read memory when the instruction needs it.
+// legal is 0 for the undocumented NMOS opcodes.
+
+OPCODE(0x00, brk,     IMPLICIT,         NONE,              7, 1)
+OPCODE(0x01, ora,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0x02, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x03, slo,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x04, nop,     ZERO_PAGE,        READ,              3, 0)
+OPCODE(0x05, ora,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0x06, asl,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0x07, slo,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0x08, php,     IMPLICIT,         NONE,              3, 1)
+OPCODE(0x09, ora,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0x0A, asl_acc, ACCUMULATOR,      NONE,              2, 1)
+OPCODE(0x0B, anc,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x0C, nop,     ABSOLUTE,         READ,              4, 0)
+OPCODE(0x0D, ora,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0x0E, asl,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x0F, slo,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x10, bpl,     RELATIVE,         NONE,              2, 1)
+OPCODE(0x11, ora,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0x12, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x13, slo,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x14, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0x15, ora,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0x16, asl,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x17, slo,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x18, clc,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x19, ora,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0x1A, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x1B, slo,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x1C, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0x1D, ora,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0x1E, asl,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0x1F, slo,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x20, jsr,     ABSOLUTE,         NONE,              6, 1)
+OPCODE(0x21, and,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0x22, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x23, rla,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x24, bit,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0x25, and,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0x26, rol,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0x27, rla,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0x28, plp,     IMPLICIT,         NONE,              4, 1)
+OPCODE(0x29, and,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0x2A, rol_acc, ACCUMULATOR,      NONE,              2, 1)
+OPCODE(0x2B, anc,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x2C, bit,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0x2D, and,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0x2E, rol,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x2F, rla,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x30, bmi,     RELATIVE,         NONE,              2, 1)
+OPCODE(0x31, and,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0x32, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x33, rla,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x34, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0x35, and,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0x36, rol,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x37, rla,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x38, sec,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x39, and,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0x3A, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x3B, rla,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x3C, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0x3D, and,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0x3E, rol,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0x3F, rla,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x40, rti,     IMPLICIT,         NONE,              6, 1)
+OPCODE(0x41, eor,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0x42, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x43, sre,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x44, nop,     ZERO_PAGE,        READ,              3, 0)
+OPCODE(0x45, eor,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0x46, lsr,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0x47, sre,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0x48, pha,     IMPLICIT,         NONE,              3, 1)
+OPCODE(0x49, eor,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0x4A, lsr_acc, ACCUMULATOR,      NONE,              2, 1)
+OPCODE(0x4B, alr,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x4C, jmp,     ABSOLUTE,         NONE,              3, 1)
+OPCODE(0x4D, eor,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0x4E, lsr,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x4F, sre,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x50, bvc,     RELATIVE,         NONE,              2, 1)
+OPCODE(0x51, eor,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0x52, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x53, sre,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x54, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0x55, eor,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0x56, lsr,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x57, sre,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x58, cli,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x59, eor,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0x5A, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x5B, sre,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x5C, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0x5D, eor,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0x5E, lsr,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0x5F, sre,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x60, rts,     IMPLICIT,         NONE,              6, 1)
+OPCODE(0x61, adc,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0x62, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x63, rra,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x64, nop,     ZERO_PAGE,        READ,              3, 0)
+OPCODE(0x65, adc,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0x66, ror,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0x67, rra,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0x68, pla,     IMPLICIT,         NONE,              4, 1)
+OPCODE(0x69, adc,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0x6A, ror_acc, ACCUMULATOR,      NONE,              2, 1)
+OPCODE(0x6B, arr,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x6C, jmp,     INDIRECT,         NONE,              5, 1)
+OPCODE(0x6D, adc,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0x6E, ror,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x6F, rra,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x70, bvs,     RELATIVE,         NONE,              2, 1)
+OPCODE(0x71, adc,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0x72, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x73, rra,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0x74, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0x75, adc,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0x76, ror,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0x77, rra,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0x78, sei,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x79, adc,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0x7A, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x7B, rra,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x7C, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0x7D, adc,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0x7E, ror,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0x7F, rra,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0x80, nop,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x81, sta,     INDEXED_INDIRECT, WRITE,             6, 1)
+OPCODE(0x82, nop,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x83, sax,     INDEXED_INDIRECT, WRITE,             6, 0)
+OPCODE(0x84, sty,     ZERO_PAGE,        WRITE,             3, 1)
+OPCODE(0x85, sta,     ZERO_PAGE,        WRITE,             3, 1)
+OPCODE(0x86, stx,     ZERO_PAGE,        WRITE,             3, 1)
+OPCODE(0x87, sax,     ZERO_PAGE,        WRITE,             3, 0)
+OPCODE(0x88, dey,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x89, nop,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x8A, txa,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x8B, ane,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0x8C, sty,     ABSOLUTE,         WRITE,             4, 1)
+OPCODE(0x8D, sta,     ABSOLUTE,         WRITE,             4, 1)
+OPCODE(0x8E, stx,     ABSOLUTE,         WRITE,             4, 1)
+OPCODE(0x8F, sax,     ABSOLUTE,         WRITE,             4, 0)
+OPCODE(0x90, bcc,     RELATIVE,         NONE,              2, 1)
+OPCODE(0x91, sta,     INDIRECT_INDEXED, WRITE,             6, 1)
+OPCODE(0x92, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0x93, sha,     INDIRECT_INDEXED, WRITE,             6, 0)
+OPCODE(0x94, sty,     ZERO_PAGE_X,      WRITE,             4, 1)
+OPCODE(0x95, sta,     ZERO_PAGE_X,      WRITE,             4, 1)
+OPCODE(0x96, stx,     ZERO_PAGE_Y,      WRITE,             4, 1)
+OPCODE(0x97, sax,     ZERO_PAGE_Y,      WRITE,             4, 0)
+OPCODE(0x98, tya,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x99, sta,     ABSOLUTE_Y,       WRITE,             5, 1)
+OPCODE(0x9A, txs,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0x9B, tas,     ABSOLUTE_Y,       WRITE,             5, 0)
+OPCODE(0x9C, shy,     ABSOLUTE_X,       WRITE,             5, 0)
+OPCODE(0x9D, sta,     ABSOLUTE_X,       WRITE,             5, 1)
+OPCODE(0x9E, shx,     ABSOLUTE_Y,       WRITE,             5, 0)
+OPCODE(0x9F, sha,     ABSOLUTE_Y,       WRITE,             5, 0)
+OPCODE(0xA0, ldy,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xA1, lda,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0xA2, ldx,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xA3, lax,     INDEXED_INDIRECT, READ,              6, 0)
+OPCODE(0xA4, ldy,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xA5, lda,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xA6, ldx,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xA7, lax,     ZERO_PAGE,        READ,              3, 0)
+OPCODE(0xA8, tay,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xA9, lda,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xAA, tax,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xAB, lxa,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0xAC, ldy,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xAD, lda,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xAE, ldx,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xAF, lax,     ABSOLUTE,         READ,              4, 0)
+OPCODE(0xB0, bcs,     RELATIVE,         NONE,              2, 1)
+OPCODE(0xB1, lda,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0xB2, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0xB3, lax,     INDIRECT_INDEXED, READ,              5, 0)
+OPCODE(0xB4, ldy,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0xB5, lda,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0xB6, ldx,     ZERO_PAGE_Y,      READ,              4, 1)
+OPCODE(0xB7, lax,     ZERO_PAGE_Y,      READ,              4, 0)
+OPCODE(0xB8, clv,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xB9, lda,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0xBA, tsx,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xBB, las,     ABSOLUTE_Y,       READ,              4, 0)
+OPCODE(0xBC, ldy,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0xBD, lda,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0xBE, ldx,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0xBF, lax,     ABSOLUTE_Y,       READ,              4, 0)
+OPCODE(0xC0, cpy,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xC1, cmp,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0xC2, nop,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0xC3, dcp,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0xC4, cpy,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xC5, cmp,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xC6, dec,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0xC7, dcp,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0xC8, iny,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xC9, cmp,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xCA, dex,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xCB, sbx,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0xCC, cpy,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xCD, cmp,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xCE, dec,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0xCF, dcp,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0xD0, bne,     RELATIVE,         NONE,              2, 1)
+OPCODE(0xD1, cmp,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0xD2, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0xD3, dcp,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0xD4, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0xD5, cmp,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0xD6, dec,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0xD7, dcp,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0xD8, cld,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xD9, cmp,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0xDA, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0xDB, dcp,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0xDC, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0xDD, cmp,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0xDE, dec,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0xDF, dcp,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0xE0, cpx,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xE1, sbc,     INDEXED_INDIRECT, READ,              6, 1)
+OPCODE(0xE2, nop,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0xE3, isc,     INDEXED_INDIRECT, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0xE4, cpx,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xE5, sbc,     ZERO_PAGE,        READ,              3, 1)
+OPCODE(0xE6, inc,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 1)
+OPCODE(0xE7, isc,     ZERO_PAGE,        READ_MODIFY_WRITE, 5, 0)
+OPCODE(0xE8, inx,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xE9, sbc,     IMMEDIATE,        READ,              2, 1)
+OPCODE(0xEA, nop,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xEB, sbc,     IMMEDIATE,        READ,              2, 0)
+OPCODE(0xEC, cpx,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xED, sbc,     ABSOLUTE,         READ,              4, 1)
+OPCODE(0xEE, inc,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 1)
+OPCODE(0xEF, isc,     ABSOLUTE,         READ_MODIFY_WRITE, 6, 0)
+OPCODE(0xF0, beq,     RELATIVE,         NONE,              2, 1)
+OPCODE(0xF1, sbc,     INDIRECT_INDEXED, READ,              5, 1)
+OPCODE(0xF2, kil,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0xF3, isc,     INDIRECT_INDEXED, READ_MODIFY_WRITE, 8, 0)
+OPCODE(0xF4, nop,     ZERO_PAGE_X,      READ,              4, 0)
+OPCODE(0xF5, sbc,     ZERO_PAGE_X,      READ,              4, 1)
+OPCODE(0xF6, inc,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 1)
+OPCODE(0xF7, isc,     ZERO_PAGE_X,      READ_MODIFY_WRITE, 6, 0)
+OPCODE(0xF8, sed,     IMPLICIT,         NONE,              2, 1)
+OPCODE(0xF9, sbc,     ABSOLUTE_Y,       READ,              4, 1)
+OPCODE(0xFA, nop,     IMPLICIT,         NONE,              2, 0)
+OPCODE(0xFB, isc,     ABSOLUTE_Y,       READ_MODIFY_WRITE, 7, 0)
+OPCODE(0xFC, nop,     ABSOLUTE_X,       READ,              4, 0)
+OPCODE(0xFD, sbc,     ABSOLUTE_X,       READ,              4, 1)
+OPCODE(0xFE, inc,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 1)
+OPCODE(0xFF, isc,     ABSOLUTE_X,       READ_MODIFY_WRITE, 7, 0)
+
+#undef OPCODE
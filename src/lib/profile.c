@@ -0,0 +1,225 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "profile.h"
+
+#ifdef M6502_PROFILE
+
+#include <string.h>
+
+#include "../../deps/cjson/cJSON.h"
+
+// =================================================================================
+// SUMMARY
+// =================================================================================
+
+typedef struct profile_totals {
+    u64 exec, cycles, reads, writes;
+} profile_totals_t;
+
+// An address and its count in whichever array is being ranked
+typedef struct profile_entry {
+    u32 count;
+    u16 addr;
+} profile_entry_t;
+
+// Hottest first, ties in address order
+static int profile_compare(const void* a, const void* b) {
+    const profile_entry_t* x = a;
+    const profile_entry_t* y = b;
+
+    if(x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+// Copy the nonzero counters into entries, sorted, and return how many
+static u32 profile_rank(const u32* counts, profile_entry_t* entries) {
+    u32 n = 0;
+
+    for(u32 i = 0; i < 0x10000; ++i) {
+        if(counts[i] != 0)
+            entries[n++] = (profile_entry_t){.count = counts[i], .addr = i};
+    }
+
+    qsort(entries, n, sizeof(profile_entry_t), profile_compare);
+
+    return n;
+}
+
+// Sums over [start, start + size)
+static profile_totals_t profile_sum(const cpu_t* cpu, u32 start, u32 size) {
+    profile_totals_t totals = {0};
+
+    for(u32 i = start; i < start + size; ++i) {
+        totals.exec += cpu->profile.exec[i];
+        totals.cycles += cpu->profile.cycles[i];
+        totals.reads += cpu->profile.reads[i];
+        totals.writes += cpu->profile.writes[i];
+    }
+
+    return totals;
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+void cpu_profile_clear(cpu_t* cpu) {
+    memset(&cpu->profile, 0, sizeof(cpu_profile_t));
+}
+
+_Bool cpu_profile_save(const cpu_t* cpu, const char* path) {
+    const size_t size = 0x10000 * 4;
+    u8* buf = malloc(size);
+    if(!buf)
+        return 0;
+
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        free(buf);
+        return 0;
+    }
+
+    const u32* arrays[] = {cpu->profile.exec, cpu->profile.cycles, cpu->profile.reads, cpu->profile.writes};
+
+    _Bool ok = fwrite(PROFILE_MAGIC, 1, 8, file) == 8;
+
+    for(u32 i = 0; ok && i < 4; ++i) {
+        for(u32 addr = 0; addr < 0x10000; ++addr) {
+            const u32 count = arrays[i][addr];
+
+            buf[addr * 4 + 0] = count;
+            buf[addr * 4 + 1] = count >> 8;
+            buf[addr * 4 + 2] = count >> 16;
+            buf[addr * 4 + 3] = count >> 24;
+        }
+
+        ok = fwrite(buf, 1, size, file) == size;
+    }
+
+    free(buf);
+
+    return fclose(file) == 0 && ok;
+}
+
+static void profile_add_ranking(cJSON* root, const char* name, const u32* counts, u32 top, profile_entry_t* entries) {
+    cJSON* array = cJSON_AddArrayToObject(root, name);
+    if(!array)
+        return;
+
+    const u32 len = profile_rank(counts, entries);
+    char hex[8];
+
+    for(u32 i = 0; i < len && i < top; ++i) {
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddItemToArray(array, entry);
+
+        snprintf(hex, sizeof(hex), "0x%04X", entries[i].addr);
+        cJSON_AddStringToObject(entry, "addr", hex);
+        cJSON_AddNumberToObject(entry, "count", entries[i].count);
+    }
+}
+
+char* cpu_profile_to_json(const cpu_t* cpu, u32 top) {
+    profile_entry_t* entries = malloc(0x10000 * sizeof(profile_entry_t));
+    cJSON* root = cJSON_CreateObject();
+
+    if(!entries || !root) {
+        free(entries);
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    const profile_totals_t totals = profile_sum(cpu, 0, 0x10000);
+    char hex[8];
+
+    cJSON_AddNumberToObject(root, "instructions", (double)totals.exec);
+    cJSON_AddNumberToObject(root, "cycles", (double)totals.cycles);
+    cJSON_AddNumberToObject(root, "reads", (double)totals.reads);
+    cJSON_AddNumberToObject(root, "writes", (double)totals.writes);
+
+    // Code is ranked by the time spent in it, with its executions alongside
+    cJSON* code = cJSON_AddArrayToObject(root, "hot_code");
+    const u32 len = profile_rank(cpu->profile.cycles, entries);
+    for(u32 i = 0; code && i < len && i < top; ++i) {
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddItemToArray(code, entry);
+
+        snprintf(hex, sizeof(hex), "0x%04X", entries[i].addr);
+        cJSON_AddStringToObject(entry, "pc", hex);
+        cJSON_AddNumberToObject(entry, "exec", cpu->profile.exec[entries[i].addr]);
+        cJSON_AddNumberToObject(entry, "cycles", entries[i].count);
+    }
+
+    profile_add_ranking(root, "hot_reads", cpu->profile.reads, top, entries);
+    profile_add_ranking(root, "hot_writes", cpu->profile.writes, top, entries);
+
+    cJSON* pages = cJSON_AddArrayToObject(root, "pages");
+    for(u32 page = 0; pages && page < CPU_NUM_PAGES; ++page) {
+        const profile_totals_t sums = profile_sum(cpu, page * CPU_PAGE_SIZE, CPU_PAGE_SIZE);
+        if(!sums.exec && !sums.reads && !sums.writes)
+            continue;
+
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddItemToArray(pages, entry);
+
+        snprintf(hex, sizeof(hex), "0x%02X", page);
+        cJSON_AddStringToObject(entry, "page", hex);
+        cJSON_AddNumberToObject(entry, "exec", (double)sums.exec);
+        cJSON_AddNumberToObject(entry, "cycles", (double)sums.cycles);
+        cJSON_AddNumberToObject(entry, "reads", (double)sums.reads);
+        cJSON_AddNumberToObject(entry, "writes", (double)sums.writes);
+    }
+
+    char* json = cJSON_Print(root);
+    cJSON_Delete(root);
+    free(entries);
+
+    return json;
+}
+
+void cpu_profile_report(const cpu_t* cpu, FILE* file, u32 top) {
+    profile_entry_t* entries = malloc(0x10000 * sizeof(profile_entry_t));
+    if(!entries)
+        return;
+
+    const profile_totals_t totals = profile_sum(cpu, 0, 0x10000);
+    const double percent = totals.cycles ? 100.0 / totals.cycles : 0.0;
+
+    fprintf(file, "%llu instructions, %llu cycles, %llu reads, %llu writes\n", (unsigned long long)totals.exec,
+        (unsigned long long)totals.cycles, (unsigned long long)totals.reads, (unsigned long long)totals.writes);
+
+    u32 len = profile_rank(cpu->profile.cycles, entries);
+    fprintf(file, "\nhottest code:\n");
+    for(u32 i = 0; i < len && i < top; ++i) {
+        fprintf(file, "  %04X %14u exec %14u cycles %6.2f%%\n", entries[i].addr, cpu->profile.exec[entries[i].addr],
+            entries[i].count, entries[i].count * percent);
+    }
+
+    len = profile_rank(cpu->profile.reads, entries);
+    fprintf(file, "\nmost read:\n");
+    for(u32 i = 0; i < len && i < top; ++i)
+        fprintf(file, "  %04X %14u\n", entries[i].addr, entries[i].count);
+
+    len = profile_rank(cpu->profile.writes, entries);
+    fprintf(file, "\nmost written:\n");
+    for(u32 i = 0; i < len && i < top; ++i)
+        fprintf(file, "  %04X %14u\n", entries[i].addr, entries[i].count);
+
+    free(entries);
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Exports for the heat maps M6502_PROFILE builds keep in cpu_t::profile:
+// executions and cycles per PC, and data reads and writes per address.
+// Spin loops and native code would hide work from the counters, so these
+// builds leave out M6502_IDLE_SKIP and run M6502_JIT as the block cache.
+
+#ifndef M6502_PROFILE_H
+#define M6502_PROFILE_H
+
+#include <stdio.h>
+
+#include "cpu.h"
+
+#ifdef M6502_PROFILE
+
+// Size of a file written by cpu_profile_save: an 8-byte magic followed by
+// the exec, cycles, reads and writes arrays as little-endian u32s
+#define PROFILE_MAGIC "M6502PRF"
+#define PROFILE_FILE_SIZE (8 + 4 * 0x10000 * 4)
+
+void cpu_profile_clear(cpu_t* cpu);
+
+// Returns 0 if the file could not be written
+_Bool cpu_profile_save(const cpu_t* cpu, const char* path);
+
+// Totals, the top hottest PCs by cycles, the top most read and written
+// addresses and per-page sums, as a JSON object. NULL if out of memory,
+// otherwise free the string with free().
+char* cpu_profile_to_json(const cpu_t* cpu, u32 top);
+
+// The same summary as a table
+void cpu_profile_report(const cpu_t* cpu, FILE* file, u32 top);
+
+#endif
+
+#endif //M6502_PROFILE_H
@@ -0,0 +1,171 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scheduler.h"
+
+#include <string.h>
+
+// =================================================================================
+// HEAP
+// =================================================================================
+
+static inline _Bool sched_before(const sched_event_t* a, const sched_event_t* b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && a->id < b->id);
+}
+
+static void sched_sift_up(sched_t* sched, u32 i) {
+    const sched_event_t event = sched->events[i];
+
+    while(i > 0) {
+        const u32 parent = (i - 1) / 2;
+
+        if(!sched_before(&event, &sched->events[parent]))
+            break;
+
+        sched->events[i] = sched->events[parent];
+        i = parent;
+    }
+
+    sched->events[i] = event;
+}
+
+static void sched_sift_down(sched_t* sched, u32 i) {
+    const sched_event_t event = sched->events[i];
+
+    for(;;) {
+        u32 child = 2 * i + 1;
+        if(child >= sched->len)
+            break;
+
+        if(child + 1 < sched->len && sched_before(&sched->events[child + 1], &sched->events[child]))
+            ++child;
+
+        if(!sched_before(&sched->events[child], &event))
+            break;
+
+        sched->events[i] = sched->events[child];
+        i = child;
+    }
+
+    sched->events[i] = event;
+}
+
+// Take out the event at i and restore the heap around the one moved there
+static void sched_remove(sched_t* sched, u32 i) {
+    if(--sched->len == i)
+        return;
+
+    sched->events[i] = sched->events[sched->len];
+
+    if(i > 0 && sched_before(&sched->events[i], &sched->events[(i - 1) / 2]))
+        sched_sift_up(sched, i);
+    else
+        sched_sift_down(sched, i);
+}
+
+// Fire everything due by now, earliest first. The event is off the heap
+// before its callback runs, so the callback can add it again.
+static void sched_fire(sched_t* sched) {
+    while(sched->len != 0 && sched->events[0].deadline <= sched->now) {
+        const sched_event_t event = sched->events[0];
+
+        sched_remove(sched, 0);
+
+        event.callback(sched, event.ctx, event.deadline);
+    }
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+void sched_init(sched_t* sched, cpu_t* cpu) {
+    memset(sched, 0, sizeof(sched_t));
+
+    sched->cpu = cpu;
+    sched->next_id = 1;
+}
+
+u64 sched_add(sched_t* sched, u64 cycle, sched_callback_t callback, void* ctx) {
+    if(sched->len == SCHED_MAX_EVENTS)
+        return 0;
+
+    const u64 id = sched->next_id++;
+
+    sched->events[sched->len] = (sched_event_t){.deadline = cycle, .id = id, .callback = callback, .ctx = ctx};
+    sched_sift_up(sched, sched->len++);
+
+    return id;
+}
+
+_Bool sched_cancel(sched_t* sched, u64 id) {
+    for(u32 i = 0; i < sched->len; ++i) {
+        if(sched->events[i].id == id) {
+            sched_remove(sched, i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+u64 sched_next(const sched_t* sched) {
+    return sched->len != 0 ? sched->events[0].deadline : UINT64_MAX;
+}
+
+u64 sched_run_until(sched_t* sched, u64 cycle) {
+    for(;;) {
+        sched_fire(sched);
+
+        if(sched->now >= cycle)
+            break;
+
+        // Nothing can happen before the next deadline, so the CPU gets the
+        // whole stretch in one call
+        u64 budget = cycle - sched->now;
+        if(sched->len != 0 && sched->events[0].deadline - sched->now < budget)
+            budget = sched->events[0].deadline - sched->now;
+        if(budget > UINT32_MAX)
+            budget = UINT32_MAX;
+
+        sched->now += cpu_run_cycles(sched->cpu, (u32)budget);
+
+#ifdef M6502_DEBUG
+        // Back to the host at a breakpoint, before firing anything that
+        // could move the CPU away from it
+        if(sched->cpu->debug.stopped)
+            break;
+#endif
+    }
+
+    return sched->now;
+}
+
+void sched_advance(sched_t* sched, u64 cycles) {
+    sched->now += cycles;
+
+    sched_fire(sched);
+}
+
+// floor(ratio * ticks / 2^32) from 32-bit halves, so no 128-bit type is
+// needed. Only the low half of the low product gets rounded away.
+u64 sched_to_master(sched_ratio_t ratio, u64 ticks) {
+    const u64 ratio_hi = ratio >> 32, ratio_lo = ratio & 0xFFFFFFFF;
+    const u64 ticks_hi = ticks >> 32, ticks_lo = ticks & 0xFFFFFFFF;
+
+    return ((ratio_hi * ticks_hi) << 32)
+        + ratio_hi * ticks_lo
+        + ratio_lo * ticks_hi
+        + ((ratio_lo * ticks_lo) >> 32);
+}
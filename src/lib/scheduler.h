@@ -0,0 +1,86 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Cycle-timestamped events for IRQ, NMI and device callbacks. The CPU runs
+// in uninterrupted batches up to the next deadline, so hosts never have to
+// poll between cpu_clock calls.
+
+#ifndef M6502_SCHEDULER_H
+#define M6502_SCHEDULER_H
+
+#include "cpu.h"
+
+#define SCHED_MAX_EVENTS 64
+
+// Master cycles per tick of another clock domain, in 32.32 fixed point.
+// E.g. SCHED_RATIO(1789773, 5369318) for the NES PPU against its CPU.
+typedef u64 sched_ratio_t;
+
+#define SCHED_RATIO(master_hz, domain_hz) ((sched_ratio_t)((((u64)(master_hz)) << 32) / (domain_hz)))
+
+struct sched;
+
+// deadline is the cycle the event was scheduled for, sched->now the one it
+// actually fires on. They differ by less than an instruction.
+typedef void (*sched_callback_t)(struct sched* sched, void* ctx, u64 deadline);
+
+typedef struct sched_event {
+    u64 deadline;
+    // Also the handle returned by sched_add. Breaks ties between equal
+    // deadlines, so events fire in the order they were added.
+    u64 id;
+    sched_callback_t callback;
+    void* ctx;
+} sched_event_t;
+
+typedef struct sched {
+    cpu_t* cpu;
+
+    // Master cycle counter: every cycle the CPU ran through the scheduler
+    u64 now;
+
+    // Binary min-heap on (deadline, id)
+    sched_event_t events[SCHED_MAX_EVENTS];
+    u32 len;
+    u64 next_id;
+} sched_t;
+
+void sched_init(sched_t* sched, cpu_t* cpu);
+
+// Call callback once the master counter reaches cycle, which may already
+// be in the past. Returns a handle for sched_cancel, or 0 if the queue is
+// full. Callbacks may add and cancel events themselves.
+u64 sched_add(sched_t* sched, u64 cycle, sched_callback_t callback, void* ctx);
+
+// Returns 0 if the event already fired or was cancelled
+_Bool sched_cancel(sched_t* sched, u64 id);
+
+// Deadline of the earliest pending event, or UINT64_MAX if there is none
+u64 sched_next(const sched_t* sched);
+
+// Run the CPU until the master counter reaches cycle, in batches that stop
+// at each deadline on the way. Like cpu_run_cycles it can overshoot by up
+// to one instruction. With M6502_DEBUG it returns early when a breakpoint
+// stops the CPU, and events due by then fire on the next call. Returns the
+// new master counter.
+u64 sched_run_until(sched_t* sched, u64 cycle);
+
+// Account for cycles run outside the scheduler, e.g. with cpu_clock or
+// cpu_run_instructions, and fire whatever became due
+void sched_advance(sched_t* sched, u64 cycles);
+
+// The master cycle that tick `ticks` of a clock domain falls on
+u64 sched_to_master(sched_ratio_t ratio, u64 ticks);
+
+#endif //M6502_SCHEDULER_H
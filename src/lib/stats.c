@@ -0,0 +1,211 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stats.h"
+
+#ifdef M6502_OPCODE_STATS
+
+#include <string.h>
+
+#include "../../deps/cjson/cJSON.h"
+
+// =================================================================================
+// OPCODES
+// =================================================================================
+
+typedef enum stats_mode {
+    STATS_IMPLICIT,
+    STATS_ACCUMULATOR,
+    STATS_IMMEDIATE,
+    STATS_ZERO_PAGE,
+    STATS_ZERO_PAGE_X,
+    STATS_ZERO_PAGE_Y,
+    STATS_RELATIVE,
+    STATS_ABSOLUTE,
+    STATS_ABSOLUTE_X,
+    STATS_ABSOLUTE_Y,
+    STATS_INDIRECT,
+    STATS_INDEXED_INDIRECT,
+    STATS_INDIRECT_INDEXED,
+    NUM_STATS_MODES,
+} stats_mode_t;
+
+static const char* const mode_names[NUM_STATS_MODES] = {
+    "IMPLICIT", "ACCUMULATOR", "IMMEDIATE", "ZERO_PAGE", "ZERO_PAGE_X", "ZERO_PAGE_Y", "RELATIVE",
+    "ABSOLUTE", "ABSOLUTE_X", "ABSOLUTE_Y", "INDIRECT", "INDEXED_INDIRECT", "INDIRECT_INDEXED",
+};
+
+typedef struct stats_opcode {
+    const char* name;
+    u8 mode;
+} stats_opcode_t;
+
+#define OPCODE(code, instr, mode, access, cycles, legal) [code] = {#instr, STATS_##mode},
+static const stats_opcode_t stats_opcodes[256] = {
+#include "opcodes.h"
+};
+
+// =================================================================================
+// RANKING
+// =================================================================================
+
+// A counter by its index: an opcode, a mode, or previous << 8 | next
+typedef struct stats_entry {
+    u64 count;
+    u32 index;
+} stats_entry_t;
+
+// Most executed first, ties in index order
+static int stats_compare(const void* a, const void* b) {
+    const stats_entry_t* x = a;
+    const stats_entry_t* y = b;
+
+    if(x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Copy the nonzero counters into entries, sorted, and return how many
+static u32 stats_rank(const u64* counts, u32 len, stats_entry_t* entries) {
+    u32 n = 0;
+
+    for(u32 i = 0; i < len; ++i) {
+        if(counts[i] != 0)
+            entries[n++] = (stats_entry_t){.count = counts[i], .index = i};
+    }
+
+    qsort(entries, n, sizeof(stats_entry_t), stats_compare);
+
+    return n;
+}
+
+static u64 stats_total(const cpu_t* cpu) {
+    u64 total = 0;
+
+    for(u32 i = 0; i < 256; ++i)
+        total += cpu->stats.opcodes[i];
+
+    return total;
+}
+
+static void stats_modes(const cpu_t* cpu, u64 modes[NUM_STATS_MODES]) {
+    memset(modes, 0, NUM_STATS_MODES * sizeof(u64));
+
+    for(u32 i = 0; i < 256; ++i)
+        modes[stats_opcodes[i].mode] += cpu->stats.opcodes[i];
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+void cpu_stats_clear(cpu_t* cpu) {
+    memset(&cpu->stats, 0, sizeof(cpu_stats_t));
+}
+
+// cJSON numbers are doubles, so counts above 2^53 lose their low bits
+char* cpu_stats_to_json(const cpu_t* cpu) {
+    cJSON* root = cJSON_CreateObject();
+    if(!root)
+        return NULL;
+
+    char hex[8];
+
+    cJSON_AddNumberToObject(root, "instructions", (double)stats_total(cpu));
+
+    cJSON* opcodes = cJSON_AddArrayToObject(root, "opcodes");
+    for(u32 i = 0; opcodes && i < 256; ++i) {
+        if(cpu->stats.opcodes[i] == 0)
+            continue;
+
+        cJSON* opcode = cJSON_CreateObject();
+        cJSON_AddItemToArray(opcodes, opcode);
+
+        snprintf(hex, sizeof(hex), "0x%02X", i);
+        cJSON_AddStringToObject(opcode, "opcode", hex);
+        cJSON_AddStringToObject(opcode, "instr", stats_opcodes[i].name);
+        cJSON_AddStringToObject(opcode, "mode", mode_names[stats_opcodes[i].mode]);
+        cJSON_AddNumberToObject(opcode, "count", (double)cpu->stats.opcodes[i]);
+    }
+
+    u64 modes[NUM_STATS_MODES];
+    stats_modes(cpu, modes);
+
+    cJSON* mode_counts = cJSON_AddObjectToObject(root, "modes");
+    for(u32 i = 0; mode_counts && i < NUM_STATS_MODES; ++i)
+        cJSON_AddNumberToObject(mode_counts, mode_names[i], (double)modes[i]);
+
+    cJSON* pairs = cJSON_AddArrayToObject(root, "pairs");
+    for(u32 i = 0; pairs && i < 256 * 256; ++i) {
+        const u64 count = cpu->stats.pairs[i >> 8][i & 0xFF];
+        if(count == 0)
+            continue;
+
+        cJSON* pair = cJSON_CreateObject();
+        cJSON_AddItemToArray(pairs, pair);
+
+        snprintf(hex, sizeof(hex), "0x%02X", i >> 8);
+        cJSON_AddStringToObject(pair, "first", hex);
+        snprintf(hex, sizeof(hex), "0x%02X", i & 0xFF);
+        cJSON_AddStringToObject(pair, "second", hex);
+        cJSON_AddNumberToObject(pair, "count", (double)count);
+    }
+
+    char* json = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    return json;
+}
+
+void cpu_stats_report(const cpu_t* cpu, FILE* file, u32 top) {
+    stats_entry_t* entries = malloc(256 * 256 * sizeof(stats_entry_t));
+    if(!entries)
+        return;
+
+    const u64 total = stats_total(cpu);
+    const double percent = total ? 100.0 / total : 0.0;
+
+    fprintf(file, "%llu instructions\n", (unsigned long long)total);
+
+    u32 len = stats_rank(cpu->stats.opcodes, 256, entries);
+    fprintf(file, "\ntop opcodes:\n");
+    for(u32 i = 0; i < len && i < top; ++i) {
+        const stats_opcode_t* opcode = &stats_opcodes[entries[i].index];
+
+        fprintf(file, "  %02X %-8s %-16s %14llu %6.2f%%\n", entries[i].index, opcode->name, mode_names[opcode->mode],
+            (unsigned long long)entries[i].count, entries[i].count * percent);
+    }
+
+    u64 modes[NUM_STATS_MODES];
+    stats_modes(cpu, modes);
+
+    len = stats_rank(modes, NUM_STATS_MODES, entries);
+    fprintf(file, "\ntop addressing modes:\n");
+    for(u32 i = 0; i < len && i < top; ++i)
+        fprintf(file, "  %-28s %14llu %6.2f%%\n", mode_names[entries[i].index], (unsigned long long)entries[i].count, entries[i].count * percent);
+
+    len = stats_rank(&cpu->stats.pairs[0][0], 256 * 256, entries);
+    fprintf(file, "\ntop pairs:\n");
+    for(u32 i = 0; i < len && i < top; ++i) {
+        const u8 first = entries[i].index >> 8, second = entries[i].index & 0xFF;
+
+        fprintf(file, "  %02X %02X %-8s %-13s %14llu %6.2f%%\n", first, second, stats_opcodes[first].name, stats_opcodes[second].name,
+            (unsigned long long)entries[i].count, entries[i].count * percent);
+    }
+
+    free(entries);
+}
+
+#endif
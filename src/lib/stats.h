@@ -0,0 +1,41 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Reports on the counters M6502_OPCODE_STATS builds keep in cpu_t::stats:
+// executions per opcode, per addressing mode and per pair of consecutive
+// opcodes. Counting happens at dispatch, so these builds run M6502_JIT as
+// the plain block cache. Without the option nothing is counted and cpu_t
+// has no stats.
+
+#ifndef M6502_STATS_H
+#define M6502_STATS_H
+
+#include <stdio.h>
+
+#include "cpu.h"
+
+#ifdef M6502_OPCODE_STATS
+
+void cpu_stats_clear(cpu_t* cpu);
+
+// Everything counted so far as a JSON object, or NULL if out of memory.
+// Only opcodes and pairs that ran are listed. Free the string with free().
+char* cpu_stats_to_json(const cpu_t* cpu);
+
+// The top most executed opcodes, addressing modes and pairs as a table
+void cpu_stats_report(const cpu_t* cpu, FILE* file, u32 top);
+
+#endif
+
+#endif //M6502_STATS_H
@@ -0,0 +1,127 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "trace.h"
+
+#ifdef M6502_TRACE
+
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+// How long the writer sleeps when the ring is empty
+#define TRACE_IDLE_NS 200000
+
+// =================================================================================
+// WRITER
+// =================================================================================
+
+// Write out records [tail, head), split in two where the ring wraps
+static void trace_drain(trace_t* trace, u32 tail, u32 head) {
+    const u32 start = tail & trace->mask;
+    const u32 len = head - tail;
+    const u32 first = len < trace->mask + 1 - start ? len : trace->mask + 1 - start;
+
+    if(fwrite(&trace->records[start], sizeof(trace_record_t), first, trace->file) != first)
+        trace->failed = 1;
+
+    if(first < len && fwrite(&trace->records[0], sizeof(trace_record_t), len - first, trace->file) != len - first)
+        trace->failed = 1;
+}
+
+static void* trace_writer(void* ctx) {
+    trace_t* trace = ctx;
+    const struct timespec idle = {0, TRACE_IDLE_NS};
+
+    u32 tail = trace->tail;
+
+    for(;;) {
+        // Read stop before head, so a stop seen here means head is final
+        const u1 stop = __atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE);
+        const u32 head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+
+        if(head == tail) {
+            if(stop)
+                break;
+
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        trace_drain(trace, tail, head);
+
+        // The slots can be reused once they are on their way to the file
+        tail = head;
+        __atomic_store_n(&trace->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+trace_t* trace_open(const char* path, u32 capacity, _Bool bus) {
+    u32 size = 1;
+    while(size < capacity && size < 0x80000000)
+        size <<= 1;
+
+    trace_t* trace = calloc(1, sizeof(trace_t));
+    if(!trace)
+        return NULL;
+
+    trace->records = malloc(size * sizeof(trace_record_t));
+    trace->file = fopen(path, "wb");
+    trace->mask = size - 1;
+    trace->bus = bus;
+
+    const u32 header[2] = {TRACE_VERSION, sizeof(trace_record_t)};
+
+    if(!trace->records || !trace->file
+        || fwrite(TRACE_MAGIC, 1, 8, trace->file) != 8
+        || fwrite(header, sizeof(u32), 2, trace->file) != 2
+        || pthread_create(&trace->thread, NULL, trace_writer, trace) != 0) {
+        if(trace->file)
+            fclose(trace->file);
+        free(trace->records);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+void trace_wait(trace_t* trace) {
+    do {
+        sched_yield();
+        trace->tail_cache = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+    } while(trace->head - trace->tail_cache > trace->mask);
+}
+
+_Bool trace_close(trace_t* trace) {
+    __atomic_store_n(&trace->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(trace->thread, NULL);
+
+    const _Bool ok = fclose(trace->file) == 0 && !trace->failed;
+
+    free(trace->records);
+    free(trace);
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,120 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Binary execution traces. With M6502_TRACE the CPU pushes one fixed-size
+// record per instruction, and optionally per data access, into a lock-free
+// single-producer/single-consumer ring. A writer thread drains the ring to
+// a file, so the CPU never waits on I/O unless the ring fills up. The
+// 6502_trace2text tool turns the file into nestest-style text. As with
+// M6502_PROFILE, spin loops and blocks run as they really do: these builds
+// leave out M6502_IDLE_SKIP and run M6502_JIT as the block cache.
+
+#ifndef M6502_TRACE_H
+#define M6502_TRACE_H
+
+#include "cpu.h"
+
+// =================================================================================
+// FILE FORMAT
+// =================================================================================
+
+// A trace file is TRACE_MAGIC, then TRACE_VERSION and the record size as
+// u32s, then records back to back, all in host byte order
+#define TRACE_MAGIC "M6502TRC"
+#define TRACE_VERSION 1
+
+typedef enum trace_kind {
+    // An instruction about to run: pc, its bytes and the registers before it
+    TRACE_INSTR,
+    // A data access by the instruction before it: addr and value
+    TRACE_READ,
+    TRACE_WRITE,
+    // An interrupt about to be taken, with the registers at that point
+    TRACE_IRQ,
+    TRACE_NMI,
+} trace_kind_t;
+
+typedef struct trace_record {
+    // cpu_get_cycles at the start of the instruction. Accesses carry the
+    // stamp of the instruction that made them.
+    u64 cycle;
+    // The PC, or the address of an access
+    u16 addr;
+    u8 kind;
+    // The opcode and the two bytes after it, read from mapped memory only
+    // and zero elsewhere. For an access, data[0] is the value.
+    u8 data[3];
+    u8 a, x, y, sp, p;
+} trace_record_t;
+
+// =================================================================================
+// RING
+// =================================================================================
+
+#ifdef M6502_TRACE
+
+#include <pthread.h>
+#include <stdio.h>
+
+typedef struct trace {
+    trace_record_t* records;
+    u32 mask;
+
+    // Whether the CPU also records its data accesses
+    u1 bus;
+
+    // Written by the CPU only. tail_cache is the last tail it saw, so it
+    // only has to look at the writer's index when the ring seems full.
+    u32 head;
+    u32 tail_cache;
+
+    // Written by the writer thread only, kept off the CPU's cache line
+    u32 tail __attribute__((aligned(64)));
+    u1 failed;
+
+    u1 stop;
+    FILE* file;
+    pthread_t thread;
+} trace_t;
+
+// Create path and start the writer thread. capacity is in records and gets
+// rounded up to a power of two. Returns NULL if the file or thread can't
+// be created. Attach the trace with cpu_t::trace.
+trace_t* trace_open(const char* path, u32 capacity, _Bool bus);
+
+// Detach the trace from the CPU first. Writes out everything still in the
+// ring, then stops the thread and frees the trace. Returns 0 if any write
+// failed.
+_Bool trace_close(trace_t* trace);
+
+// Block until the writer has made room, used by trace_push
+void trace_wait(trace_t* trace);
+
+static inline void trace_push(trace_t* trace, const trace_record_t* record) {
+    if(trace->head - trace->tail_cache > trace->mask) {
+        trace->tail_cache = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+
+        if(trace->head - trace->tail_cache > trace->mask)
+            trace_wait(trace);
+    }
+
+    trace->records[trace->head & trace->mask] = *record;
+
+    // Publish the record only once it is complete
+    __atomic_store_n(&trace->head, trace->head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+#endif //M6502_TRACE_H
@@ -0,0 +1,1030 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emulator.h"
+#include "fork_server.h"
+#include "pool.h"
+#include "replay.h"
+#include "rewind.h"
+#include "../lib/lanes.h"
+#include "../lib/profile.h"
+#include "../lib/stats.h"
+
+#define PROGRAM_START 0x0400
+
+#define NUM_INSTRUCTIONS 100000000
+
+// Random images the JIT is checked against the interpreter with, the
+// batches each runs in and the bytes of code in each image's main loop
+#define JIT_CHECK_IMAGES 100
+#define JIT_CHECK_BATCHES 200
+#define JIT_CHECK_BODY 80
+
+// Where the check images keep their interrupt handler and their data
+#define JIT_CHECK_HANDLER 0x0600
+#define JIT_CHECK_DATA 0x0200
+
+// Round trips for the snapshot timing, and instructions run between the
+// two snapshots it switches between
+#define NUM_SNAPSHOTS 100000
+#define SNAPSHOT_DISTANCE 1000
+
+// Rewind history of ten seconds at one entry per NTSC NES frame
+#define REWIND_FRAMES 600
+#define REWIND_FRAME_CYCLES 29780
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_ARENA_SIZE (4 << 20)
+
+// Sessions per worker thread in the pool run, the cycles each gets per
+// turn, and how long the pool runs
+#define POOL_SESSIONS_PER_WORKER 64
+#define POOL_QUANTUM 10000
+#define POOL_SECONDS 2
+
+// Workers, sessions and operations in the pool stress run, with a short
+// quantum so that the workers keep coming back to the sessions the host is
+// working on
+#define POOL_STRESS_WORKERS 4
+#define POOL_STRESS_SESSIONS 64
+#define POOL_STRESS_OPS 2000
+#define POOL_STRESS_QUANTUM 500
+
+// Cycles each lane runs in the lanes comparison, in slices of LANES_SLICE
+#define LANES_CYCLES 2000000
+#define LANES_SLICE 10000
+
+// Round trips to the fork server, the cycles each job runs and the
+// children it keeps forked
+#define FORK_JOBS 1000
+#define FORK_JOB_CYCLES 1000
+#define FORK_CHILDREN 4
+
+// Cycles the device workload runs for with and without recording, the
+// page its registers are on and the cycles between its timer interrupts
+#define REPLAY_CYCLES 20000000
+#define REPLAY_DEVICE_PAGE 0x40
+#define REPLAY_IRQ_PERIOD 1000
+
+// Rows per table in the M6502_OPCODE_STATS report
+#define STATS_TOP 8
+
+// Rows per table in the M6502_PROFILE report
+#define PROFILE_TOP 8
+
+typedef struct workload {
+    const char* name;
+    const u8* program;
+    size_t size;
+} workload_t;
+
+// Straight-line arithmetic and logic on registers and zero page
+static const u8 alu_program[] = {
+    0xA2, 0x00,         // LDX #$00
+    0xBD, 0x00, 0x02,   // LDA $0200,X
+    0x18,               // CLC
+    0x69, 0x01,         // ADC #$01
+    0x9D, 0x00, 0x03,   // STA $0300,X
+    0x45, 0x10,         // EOR $10
+    0x85, 0x10,         // STA $10
+    0xE8,               // INX
+    0xA8,               // TAY
+    0xC8,               // INY
+    0x98,               // TYA
+    0x29, 0x7F,         // AND #$7F
+    0xC9, 0x40,         // CMP #$40
+    0xE6, 0x11,         // INC $11
+    0xA5, 0x11,         // LDA $11
+    0x0A,               // ASL A
+    0x4A,               // LSR A
+    0x4C, 0x02, 0x04,   // JMP $0402
+};
+
+// Indexed and indirect memory traffic
+static const u8 mem_program[] = {
+    0xA9, 0x00,         // LDA #$00
+    0x85, 0x20,         // STA $20
+    0xA9, 0x02,         // LDA #$02
+    0x85, 0x21,         // STA $21
+    0xA0, 0x00,         // LDY #$00
+    0xB1, 0x20,         // LDA ($20),Y
+    0x91, 0x20,         // STA ($20),Y
+    0xC8,               // INY
+    0xB1, 0x20,         // LDA ($20),Y
+    0x99, 0x00, 0x03,   // STA $0300,Y
+    0xE8,               // INX
+    0xA1, 0x20,         // LDA ($20,X)
+    0x9D, 0x00, 0x03,   // STA $0300,X
+    0xB5, 0x30,         // LDA $30,X
+    0xFE, 0x00, 0x03,   // INC $0300,X
+    0x4C, 0x0A, 0x04,   // JMP $040A
+};
+
+// Subroutine calls and stack traffic
+static const u8 stack_program[] = {
+    0x20, 0x0A, 0x04,   // JSR $040A
+    0xE8,               // INX
+    0x8A,               // TXA
+    0x48,               // PHA
+    0x68,               // PLA
+    0x4C, 0x00, 0x04,   // JMP $0400
+    0x48,               // PHA
+    0x08,               // PHP
+    0xA9, 0x55,         // LDA #$55
+    0x28,               // PLP
+    0x68,               // PLA
+    0x60,               // RTS
+};
+
+// Tight counted loops
+static const u8 branch_program[] = {
+    0xA0, 0x00,         // LDY #$00
+    0xA2, 0x10,         // LDX #$10
+    0xCA,               // DEX
+    0xD0, 0xFD,         // BNE $0404
+    0xC8,               // INY
+    0xC0, 0x80,         // CPY #$80
+    0x90, 0xF6,         // BCC $0402
+    0x4C, 0x00, 0x04,   // JMP $0400
+};
+
+// Decimal counters, to compare against the binary ALU work
+static const u8 bcd_program[] = {
+    0xF8,               // SED
+    0x18,               // CLC
+    0xA5, 0x10,         // LDA $10
+    0x69, 0x01,         // ADC #$01
+    0x85, 0x10,         // STA $10
+    0xA5, 0x11,         // LDA $11
+    0x69, 0x00,         // ADC #$00
+    0x85, 0x11,         // STA $11
+    0x38,               // SEC
+    0xE9, 0x07,         // SBC #$07
+    0x4C, 0x01, 0x04,   // JMP $0401
+};
+
+// Software interrupts: every pass takes a BRK into a handler at
+// PROGRAM_START + 0x10, so status pushes and pulls dominate
+static const u8 irq_program[] = {
+    0xE8,               // INX
+    0x00, 0xEA,         // BRK
+    0x08,               // PHP
+    0x28,               // PLP
+    0x4C, 0x00, 0x04,   // JMP $0400
+    0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+    0x48,               // PHA
+    0x08,               // PHP
+    0x28,               // PLP
+    0x68,               // PLA
+    0x40,               // RTI
+};
+
+// Three ways through the loop depending on X, which the lanes benchmark
+// starts out different in every lane, so the lanes split up and join again
+static const u8 split_program[] = {
+    0x8A,               // TXA
+    0x29, 0x03,         // AND #$03
+    0xF0, 0x0D,         // BEQ $0412
+    0x4A,               // LSR A
+    0xB0, 0x05,         // BCS $040D
+    0xE6, 0x20,         // INC $20
+    0x4C, 0x16, 0x04,   // JMP $0416
+    0xC6, 0x21,         // DEC $21
+    0x4C, 0x16, 0x04,   // JMP $0416
+    0x65, 0x22,         // ADC $22
+    0x85, 0x22,         // STA $22
+    0xE8,               // INX
+    0x4C, 0x00, 0x04,   // JMP $0400
+};
+
+// Polls a device register and takes timer interrupts, which read another
+// one to acknowledge them. Only used by the replay timing, since it needs
+// the device.
+static const u8 device_program[] = {
+    0xAD, 0x00, 0x40,   // LDA $4000
+    0x85, 0x10,         // STA $10
+    0x65, 0x11,         // ADC $11
+    0x85, 0x11,         // STA $11
+    0x58,               // CLI
+    0x4C, 0x00, 0x04,   // JMP $0400
+    0xEA, 0xEA, 0xEA,
+    0xE6, 0x12,         // INC $12
+    0xAD, 0x01, 0x40,   // LDA $4001
+    0x40,               // RTI
+};
+
+static const workload_t workloads[] = {
+    {"alu", alu_program, sizeof(alu_program)},
+    {"mem", mem_program, sizeof(mem_program)},
+    {"stack", stack_program, sizeof(stack_program)},
+    {"branch", branch_program, sizeof(branch_program)},
+    {"bcd", bcd_program, sizeof(bcd_program)},
+    {"irq", irq_program, sizeof(irq_program)},
+    {"split", split_program, sizeof(split_program)},
+};
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef M6502_OPCODE_STATS
+
+// Print the report and write the full counts to stats_<workload>.json
+static void bench_stats(emulator_t* emulator, const workload_t* workload) {
+    cpu_stats_report(&emulator->cpu, stdout, STATS_TOP);
+    printf("\n");
+
+    char* json = cpu_stats_to_json(&emulator->cpu);
+    if(!json)
+        return;
+
+    char path[64];
+    snprintf(path, sizeof(path), "stats_%s.json", workload->name);
+
+    FILE* file = fopen(path, "w");
+    if(file) {
+        fputs(json, file);
+        fclose(file);
+    }
+
+    free(json);
+}
+
+#endif
+
+#ifdef M6502_PROFILE
+
+// Print the summary and save the heat maps to profile_<workload>.bin
+static void bench_profile(emulator_t* emulator, const workload_t* workload) {
+    cpu_profile_report(&emulator->cpu, stdout, PROFILE_TOP);
+    printf("\n");
+
+    char path[64];
+    snprintf(path, sizeof(path), "profile_%s.bin", workload->name);
+
+    cpu_profile_save(&emulator->cpu, path);
+}
+
+#endif
+
+// Put the workload in memory and run its first instruction
+static void bench_load(emulator_t* emulator, const workload_t* workload) {
+    emulator_reset(emulator);
+
+    memcpy(emulator->mem + PROGRAM_START, workload->program, workload->size);
+    emulator->mem[RST_START] = PROGRAM_START & 0xFF;
+    emulator->mem[RST_START + 1] = PROGRAM_START >> 8;
+    emulator->mem[IRQ_START] = (PROGRAM_START + 0x10) & 0xFF;
+    emulator->mem[IRQ_START + 1] = (PROGRAM_START + 0x10) >> 8;
+
+    cpu_reset(&emulator->cpu);
+    emulator_run_instructions(emulator, 1);
+}
+
+static void bench_workload(emulator_t* emulator, const workload_t* workload) {
+    bench_load(emulator, workload);
+
+#ifdef M6502_OPCODE_STATS
+    cpu_stats_clear(&emulator->cpu);
+#endif
+
+#ifdef M6502_PROFILE
+    cpu_profile_clear(&emulator->cpu);
+#endif
+
+    const u64 start_cycles = cpu_get_cycles(&emulator->cpu);
+
+    const double start = bench_now();
+    emulator_run_instructions(emulator, NUM_INSTRUCTIONS);
+    const double elapsed = bench_now() - start;
+
+    const u64 cycles = cpu_get_cycles(&emulator->cpu) - start_cycles;
+    const double emulated = cpu_cycles_to_ns(cycles, CYCLES_PER_SECOND) * 1e-9;
+
+    printf("%-8s %8.1f Minstr/s %8.1f Mcycles/s %8.0fx real time\n", workload->name, NUM_INSTRUCTIONS / elapsed / 1e6, cycles / elapsed / 1e6, emulated / elapsed);
+
+#ifdef M6502_OPCODE_STATS
+    bench_stats(emulator, workload);
+#endif
+
+#ifdef M6502_PROFILE
+    bench_profile(emulator, workload);
+#endif
+}
+
+// Time taking a snapshot, and restoring two that lie SNAPSHOT_DISTANCE
+// instructions apart, so each restore has a few pages to copy
+static void bench_snapshot(emulator_t* emulator) {
+    static u8 before[EMULATOR_SNAPSHOT_SIZE], after[EMULATOR_SNAPSHOT_SIZE];
+
+    emulator_snapshot(emulator, before, sizeof(before));
+    emulator_run_instructions(emulator, SNAPSHOT_DISTANCE);
+
+    double start = bench_now();
+    for(u32 i = 0; i < NUM_SNAPSHOTS; ++i)
+        emulator_snapshot(emulator, after, sizeof(after));
+    const double snapshot = bench_now() - start;
+
+    start = bench_now();
+    for(u32 i = 0; i < NUM_SNAPSHOTS; ++i) {
+        emulator_restore(emulator, before, sizeof(before));
+        emulator_restore(emulator, after, sizeof(after));
+    }
+    const double restore = bench_now() - start;
+
+    printf("snapshot %8.2f us/op  restore %8.2f us/op\n", snapshot / NUM_SNAPSHOTS * 1e6, restore / (2 * NUM_SNAPSHOTS) * 1e6);
+}
+
+// Time a rewind push per frame, and the slowest restore: the entry just
+// before the newest keyframe, which takes the longest run of deltas
+static void bench_rewind(emulator_t* emulator) {
+    rewind_t rewind;
+    if(!rewind_init(&rewind, REWIND_FRAMES, REWIND_ARENA_SIZE, REWIND_KEYFRAME_INTERVAL))
+        return;
+
+    double push = 0;
+    for(u32 i = 0; i < REWIND_FRAMES; ++i) {
+        emulator_run_cycles(emulator, REWIND_FRAME_CYCLES);
+
+        const double start = bench_now();
+        rewind_push(&rewind, emulator);
+        push += bench_now() - start;
+    }
+
+    const u32 back = rewind.since_keyframe + 1;
+    const u32 entries = rewind.count;
+    const u32 used = rewind.used;
+
+    const double start = bench_now();
+    rewind_restore(&rewind, emulator, back);
+    const double restore = bench_now() - start;
+
+    printf("rewind   %8.2f us/push %8u bytes/entry %8.2f us/restore\n", push / REWIND_FRAMES * 1e6, used / entries, restore * 1e6);
+
+    rewind_free(&rewind);
+}
+
+// Serve jobs from forks of the warmed-up emulator and time each round
+// trip: connect, poke the input, run, send back the output. Back to back
+// on one core, this includes forking the replacement children.
+static void bench_fork_server(emulator_t* emulator) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/6502_bench_%d.sock", (int)getpid());
+    unlink(path);
+
+    const pid_t server = fork();
+    if(server < 0)
+        return;
+
+    if(server == 0) {
+        fork_server_serve(emulator, path, FORK_CHILDREN, NULL, NULL);
+        _exit(1);
+    }
+
+    const fork_job_t job = {
+        .magic = FORK_SERVER_MAGIC,
+        .cycles = FORK_JOB_CYCLES,
+        .input_addr = 0x0200,
+        .input_size = 16,
+        .output_addr = 0x0200,
+        .output_size = 16,
+    };
+
+    u8 input[16] = {0}, output[16];
+    fork_result_t result;
+
+    // Wait for the server to start listening
+    const struct timespec retry = {0, 1000000};
+    for(u32 i = 0; i < 1000 && !fork_server_submit(path, &job, input, &result, output); ++i)
+        nanosleep(&retry, NULL);
+
+    u32 done = 0;
+
+    const double start = bench_now();
+    for(u32 i = 0; i < FORK_JOBS; ++i) {
+        input[0] = i;
+        done += fork_server_submit(path, &job, input, &result, output);
+    }
+    const double elapsed = bench_now() - start;
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(path);
+
+    printf("fork     %8.2f us/job %8u jobs\n", elapsed / FORK_JOBS * 1e6, done);
+}
+
+// A device page that reads as a pseudo-random sequence, and a timer that
+// raises an IRQ every REPLAY_IRQ_PERIOD cycles
+typedef struct bench_device {
+    emulator_t* emulator;
+    replay_t* replay;
+    u8 (*read_bus)(void* ctx, u16 addr);
+    u64 timer;
+    u32 state;
+} bench_device_t;
+
+static bench_device_t bench_device;
+
+static u8 bench_device_read(void* ctx, const u16 addr) {
+    if(addr >> 8 != REPLAY_DEVICE_PAGE)
+        return bench_device.read_bus(ctx, addr);
+
+    bench_device.state ^= bench_device.state << 13;
+    bench_device.state ^= bench_device.state >> 17;
+    bench_device.state ^= bench_device.state << 5;
+
+    return (u8)bench_device.state;
+}
+
+static void bench_device_timer(sched_t* sched, void* ctx, u64 deadline) {
+    (void)ctx;
+
+    if(bench_device.replay)
+        replay_irq(bench_device.replay);
+    else
+        cpu_irq(sched->cpu);
+
+    bench_device.timer = sched_add(sched, deadline + REPLAY_IRQ_PERIOD, bench_device_timer, NULL);
+}
+
+static void bench_device_attach(emulator_t* emulator, u32 seed) {
+    static const workload_t workload = {"device", device_program, sizeof(device_program)};
+    bench_load(emulator, &workload);
+
+    cpu_map(&emulator->cpu, REPLAY_DEVICE_PAGE << 8, CPU_PAGE_SIZE, NULL, NULL);
+
+    bench_device.emulator = emulator;
+    bench_device.replay = NULL;
+    bench_device.read_bus = emulator->cpu.read_bus;
+    bench_device.state = seed;
+    bench_device.timer = sched_add(&emulator->sched, emulator->sched.now + REPLAY_IRQ_PERIOD, bench_device_timer, NULL);
+
+    emulator->cpu.read_bus = bench_device_read;
+}
+
+static void bench_device_detach(emulator_t* emulator) {
+    sched_cancel(&emulator->sched, bench_device.timer);
+
+    emulator->cpu.read_bus = bench_device.read_bus;
+    cpu_map(&emulator->cpu, REPLAY_DEVICE_PAGE << 8, CPU_PAGE_SIZE, emulator->mem + (REPLAY_DEVICE_PAGE << 8), emulator->mem + (REPLAY_DEVICE_PAGE << 8));
+}
+
+// Run cycles in emulator_run_cycles calls of batch cycles each, or a single
+// call for 0
+static void bench_run_batches(emulator_t* emulator, u32 cycles, u32 batch) {
+    const u64 end = emulator->sched.now + cycles;
+
+    if(batch == 0)
+        batch = cycles;
+
+    while(emulator->sched.now < end) {
+        const u64 left = end - emulator->sched.now;
+        emulator_run_cycles(emulator, left < batch ? (u32)left : batch);
+    }
+}
+
+// Record the device workload in record_batch batches, then play it back in
+// play_batch ones against a device that would read differently. Returns 1
+// if the machine ends up the same without diverging.
+static _Bool bench_replay_check(emulator_t* emulator, const char* path, u32 record_batch, u32 play_batch, double* record, u64* events) {
+    static u8 recorded[EMULATOR_SNAPSHOT_SIZE], played[EMULATOR_SNAPSHOT_SIZE];
+
+    replay_t replay;
+
+    bench_device_attach(emulator, 1);
+    if(!replay_record(&replay, emulator, path)) {
+        bench_device_detach(emulator);
+        return 0;
+    }
+    bench_device.replay = &replay;
+
+    const double start = bench_now();
+    bench_run_batches(emulator, REPLAY_CYCLES, record_batch);
+    *record = bench_now() - start;
+
+    emulator_snapshot(emulator, recorded, sizeof(recorded));
+    *events = replay.events;
+    replay_close(&replay);
+    bench_device_detach(emulator);
+
+    bench_device_attach(emulator, 2);
+    _Bool exact = 0;
+    if(replay_play(&replay, emulator, path)) {
+        bench_device.replay = &replay;
+        bench_run_batches(emulator, REPLAY_CYCLES, play_batch);
+
+        emulator_snapshot(emulator, played, sizeof(played));
+        exact = !replay.diverged && memcmp(recorded, played, sizeof(played)) == 0;
+        replay_close(&replay);
+    }
+    bench_device_detach(emulator);
+
+    return exact;
+}
+
+// Time the device workload with and without recording its reads and
+// interrupts, then check that playback ends up where the recording did,
+// also when the run is split into batches differently than when recording
+static void bench_replay(emulator_t* emulator) {
+    // Record and play batch sizes, 0 for one call
+    static const u32 batches[][2] = {{0, 0}, {1000, 999}, {1000, 7}, {50, 200000}};
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/6502_bench_%d.replay", (int)getpid());
+
+    bench_device_attach(emulator, 1);
+    const double start = bench_now();
+    emulator_run_cycles(emulator, REPLAY_CYCLES);
+    const double plain = bench_now() - start;
+    bench_device_detach(emulator);
+
+    double record = 0;
+    u64 events = 0;
+    _Bool exact = bench_replay_check(emulator, path, batches[0][0], batches[0][1], &record, &events);
+
+    struct stat st;
+    const double bytes = stat(path, &st) == 0 ? (double)(st.st_size - sizeof(replay_header_t) - EMULATOR_SNAPSHOT_SIZE) : 0;
+
+    u32 split = 1;
+    for(; exact && split < sizeof(batches) / sizeof(batches[0]); ++split) {
+        double time;
+        u64 count;
+        exact = bench_replay_check(emulator, path, batches[split][0], batches[split][1], &time, &count);
+    }
+
+    unlink(path);
+
+    printf("replay   %+7.1f%% recording %8.2f bytes/event %8s", (record / plain - 1) * 100, events ? bytes / events : 0, exact ? "exact" : "diverged");
+    if(!exact)
+        printf(" (%u/%u)", batches[split - 1][0], batches[split - 1][1]);
+    printf("\n");
+}
+
+// A lane ended up exactly where its own emulator did, with counters that
+// started at loaded_cycles and loaded_instructions
+static _Bool bench_lanes_same(const lanes_t* lanes, u32 lane, emulator_t* emulator, u64 loaded_cycles, u64 loaded_instructions) {
+    const cpu_t* cpu = &emulator->cpu;
+
+    if(lanes->pc[lane] != cpu->pc || lanes->a[lane] != cpu->a || lanes->x[lane] != cpu->x || lanes->y[lane] != cpu->y || lanes->sp[lane] != cpu->sp ||
+        lanes->p[lane] != cpu_get_status(&emulator->cpu))
+        return 0;
+
+    if(lanes->total_cycles[lane] != cpu_get_cycles(cpu) - loaded_cycles || lanes->total_instructions[lane] != cpu_get_instructions(cpu) - loaded_instructions)
+        return 0;
+
+    for(u32 addr = 0; addr < 0x10000; ++addr) {
+        if(lanes_peek(lanes, lane, addr) != emulator->mem[addr])
+            return 0;
+    }
+
+    return 1;
+}
+
+// Run LANES_WIDTH copies of the workload with different A and X, once as
+// separate emulators one after another and once as lockstep lanes, then
+// check every lane against its emulator. Returns whether they all match.
+static _Bool bench_lanes(const workload_t* workload) {
+    static emulator_t emulators[LANES_WIDTH];
+    static u64 loaded_cycles[LANES_WIDTH], loaded_instructions[LANES_WIDTH];
+    static lanes_t lanes;
+
+    if(!lanes_init(&lanes))
+        return 1;
+
+    lanes_load(&lanes, PROGRAM_START, workload->program, workload->size);
+
+    for(u32 lane = 0; lane < LANES_WIDTH; ++lane) {
+        emulator_init(&emulators[lane]);
+        bench_load(&emulators[lane], workload);
+        emulators[lane].cpu.a = emulators[lane].cpu.x = lane;
+
+        // Pick up exactly where the emulator is after bench_load
+        for(u32 addr = 0; addr < 0x10000; ++addr)
+            lanes_poke(&lanes, lane, addr, emulators[lane].mem[addr]);
+
+        lanes.pc[lane] = emulators[lane].cpu.pc;
+        lanes.a[lane] = emulators[lane].cpu.a;
+        lanes.x[lane] = emulators[lane].cpu.x;
+        lanes.y[lane] = emulators[lane].cpu.y;
+        lanes.sp[lane] = emulators[lane].cpu.sp;
+        lanes.p[lane] = cpu_get_status(&emulators[lane].cpu);
+
+        loaded_cycles[lane] = cpu_get_cycles(&emulators[lane].cpu);
+        loaded_instructions[lane] = cpu_get_instructions(&emulators[lane].cpu);
+    }
+
+    // Straight on the CPU, which like lanes_run starts every slice afresh
+    // instead of taking an overshoot off the next one
+    double start = bench_now();
+    for(u32 done = 0; done < LANES_CYCLES; done += LANES_SLICE) {
+        for(u32 lane = 0; lane < LANES_WIDTH; ++lane)
+            cpu_run_cycles(&emulators[lane].cpu, LANES_SLICE);
+    }
+    const double scalar = bench_now() - start;
+
+    start = bench_now();
+    for(u32 done = 0; done < LANES_CYCLES; done += LANES_SLICE)
+        lanes_run(&lanes, LANES_SLICE);
+    const double vector = bench_now() - start;
+
+    const double cycles = (double)LANES_CYCLES * LANES_WIDTH;
+
+    u32 lane = 0;
+    while(lane < LANES_WIDTH && bench_lanes_same(&lanes, lane, &emulators[lane], loaded_cycles[lane], loaded_instructions[lane]))
+        ++lane;
+
+    printf("%-8s %8.1f Mcycles/s scalar %8.1f Mcycles/s lanes %8.1f steps/instr %8llu fallbacks", workload->name, cycles / scalar / 1e6, cycles / vector / 1e6,
+        (double)lanes.steps / (lanes.total_instructions[0] ? lanes.total_instructions[0] : 1), (unsigned long long)lanes.fallbacks);
+    if(lane < LANES_WIDTH)
+        printf(" (lane %u diverged)", lane);
+    printf("\n");
+
+    for(u32 i = 0; i < LANES_WIDTH; ++i)
+        cpu_release(&emulators[i].cpu);
+
+    lanes_free(&lanes);
+
+    return lane == LANES_WIDTH;
+}
+
+// Run the workloads side by side as independent sessions on one worker per
+// core and report the emulated clock rate of all of them together
+static void bench_pool(void) {
+    pool_t pool;
+    if(!pool_init(&pool, 0, 0x10000, POOL_QUANTUM, 1))
+        return;
+
+    const u32 num_sessions = pool.num_workers * POOL_SESSIONS_PER_WORKER;
+
+    for(u32 i = 0; i < num_sessions; ++i) {
+        pool_session_t* session = pool_add(&pool);
+        if(!session)
+            break;
+
+        bench_load(&session->emulator, &workloads[i % (sizeof(workloads) / sizeof(workloads[0]))]);
+        pool_resume(&pool, session);
+    }
+
+    const u64 start_cycles = pool_cycles(&pool);
+    const double start = bench_now();
+
+    const struct timespec duration = {POOL_SECONDS, 0};
+    nanosleep(&duration, NULL);
+
+    const double elapsed = bench_now() - start;
+    const u64 cycles = pool_cycles(&pool) - start_cycles;
+
+    printf("pool     %8u workers %8u sessions %8.1f MHz total %8llu steals\n", pool.num_workers, pool.num_sessions, cycles / elapsed / 1e6, (unsigned long long)pool_steals(&pool));
+
+    pool_destroy(&pool);
+}
+
+static u32 bench_random(u32* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+typedef struct pool_stress {
+    pool_session_t* session;
+
+    // Cycles the host ran while loading it, which the pool did not count
+    u64 loaded;
+
+    _Bool paused;
+} pool_stress_t;
+
+// A parked session's emulator ran exactly the cycles the pool counted for
+// it, so no quantum was lost or run twice
+static _Bool bench_pool_counted(const pool_stress_t* entry) {
+    return cpu_get_cycles(&entry->session->emulator.cpu) - entry->loaded == entry->session->cycles;
+}
+
+static _Bool bench_pool_stress_add(pool_t* pool, pool_stress_t* entry, u32 i) {
+    entry->session = pool_add(pool);
+    if(!entry->session)
+        return 0;
+
+    bench_load(&entry->session->emulator, &workloads[i % (sizeof(workloads) / sizeof(workloads[0]))]);
+    entry->loaded = cpu_get_cycles(&entry->session->emulator.cpu);
+    entry->paused = 0;
+
+    pool_resume(pool, entry->session);
+
+    return 1;
+}
+
+// Pause with and without waiting, resume, remove and add sessions at random
+// while the workers run them, including resumes of sessions that were
+// paused but not parked yet. Every session that gets parked must have run
+// exactly the cycles the pool counted for it. Returns whether they all did.
+static _Bool bench_pool_stress(void) {
+    pool_t pool;
+    if(!pool_init(&pool, POOL_STRESS_WORKERS, POOL_STRESS_SESSIONS, POOL_STRESS_QUANTUM, 0))
+        return 1;
+
+    static pool_stress_t entries[POOL_STRESS_SESSIONS];
+    u32 num_entries = 0;
+
+    while(num_entries < POOL_STRESS_SESSIONS / 2 && bench_pool_stress_add(&pool, &entries[num_entries], num_entries))
+        ++num_entries;
+
+    u32 state = 0x6502;
+    _Bool counted = 1;
+
+    for(u32 op = 0; op < POOL_STRESS_OPS && counted; ++op) {
+        const u32 i = num_entries ? bench_random(&state) % num_entries : 0;
+        pool_stress_t* entry = &entries[i];
+
+        switch(bench_random(&state) % 5) {
+            case 0:
+                if(num_entries == 0)
+                    break;
+
+                pool_pause(&pool, entry->session, 0);
+                entry->paused = 1;
+                break;
+            case 1:
+                if(num_entries == 0)
+                    break;
+
+                pool_pause(&pool, entry->session, 1);
+                entry->paused = 1;
+                counted = bench_pool_counted(entry);
+                break;
+            case 2:
+                if(num_entries == 0 || !entry->paused)
+                    break;
+
+                pool_resume(&pool, entry->session);
+                entry->paused = 0;
+                break;
+            case 3:
+                if(num_entries == 0)
+                    break;
+
+                pool_remove(&pool, entry->session);
+                *entry = entries[--num_entries];
+                break;
+            case 4:
+                if(num_entries < POOL_STRESS_SESSIONS && bench_pool_stress_add(&pool, &entries[num_entries], op))
+                    ++num_entries;
+                break;
+        }
+    }
+
+    for(u32 i = 0; i < num_entries && counted; ++i) {
+        pool_pause(&pool, entries[i].session, 1);
+        counted = bench_pool_counted(&entries[i]);
+    }
+
+    printf("pool     %8u ops %8s\n", POOL_STRESS_OPS, counted ? "exact" : "miscounted");
+
+    pool_destroy(&pool);
+
+    return counted;
+}
+
+#ifdef M6502_JIT
+
+// Instructions the check images are made of: everything but jumps,
+// subroutines, BRK/RTI and KIL, in every addressing mode. The stack and
+// SP changes come last, so handlers can leave them out and stay balanced.
+static const u8 jit_check_opcodes[] = {
+    0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, 0xA1, 0xB1, // LDA
+    0xA2, 0xA6, 0xB6, 0xAE, 0xBE,                   // LDX
+    0xA0, 0xA4, 0xB4, 0xAC, 0xBC,                   // LDY
+    0x85, 0x95, 0x8D, 0x9D, 0x99, 0x81, 0x91,       // STA
+    0x86, 0x96, 0x8E, 0x84, 0x94, 0x8C,             // STX, STY
+    0xAA, 0xA8, 0x8A, 0x98, 0xBA,                   // TAX, TAY, TXA, TYA, TSX
+    0x69, 0x65, 0x7D, 0x71, 0xE9, 0xE5, 0xFD, 0xE1, // ADC, SBC
+    0x29, 0x35, 0x3D, 0x09, 0x0D, 0x19, 0x49, 0x55, // AND, ORA, EOR
+    0xC9, 0xC5, 0xDD, 0xE0, 0xE4, 0xC0, 0xCC, 0x24, 0x2C, // CMP, CPX, CPY, BIT
+    0x0A, 0x06, 0x1E, 0x4A, 0x56, 0x4E, 0x2A, 0x26, // ASL, LSR, ROL
+    0x3E, 0x6A, 0x66, 0x7E,                         // ROL, ROR
+    0xE6, 0xFE, 0xC6, 0xD6, 0xEE, 0xCE,             // INC, DEC
+    0xE8, 0xC8, 0xCA, 0x88,                         // INX, INY, DEX, DEY
+    0x18, 0x38, 0x58, 0x78, 0xB8, 0xD8, 0xF8,       // flags
+    0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0, // branches
+    0x48, 0x68, 0x08, 0x28, 0x9A,                   // PHA, PLA, PHP, PLP, TXS
+};
+
+#define JIT_CHECK_STACK_OPCODES 5
+
+// Instruction length by the low five bits of the opcode, which holds for
+// everything in jit_check_opcodes
+static const u8 jit_check_sizes[32] = {
+    2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+    2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+};
+
+// Fill [addr, end) with random instructions from the first num_opcodes of
+// jit_check_opcodes. Some of the absolute operands point into the image's
+// own code, mostly just ahead of themselves, so it keeps rewriting the
+// block it is in; the rest point at data.
+static u16 bench_jit_code(emulator_t* emulator, u16 addr, u16 end, u32 num_opcodes, u32* state) {
+    while(addr + 3 <= end) {
+        const u8 opcode = jit_check_opcodes[bench_random(state) % num_opcodes];
+        const u8 size = jit_check_sizes[opcode & 0x1F];
+
+        u16 operand;
+        if((opcode & 0x1F) == 0x10)
+            operand = bench_random(state) % 8;
+        else if(bench_random(state) % 8 == 0)
+            operand = addr + bench_random(state) % 32;
+        else if(bench_random(state) % 8 == 0)
+            operand = PROGRAM_START + bench_random(state) % (JIT_CHECK_HANDLER + 0x40 - PROGRAM_START);
+        else
+            operand = JIT_CHECK_DATA + bench_random(state) % 0x200;
+
+        emulator->mem[addr] = opcode;
+        if(size > 1)
+            emulator->mem[addr + 1] = operand & 0xFF;
+        if(size > 2)
+            emulator->mem[addr + 2] = operand >> 8;
+
+        addr += size;
+    }
+
+    return addr;
+}
+
+// A random image: random data everywhere, a main loop at PROGRAM_START
+// and an interrupt handler at JIT_CHECK_HANDLER
+static void bench_jit_image(emulator_t* emulator, u32* state) {
+    for(u32 addr = 0; addr < MEM_SIZE; ++addr)
+        emulator->mem[addr] = bench_random(state);
+
+    u16 addr = bench_jit_code(emulator, PROGRAM_START, PROGRAM_START + JIT_CHECK_BODY, sizeof(jit_check_opcodes), state);
+    emulator->mem[addr] = 0x4C; // JMP PROGRAM_START
+    emulator->mem[addr + 1] = PROGRAM_START & 0xFF;
+    emulator->mem[addr + 2] = PROGRAM_START >> 8;
+
+    addr = bench_jit_code(emulator, JIT_CHECK_HANDLER, JIT_CHECK_HANDLER + 0x3F, sizeof(jit_check_opcodes) - JIT_CHECK_STACK_OPCODES, state);
+    emulator->mem[addr] = 0x40; // RTI
+
+    emulator->mem[RST_START] = PROGRAM_START & 0xFF;
+    emulator->mem[RST_START + 1] = PROGRAM_START >> 8;
+    for(u16 vector = NMI_START; vector < RST_START; vector += 4) {
+        emulator->mem[vector] = JIT_CHECK_HANDLER & 0xFF;
+        emulator->mem[vector + 1] = JIT_CHECK_HANDLER >> 8;
+    }
+}
+
+static _Bool bench_jit_same(emulator_t* jit, emulator_t* interpreter) {
+    const cpu_t* a = &jit->cpu;
+    const cpu_t* b = &interpreter->cpu;
+
+    return a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp && a->pc == b->pc && b->cycles == 0 &&
+        cpu_get_status(&jit->cpu) == cpu_get_status(&interpreter->cpu) && cpu_get_cycles(a) == cpu_get_cycles(b) &&
+        cpu_get_instructions(a) == cpu_get_instructions(b) && memcmp(jit->mem, interpreter->mem, MEM_SIZE) == 0;
+}
+
+// Run random self-modifying images through the JIT at its usual thresholds
+// and through the interpreter one cpu_clock at a time, in random batches
+// of cycles or instructions with IRQs and NMIs in between, and compare the
+// registers, memory, and the cycles and instructions run after each batch.
+// Returns whether the two agreed throughout.
+static _Bool bench_jit_check(void) {
+    static emulator_t jit, interpreter;
+    emulator_init(&jit);
+    emulator_init(&interpreter);
+
+    u32 state = 0x6502;
+    u32 image = 0, batch = 0;
+    _Bool same = 1;
+
+    for(image = 0; image < JIT_CHECK_IMAGES && same; ++image) {
+        bench_jit_image(&jit, &state);
+        memcpy(interpreter.mem, jit.mem, MEM_SIZE);
+        cpu_invalidate(&jit.cpu, 0, MEM_SIZE);
+        cpu_reset(&jit.cpu);
+        cpu_reset(&interpreter.cpu);
+
+        // The reset sequence is pending just like an interrupt's
+        _Bool interrupted = 1;
+
+        for(batch = 0; batch < JIT_CHECK_BATCHES && same; ++batch) {
+            u32 cycles, instructions;
+
+            // A pending reset or interrupt sequence would count as an
+            // instruction
+            if(interrupted || bench_random(&state) % 2) {
+                cycles = cpu_run_cycles(&jit.cpu, 1 + bench_random(&state) % 3000);
+                instructions = UINT32_MAX;
+            }
+            else {
+                instructions = 1 + bench_random(&state) % 1000;
+                cycles = cpu_run_instructions(&jit.cpu, instructions);
+            }
+
+            u32 started = 0;
+            for(u32 i = 0; i < cycles; ++i) {
+                started += interpreter.cpu.cycles == 0;
+                cpu_clock(&interpreter.cpu);
+            }
+
+            same = bench_jit_same(&jit, &interpreter) && (instructions == UINT32_MAX || started == instructions);
+
+            interrupted = 0;
+            switch(bench_random(&state) % 8) {
+                case 0:
+                    cpu_irq(&jit.cpu);
+                    cpu_irq(&interpreter.cpu);
+                    interrupted = 1;
+                    break;
+                case 1:
+                    cpu_nmi(&jit.cpu);
+                    cpu_nmi(&interpreter.cpu);
+                    interrupted = 1;
+                    break;
+            }
+        }
+    }
+
+    printf("jit      %8u images %8s", image, same ? "exact" : "diverged");
+    if(!same)
+        printf(" (image %u, batch %u)", image - 1, batch - 1);
+    printf("\n");
+
+    cpu_release(&jit.cpu);
+
+    return same;
+}
+
+#endif
+
+int main(int argc, char* argv[]) {
+    static emulator_t emulator;
+    emulator_init(&emulator);
+
+#if defined(M6502_CYCLE_EXACT)
+    printf("-- cycle-exact --\n");
+#elif defined(M6502_JIT)
+    printf("-- x86-64 jit --\n");
+#elif defined(M6502_BLOCK_CACHE)
+    printf("-- block cache --\n");
+#elif defined(M6502_THREADED_DISPATCH)
+    printf("-- threaded dispatch --\n");
+#else
+    printf("-- table dispatch --\n");
+#endif
+
+    for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+        if(argc > 1 && strcmp(argv[1], workloads[i].name) != 0)
+            continue;
+
+        bench_workload(&emulator, &workloads[i]);
+    }
+
+    printf("-- %u lanes --\n", LANES_WIDTH);
+
+    _Bool lanes_exact = 1;
+    for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+        if(argc > 1 && strcmp(argv[1], workloads[i].name) != 0)
+            continue;
+
+        lanes_exact &= bench_lanes(&workloads[i]);
+    }
+
+    if(!lanes_exact)
+        return 1;
+
+    bench_snapshot(&emulator);
+    bench_rewind(&emulator);
+    bench_replay(&emulator);
+    bench_pool();
+    bench_fork_server(&emulator);
+
+    if(!bench_pool_stress())
+        return 1;
+
+#ifdef M6502_JIT
+    if(!bench_jit_check())
+        return 1;
+#endif
+
+    return 0;
+}
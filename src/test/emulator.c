@@ -14,10 +14,12 @@
 
 #include "emulator.h"
 
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#define CYCLES_PER_SECOND 1790000 // 1.79 MHz
-
 static inline u8 mem_read_byte(u8* mem, const u16 addr) {
     return mem[addr];
 }
@@ -26,13 +28,23 @@ static inline void mem_write_byte(u8* mem, const u16 addr, const u8 val) {
     mem[addr] = val;
 }
 
+static inline void emulator_log_access(emulator_t* emulator, const u16 addr, const u8 val, const _Bool write) {
+    if(!emulator->bus_log_enabled || emulator->bus_log_len == BUS_LOG_SIZE)
+        return;
+
+    emulator->bus_log[emulator->bus_log_len++] = (bus_access_t){.addr = addr, .val = val, .write = write};
+}
+
 static u8 emulator_read_bus(void* ctx, const u16 addr) {
     emulator_t* emulator = (emulator_t*)ctx;
-    return mem_read_byte(emulator->mem, addr);
+    const u8 val = mem_read_byte(emulator->mem, addr);
+    emulator_log_access(emulator, addr, val, 0);
+    return val;
 }
 
 static void emulator_write_bus(void* ctx, const u16 addr, const u8 val) {
     emulator_t* emulator = (emulator_t*)ctx;
+    emulator_log_access(emulator, addr, val, 1);
     mem_write_byte(emulator->mem, addr, val);
 }
 
@@ -42,10 +54,19 @@ void emulator_reset(emulator_t* emulator) {
 }
 
 void emulator_init(emulator_t* emulator) {
+    memset(&emulator->cpu, 0, sizeof(cpu_t));
+    emulator->bus_log_len = 0;
+    emulator->bus_log_enabled = 0;
+
     emulator->cpu.bus = emulator;
     emulator->cpu.read_bus = &emulator_read_bus;
     emulator->cpu.write_bus = &emulator_write_bus;
 
+    sched_init(&emulator->sched, &emulator->cpu);
+
+    // All of memory is plain RAM, so let the CPU access it directly
+    cpu_map(&emulator->cpu, 0x0000, MEM_SIZE, emulator->mem, emulator->mem);
+
     // emulator->cpu.write_bus(emulator->cpu.bus, RST_START, 0x00);
     // emulator->cpu.write_bus(emulator->cpu.bus, RST_START + 1, 0xC0);
 
@@ -69,6 +90,8 @@ void emulator_load(emulator_t* emulator, const char* path) {
         return;
     }
 
+    cpu_invalidate(&emulator->cpu, 0x0000, MEM_SIZE);
+
     // == NESTEST ==
 
     // fseek(file, 0x10, SEEK_SET);
@@ -90,7 +113,120 @@ void emulator_load(emulator_t* emulator, const char* path) {
 void emulator_run(emulator_t* emulator) {
     // for(size_t i = 0; i < CYCLES_PER_SECOND; ++i) {
         cpu_clock(&emulator->cpu);
+        sched_advance(&emulator->sched, 1);
     // }
     
     // sleep(1);
+}
+
+u32 emulator_run_cycles(emulator_t* emulator, u32 budget) {
+    const u64 start = emulator->sched.now;
+    return sched_run_until(&emulator->sched, start + budget) - start;
+}
+
+u32 emulator_run_instructions(emulator_t* emulator, u32 n) {
+    const u32 cycles = cpu_run_instructions(&emulator->cpu, n);
+    sched_advance(&emulator->sched, cycles);
+    return cycles;
+}
+
+size_t emulator_snapshot(emulator_t* emulator, void* buf, size_t size) {
+    if(size < EMULATOR_SNAPSHOT_SIZE)
+        return 0;
+
+    const emulator_snapshot_t header = {
+        .magic = EMULATOR_SNAPSHOT_MAGIC,
+        .version = EMULATOR_SNAPSHOT_VERSION,
+        .size = EMULATOR_SNAPSHOT_SIZE,
+        .sched_now = emulator->sched.now,
+    };
+
+    // Field by field, so buf needs no particular alignment
+    u8* out = buf;
+    memcpy(out, &header, offsetof(emulator_snapshot_t, cpu));
+    cpu_snapshot(&emulator->cpu, out + offsetof(emulator_snapshot_t, cpu), CPU_SNAPSHOT_SIZE);
+    memcpy(out + offsetof(emulator_snapshot_t, mem), emulator->mem, MEM_SIZE);
+
+    return EMULATOR_SNAPSHOT_SIZE;
+}
+
+_Bool emulator_restore(emulator_t* emulator, const void* buf, size_t size) {
+    if(size < EMULATOR_SNAPSHOT_SIZE)
+        return 0;
+
+    emulator_snapshot_t header;
+    const u8* in = buf;
+    memcpy(&header, in, offsetof(emulator_snapshot_t, cpu));
+
+    if(header.magic != EMULATOR_SNAPSHOT_MAGIC || header.version != EMULATOR_SNAPSHOT_VERSION || header.size != EMULATOR_SNAPSHOT_SIZE)
+        return 0;
+
+    // The CPU checks its part before anything is changed
+    if(!cpu_restore(&emulator->cpu, in + offsetof(emulator_snapshot_t, cpu), CPU_SNAPSHOT_SIZE))
+        return 0;
+
+    // Snapshots taken close together share most pages, and leaving those
+    // alone keeps their decoded blocks. Within a page only the span that
+    // changed is invalidated, since that costs a block cache scan per byte
+    // of code.
+    const u8* mem = in + offsetof(emulator_snapshot_t, mem);
+    for(u32 page = 0; page < MEM_SIZE; page += CPU_PAGE_SIZE) {
+        if(memcmp(emulator->mem + page, mem + page, CPU_PAGE_SIZE) == 0)
+            continue;
+
+        u32 first = page, last = page + CPU_PAGE_SIZE - 1;
+        while(emulator->mem[first] == mem[first])
+            ++first;
+        while(emulator->mem[last] == mem[last])
+            --last;
+
+        memcpy(emulator->mem + first, mem + first, last + 1 - first);
+        cpu_invalidate(&emulator->cpu, first, last + 1 - first);
+    }
+
+    emulator->sched.now = header.sched_now;
+
+    return 1;
+}
+
+_Bool emulator_save_snapshot(emulator_t* emulator, const char* path) {
+    u8* buf = malloc(EMULATOR_SNAPSHOT_SIZE);
+    if(!buf)
+        return 0;
+
+    emulator_snapshot(emulator, buf, EMULATOR_SNAPSHOT_SIZE);
+
+    FILE* file = fopen(path, "wb");
+    _Bool ok = file && fwrite(buf, 1, EMULATOR_SNAPSHOT_SIZE, file) == EMULATOR_SNAPSHOT_SIZE;
+
+    if(file && fclose(file) != 0)
+        ok = 0;
+
+    free(buf);
+
+    return ok;
+}
+
+_Bool emulator_restore_file(emulator_t* emulator, const char* path) {
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < EMULATOR_SNAPSHOT_SIZE) {
+        close(fd);
+        return 0;
+    }
+
+    void* map = mmap(NULL, EMULATOR_SNAPSHOT_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED)
+        return 0;
+
+    const _Bool ok = emulator_restore(emulator, map, EMULATOR_SNAPSHOT_SIZE);
+
+    munmap(map, EMULATOR_SNAPSHOT_SIZE);
+
+    return ok;
 }
\ No newline at end of file
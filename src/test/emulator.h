@@ -17,22 +17,81 @@
 
 #define MEM_SIZE 0x10000
 
+#define CYCLES_PER_SECOND 1790000 // 1.79 MHz
+
+// Longest instruction is 7 cycles, with room to spare
+#define BUS_LOG_SIZE 16
+
 #include <stdio.h>
 #include <memory.h>
 
 #include "../lib/cpu.h"
+#include "../lib/scheduler.h"
+
+// One access seen by the bus callbacks
+typedef struct bus_access {
+    u16 addr;
+    u8 val;
+    _Bool write;
+} bus_access_t;
 
 typedef struct emulator {
     cpu_t cpu;
     u8 mem[MEM_SIZE];
+
+    // Device events. Every way of running the CPU below keeps sched.now in
+    // step with it.
+    sched_t sched;
+
+    // Accesses to unmapped pages are recorded here while bus_log_enabled is
+    // set, so tests can compare them cycle by cycle
+    bus_access_t bus_log[BUS_LOG_SIZE];
+    u8 bus_log_len;
+    _Bool bus_log_enabled;
 } emulator_t;
 
+#define EMULATOR_SNAPSHOT_MAGIC 0x554D4536 // "6EMU" in a little-endian dump
+#define EMULATOR_SNAPSHOT_VERSION 1
+
+// A whole machine: the CPU, all of memory and the scheduler's clock.
+// Pending scheduler events hold host pointers, so they are not saved and
+// stay as they are on restore.
+typedef struct emulator_snapshot {
+    u32 magic;
+    u16 version;
+    u16 reserved;
+    u32 size;
+    u32 reserved2;
+    u64 sched_now;
+    cpu_snapshot_t cpu;
+    u8 mem[MEM_SIZE];
+} emulator_snapshot_t;
+
+#define EMULATOR_SNAPSHOT_SIZE sizeof(emulator_snapshot_t)
+
 void emulator_reset(emulator_t* emulator);
 void emulator_init(emulator_t* emulator);
 
 void emulator_load(emulator_t* emulator, const char* path);
 
 void emulator_run(emulator_t* emulator);
+u32 emulator_run_cycles(emulator_t* emulator, u32 budget);
+u32 emulator_run_instructions(emulator_t* emulator, u32 n);
+
+// Write the machine into buf, which needs EMULATOR_SNAPSHOT_SIZE bytes.
+// Returns the bytes written, or 0 if size is short.
+size_t emulator_snapshot(emulator_t* emulator, void* buf, size_t size);
+
+// Load a snapshot from buf, which can be read-only. Only the memory pages
+// that differ get copied and dropped from the CPU's caches, so rewinding a
+// short way keeps the block cache warm. The memory map and bus callbacks
+// stay as they are. Returns 0 and leaves the machine alone if buf holds no
+// usable snapshot.
+_Bool emulator_restore(emulator_t* emulator, const void* buf, size_t size);
+
+// The same through a file, which is mapped read-only to restore from
+_Bool emulator_save_snapshot(emulator_t* emulator, const char* path);
+_Bool emulator_restore_file(emulator_t* emulator, const char* path);
 
 static u8 emulator_read_bus(void* bus, const u16 addr);
 static void emulator_write_bus(void* bus, const u16 addr, const u8 val);
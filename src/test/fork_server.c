@@ -0,0 +1,232 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#define _GNU_SOURCE
+
+#include "fork_server.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Connections waiting for accept
+#define FORK_SERVER_BACKLOG 64
+
+// How long to wait before forking again when no child could be forked, or
+// one failed, so a persistent error doesn't turn into a fork loop
+#define FORK_SERVER_RETRY_NS 1000000
+
+// =================================================================================
+// SOCKETS
+// =================================================================================
+
+static _Bool fork_read(int fd, void* buf, size_t size) {
+    u8* bytes = buf;
+
+    while(size != 0) {
+        const ssize_t n = recv(fd, bytes, size, 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+
+        bytes += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+// MSG_NOSIGNAL, so a peer that went away is an error rather than SIGPIPE
+static _Bool fork_write(int fd, const void* buf, size_t size) {
+    const u8* bytes = buf;
+
+    while(size != 0) {
+        const ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+
+        bytes += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+static _Bool fork_address(struct sockaddr_un* addr, const char* path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if(strlen(path) >= sizeof(addr->sun_path))
+        return 0;
+
+    strcpy(addr->sun_path, path);
+
+    return 1;
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+void fork_server_job(emulator_t* emulator, int fd, void* ctx) {
+    fork_job_t job;
+    if(!fork_read(fd, &job, sizeof(job)) || job.magic != FORK_SERVER_MAGIC)
+        return;
+
+    if(job.input_size > (u32)MEM_SIZE - job.input_addr || job.output_size > (u32)MEM_SIZE - job.output_addr)
+        return;
+
+    if(!fork_read(fd, emulator->mem + job.input_addr, job.input_size))
+        return;
+
+    cpu_invalidate(&emulator->cpu, job.input_addr, job.input_size);
+
+    fork_result_t result = {.magic = FORK_SERVER_MAGIC, .output_size = job.output_size};
+    result.cycles = emulator_run_cycles(emulator, job.cycles);
+
+    result.pc = emulator->cpu.pc;
+    result.a = emulator->cpu.a;
+    result.x = emulator->cpu.x;
+    result.y = emulator->cpu.y;
+    result.sp = emulator->cpu.sp;
+    result.p = cpu_get_status(&emulator->cpu);
+
+    if(fork_write(fd, &result, sizeof(result)))
+        fork_write(fd, emulator->mem + job.output_addr, job.output_size);
+}
+
+// Fork a child that waits for one connection, handles it and exits, so its
+// slot is refilled once the reply is out. Exits with 1 if accept failed.
+static pid_t fork_server_spawn(emulator_t* emulator, int server, fork_handler_t handler, void* ctx) {
+    const pid_t parent = getpid();
+    const pid_t pid = fork();
+    if(pid != 0)
+        return pid;
+
+    // Don't outlive the server while waiting in accept
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if(getppid() != parent)
+        _exit(1);
+
+    int fd;
+    do {
+        fd = accept(server, NULL, NULL);
+    } while(fd < 0 && (errno == EINTR || errno == ECONNABORTED));
+
+    close(server);
+
+    // Skip atexit handlers and stdio buffers, which belong to the server.
+    // stderr is unbuffered.
+    if(fd < 0) {
+        fprintf(stderr, "fork server: accept failed: %s\n", strerror(errno));
+        _exit(1);
+    }
+
+    handler(emulator, fd, ctx);
+    close(fd);
+
+    _exit(0);
+}
+
+_Bool fork_server_serve(emulator_t* emulator, const char* path, u32 children, fork_handler_t handler, void* ctx) {
+    if(!handler)
+        handler = fork_server_job;
+    if(children == 0)
+        children = 1;
+
+    struct sockaddr_un addr;
+    if(!fork_address(&addr, path))
+        return 0;
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0)
+        return 0;
+
+    unlink(path);
+
+    if(bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, FORK_SERVER_BACKLOG) != 0) {
+        close(server);
+        return 0;
+    }
+
+    const struct timespec retry = {0, FORK_SERVER_RETRY_NS};
+    u32 running = 0;
+
+    for(;;) {
+        // Keep every slot filled. When fork fails, e.g. at the process
+        // limit, try again a little later.
+        while(running < children && fork_server_spawn(emulator, server, handler, ctx) > 0)
+            ++running;
+
+        if(running == 0) {
+            nanosleep(&retry, NULL);
+            continue;
+        }
+
+        // A slot is free once its child is gone, however it ended, so a
+        // crashed or killed child is replaced like one that finished
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+
+        if(pid < 0) {
+            // Someone else reaped them, none of the count is left
+            if(errno == ECHILD)
+                running = 0;
+            continue;
+        }
+
+        --running;
+
+        if(WIFSIGNALED(status))
+            fprintf(stderr, "fork server: child %d killed by signal %d\n", (int)pid, WTERMSIG(status));
+
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            nanosleep(&retry, NULL);
+    }
+
+    return 0;
+}
+
+_Bool fork_server_submit(const char* path, const fork_job_t* job, const void* input, fork_result_t* result, void* output) {
+    struct sockaddr_un addr;
+    if(!fork_address(&addr, path))
+        return 0;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return 0;
+
+    const _Bool ok = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0
+        && fork_write(fd, job, sizeof(*job))
+        && fork_write(fd, input, job->input_size)
+        && fork_read(fd, result, sizeof(*result))
+        && result->magic == FORK_SERVER_MAGIC
+        && result->output_size == job->output_size
+        && fork_read(fd, output, result->output_size);
+
+    close(fd);
+
+    return ok;
+}
@@ -0,0 +1,83 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Boot a machine once, then serve jobs from it. Every connection to the
+// server's Unix socket is handled by a fork() of the server, so each job
+// starts from the warmed-up machine, caches included, while the kernel
+// shares its memory copy-on-write. Only the thread that calls
+// fork_server_serve exists in the children, so don't serve while a trace
+// writer thread is running.
+
+#ifndef M6502_FORK_SERVER_H
+#define M6502_FORK_SERVER_H
+
+#include "emulator.h"
+
+#define FORK_SERVER_MAGIC 0x4B524F46 // "FORK" in a little-endian dump
+
+// Sent by the client, followed by input_size bytes for memory at
+// input_addr. The job then runs for cycles, like emulator_run_cycles.
+typedef struct fork_job {
+    u32 magic;
+    u32 cycles;
+    u16 input_addr;
+    u16 output_addr;
+    u32 input_size;
+    u32 output_size;
+} fork_job_t;
+
+// Sent back when the job is done, followed by output_size bytes of memory
+// from output_addr
+typedef struct fork_result {
+    u32 magic;
+    // Cycles actually run
+    u32 cycles;
+    u16 pc;
+    u8 a;
+    u8 x;
+    u8 y;
+    u8 sp;
+    // As cpu_get_status returns it
+    u8 p;
+    u8 reserved;
+    u32 output_size;
+} fork_result_t;
+
+// Runs in the child on its own copy of the machine, with the connection
+// in fd. The child exits when it returns.
+typedef void (*fork_handler_t)(emulator_t* emulator, int fd, void* ctx);
+
+// The default handler: one fork_job_t in, one fork_result_t out. A job
+// whose ranges don't fit in memory gets the connection closed instead.
+void fork_server_job(emulator_t* emulator, int fd, void* ctx);
+
+// Listen on a Unix socket at path, replacing any file there, and serve
+// connections from forks of the server. children are forked ahead of time
+// and wait in accept, each for a single connection, so a job never waits
+// for fork() unless all of them are busy; a child is replaced once it has
+// sent its result. handler may be NULL for fork_server_job. Slots are
+// freed by reaping children, crashed or not, so this should run in a
+// process of its own. Children that fail to accept or die from a signal
+// are logged to stderr and replaced. Only returns, with 0, when the socket
+// can't be set up; stop it with a signal, which also takes the waiting
+// children down.
+_Bool fork_server_serve(emulator_t* emulator, const char* path, u32 children, fork_handler_t handler, void* ctx);
+
+// Client side: run one job on the server at path. output needs room for
+// job->output_size bytes. Returns 0 if the server can't be reached or
+// didn't send a result.
+_Bool fork_server_submit(const char* path, const fork_job_t* job, const void* input, fork_result_t* result, void* output);
+
+#endif //M6502_FORK_SERVER_H
@@ -15,6 +15,10 @@
 #include <ncurses.h>
 
 #include "emulator.h"
+#include "rewind.h"
+#include "../lib/debug.h"
+#include "../lib/profile.h"
+#include "../lib/trace.h"
 #include "../../deps/cjson/cJSON.h"
 
 #define MEM_COLS 0x10
@@ -22,6 +26,55 @@
 
 #define MEM_SCROLL_SPEED 8
 
+// Steps 'r' can undo, kept as deltas with a keyframe every REWIND_INTERVAL
+#define REWIND_STEPS 4096
+#define REWIND_ARENA_SIZE (1 << 20)
+#define REWIND_INTERVAL 64
+
+#ifdef M6502_PROFILE
+
+// Color pairs from cold to hot
+#define HEAT_LEVELS 5
+
+#define PROFILE_TOP 16
+
+// Which heat map the memory view colors bytes by, cycled with 'h'
+typedef enum heat_mode {
+    HEAT_OFF,
+    HEAT_CYCLES,
+    HEAT_READS,
+    HEAT_WRITES,
+    NUM_HEAT_MODES,
+} heat_mode_t;
+
+static const char* const heat_names[NUM_HEAT_MODES] = {"off", "cycles", "reads", "writes"};
+
+static heat_mode_t heat_mode = HEAT_OFF;
+
+#endif
+
+#ifdef M6502_TRACE
+
+// Records the ring holds before the CPU has to wait for the writer
+#define TRACE_CAPACITY (1 << 16)
+
+#endif
+
+#ifdef M6502_DEBUG
+
+// 'c' runs in slices of one 60 Hz frame, checking for a key in between
+#define DEBUG_SLICE_CYCLES (CYCLES_PER_SECOND / 60)
+
+#endif
+
+// The NES set comes from a 2A03 and has no decimal mode, so it only
+// matches a build without it
+#ifdef M6502_NO_DECIMAL
+#define TESTS_DIR "SingleStepTestsNES"
+#else
+#define TESTS_DIR "SingleStepTests"
+#endif
+
 // Test an opcode with only one test, specified by index
 u8 test_opcode_single(emulator_t* emulator, const char* path, u16 test_idx) {
     FILE* file = fopen(path, "r");
@@ -113,30 +166,68 @@ u8 test_opcode_single(emulator_t* emulator, const char* path, u16 test_idx) {
     }
 
     // Finish the reset routine
-    do {
-        emulator_run(emulator);
-    } while(!cpu_is_complete(&emulator->cpu));
+    emulator_run_instructions(emulator, 1);
 
-    if(cpu_is_illegal(&emulator->cpu))
+    // KIL/JAM lock up the bus in ways the core does not model
+    if(cpu_is_jammed(&emulator->cpu)) {
+        cJSON_Delete(root);
         return 2;
+    }
+
+#ifdef M6502_CYCLE_EXACT
+    // Send every access through the bus callbacks so each cycle gets logged
+    cpu_map(&emulator->cpu, 0x0000, MEM_SIZE, NULL, NULL);
+    emulator->bus_log_len = 0;
+    emulator->bus_log_enabled = 1;
+#endif
 
     // Execute one instruction
-    do {
-        emulator_run(emulator);
-    } while(!cpu_is_complete(&emulator->cpu));
+    emulator_run_instructions(emulator, 1);
 
-    if((emulator->cpu.sp != final_sp->valueint) || (cpu_get_status(&emulator->cpu) != final_sr->valueint) || (emulator->cpu.a != final_a->valueint) || (emulator->cpu.x != final_x->valueint) || (emulator->cpu.y != final_y->valueint))
-        return 1;
+#ifdef M6502_CYCLE_EXACT
+    emulator->bus_log_enabled = 0;
+    cpu_map(&emulator->cpu, 0x0000, MEM_SIZE, emulator->mem, emulator->mem);
+#endif
+
+    u8 res = 0;
+
+    if((emulator->cpu.pc != final_pc->valueint) || (emulator->cpu.sp != final_sp->valueint) || (cpu_get_status(&emulator->cpu) != final_sr->valueint) || (emulator->cpu.a != final_a->valueint) || (emulator->cpu.x != final_x->valueint) || (emulator->cpu.y != final_y->valueint))
+        res = 1;
 
     cJSON_ArrayForEach(final_ram_element, final_ram_array) {
         cJSON* addr = cJSON_GetArrayItem(final_ram_element, 0);
         cJSON* val = cJSON_GetArrayItem(final_ram_element, 1);
 
         if(emulator->cpu.read_bus(emulator->cpu.bus, addr->valueint) != val->valueint)
-            return 1;
+            res = 1;
     }
 
-    return 0;
+#ifdef M6502_CYCLE_EXACT
+    // Each cycle is [address, value, "read" or "write"]
+    cJSON* cycles_array = cJSON_GetObjectItem(test, "cycles");
+    cJSON* cycle_element = NULL;
+
+    if(cJSON_GetArraySize(cycles_array) != emulator->bus_log_len)
+        res = 1;
+
+    u8 cycle = 0;
+    cJSON_ArrayForEach(cycle_element, cycles_array) {
+        if(cycle == emulator->bus_log_len)
+            break;
+
+        const bus_access_t* access = &emulator->bus_log[cycle++];
+        cJSON* addr = cJSON_GetArrayItem(cycle_element, 0);
+        cJSON* val = cJSON_GetArrayItem(cycle_element, 1);
+        cJSON* type = cJSON_GetArrayItem(cycle_element, 2);
+
+        if(access->addr != addr->valueint || access->val != val->valueint || access->write != (strcmp(type->valuestring, "write") == 0))
+            res = 1;
+    }
+#endif
+
+    cJSON_Delete(root);
+
+    return res;
 }
 
 // // Test a single opcode with all 10,000 tests
@@ -151,12 +242,16 @@ u8 test_opcode_single(emulator_t* emulator, const char* path, u16 test_idx) {
 void test_all_opcodes(emulator_t* emulator) {
     FILE* file = fopen("logs/log.txt", "w+");
     
+    // Passed, failed and skipped
+    u32 counts[3] = {0};
+
     char path[32];
     for(u16 i = 0; i <= 0xFF; i++)
     {
-        snprintf(path, 32, "SingleStepTestsNES/%02x.json", i);
+        snprintf(path, 32, TESTS_DIR "/%02x.json", i);
 
         u8 res = test_opcode_single(emulator, path, (u16)i);
+        ++counts[res];
 
         fprintf(file, "%X: ", i);
 
@@ -168,11 +263,14 @@ void test_all_opcodes(emulator_t* emulator) {
                 fprintf(file, "FAIL\n");
                 break;
             case 2:
-                fprintf(file, "ILLEGAL\n");
+                fprintf(file, "JAM (skipped)\n");
                 break;
         }
     }
 
+    fprintf(file, "%u passed, %u failed, %u skipped\n", counts[0], counts[1], counts[2]);
+    printf("%u passed, %u failed, %u skipped\n", counts[0], counts[1], counts[2]);
+
     fclose(file);
 }
 
@@ -184,16 +282,181 @@ void draw_cpu(emulator_t* emulator) {
     printw("Y: %X\n", emulator->cpu.y);
     printw("SP: %X\n", emulator->cpu.sp);
     printw("PC: %X\n", emulator->cpu.pc);
+#ifdef M6502_TRACE
+    printw("TRACE: %s\n", emulator->cpu.trace ? "on" : "off");
+#endif
+}
+
+#ifdef M6502_PROFILE
+
+static const u32* heat_counts(emulator_t* emulator) {
+    switch(heat_mode) {
+        case HEAT_CYCLES:
+            return emulator->cpu.profile.cycles;
+        case HEAT_READS:
+            return emulator->cpu.profile.reads;
+        case HEAT_WRITES:
+            return emulator->cpu.profile.writes;
+        default:
+            return NULL;
+    }
+}
+
+static u32 heat_bits(u32 count) {
+    u32 bits = 0;
+    for(; count; count >>= 1)
+        ++bits;
+    return bits;
+}
+
+// 0 for untouched bytes, otherwise 1 to HEAT_LEVELS on a log scale up to
+// the hottest byte on screen
+static u32 heat_level(u32 count, u32 max) {
+    if(count == 0)
+        return 0;
+
+    return 1 + (heat_bits(count) - 1) * HEAT_LEVELS / heat_bits(max);
+}
+
+static void heat_init(void) {
+    if(!has_colors())
+        return;
+
+    start_color();
+    init_pair(1, COLOR_BLUE, COLOR_BLACK);
+    init_pair(2, COLOR_CYAN, COLOR_BLACK);
+    init_pair(3, COLOR_GREEN, COLOR_BLACK);
+    init_pair(4, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(5, COLOR_RED, COLOR_BLACK);
 }
 
+static void save_profile(emulator_t* emulator) {
+    cpu_profile_save(&emulator->cpu, "logs/profile.bin");
+
+    char* json = cpu_profile_to_json(&emulator->cpu, PROFILE_TOP);
+    if(!json)
+        return;
+
+    FILE* file = fopen("logs/profile.json", "w");
+    if(file) {
+        fputs(json, file);
+        fclose(file);
+    }
+
+    free(json);
+}
+
+#endif
+
+#ifdef M6502_TRACE
+
+// Start or stop recording to logs/trace.bin, bus accesses included
+static void toggle_trace(emulator_t* emulator) {
+    trace_t* trace = emulator->cpu.trace;
+
+    if(trace) {
+        emulator->cpu.trace = NULL;
+        trace_close(trace);
+        return;
+    }
+
+    emulator->cpu.trace = trace_open("logs/trace.bin", TRACE_CAPACITY, 1);
+}
+
+#endif
+
+#ifdef M6502_DEBUG
+
+static void draw_breakpoints(emulator_t* emulator) {
+    const cpu_debug_t* debug = &emulator->cpu.debug;
+
+    printw("-- BREAK --\n");
+
+    for(u32 i = 0; i < DEBUG_MAX_BREAKPOINTS; ++i) {
+        const cpu_breakpoint_t* breakpoint = &debug->breakpoints[i];
+        if(breakpoint->kinds == 0)
+            continue;
+
+        printw("%c%c%c %04X", breakpoint->kinds & DEBUG_EXEC ? 'x' : '-', breakpoint->kinds & DEBUG_READ ? 'r' : '-', breakpoint->kinds & DEBUG_WRITE ? 'w' : '-', breakpoint->start);
+        if(breakpoint->end != breakpoint->start)
+            printw("-%04X", breakpoint->end);
+        printw(" hits %u", breakpoint->hits);
+        if(breakpoint->ignore)
+            printw(" (ignore %u)", breakpoint->ignore);
+        printw("%s\n", debug->stopped && debug->stop_index == i ? " <-" : "");
+    }
+
+    if(debug->stopped && debug->stop_kind != DEBUG_EXEC)
+        printw("%s %04X = %02X\n", debug->stop_kind == DEBUG_READ ? "read" : "write", debug->stop_addr, debug->stop_val);
+}
+
+// Ask for "addr [ignore]" in hex and decimal on the bottom line, and add
+// a breakpoint of kind there, or remove the one already there
+static void toggle_breakpoint(emulator_t* emulator, u8 kind, const char* label) {
+    unsigned addr = 0, ignore = 0;
+
+    move(LINES - 1, 0);
+    clrtoeol();
+    printw("%s at: ", label);
+
+    echo();
+    const int n = scanw("%x %u", &addr, &ignore);
+    noecho();
+
+    if(n < 1 || addr >= MEM_SIZE)
+        return;
+
+    const int index = cpu_debug_find(&emulator->cpu, kind, addr);
+    if(index >= 0)
+        cpu_debug_remove(&emulator->cpu, index);
+    else
+        cpu_debug_add(&emulator->cpu, kind, addr, 1, NULL, ignore);
+}
+
+// Run until a breakpoint stops the CPU or a key is pressed
+static void run_to_breakpoint(emulator_t* emulator) {
+    nodelay(stdscr, TRUE);
+
+    do {
+        emulator_run_cycles(emulator, DEBUG_SLICE_CYCLES);
+    } while(!emulator->cpu.debug.stopped && getch() == ERR);
+
+    nodelay(stdscr, FALSE);
+}
+
+#endif
+
 void draw_mem(emulator_t* emulator, u16 base_addr) {
     u16 addr = base_addr;
 
+#ifdef M6502_PROFILE
+    const u32* counts = heat_counts(emulator);
+
+    u32 max = 0;
+    for(u32 i = 0; counts && i < MEM_ROWS * MEM_COLS; ++i) {
+        if(counts[(u16)(base_addr + i)] > max)
+            max = counts[(u16)(base_addr + i)];
+    }
+
+    printw("-- MEM (heat: %s) --\n", heat_names[heat_mode]);
+#else
     printw("-- MEM --\n");
+#endif
     for(size_t y = 0; y < MEM_ROWS; ++y) {
         printw("%04X: ", addr);
         for(size_t x = 0; x < MEM_COLS; ++x) {
+#ifdef M6502_PROFILE
+            const u32 level = counts ? heat_level(counts[addr], max) : 0;
+
+            if(level)
+                attron(COLOR_PAIR(level));
+            printw("%02X", emulator->mem[addr]);
+            if(level)
+                attroff(COLOR_PAIR(level));
+            printw(" ");
+#else
             printw("%02X ", emulator->mem[addr]);
+#endif
             ++addr;
         }
         printw("\n");
@@ -210,15 +473,32 @@ int main(int argc, char* argv[]) {
 
     test_all_opcodes(&emulator);
 
+#ifdef M6502_PROFILE
+    // Only profile what runs from here on
+    cpu_profile_clear(&emulator.cpu);
+#endif
+
     initscr();
     noecho();
 
+#ifdef M6502_PROFILE
+    heat_init();
+#endif
+
     u16 addr = 0x0000;
 
+    rewind_t rewind;
+    const _Bool can_rewind = rewind_init(&rewind, REWIND_STEPS, REWIND_ARENA_SIZE, REWIND_INTERVAL);
+    if(can_rewind)
+        rewind_push(&rewind, &emulator);
+
     while(1) {
         clear();
 
         draw_cpu(&emulator);
+#ifdef M6502_DEBUG
+        draw_breakpoints(&emulator);
+#endif
         draw_mem(&emulator, addr);
 
         refresh();
@@ -230,10 +510,55 @@ int main(int argc, char* argv[]) {
         }
 
         if(c == 'd') {
-            do {
-                emulator_run(&emulator);
-            } while(!cpu_is_complete(&emulator.cpu));
+            emulator_run_instructions(&emulator, 1);
+        }
+
+#ifdef M6502_DEBUG
+        if(c == 'c') {
+            run_to_breakpoint(&emulator);
+        }
+
+        if(c == 'b') {
+            toggle_breakpoint(&emulator, DEBUG_EXEC, "break");
+        }
+
+        if(c == 'm') {
+            toggle_breakpoint(&emulator, DEBUG_READ, "watch reads");
+        }
+
+        if(c == 'w') {
+            toggle_breakpoint(&emulator, DEBUG_WRITE, "watch writes");
+        }
+
+        if(c == 'x') {
+            cpu_debug_clear(&emulator.cpu);
+        }
+#endif
+
+        if(can_rewind) {
+            if(c == 's' || c == 'd' || c == 'c')
+                rewind_push(&rewind, &emulator);
+
+            // Back to the state before the last step
+            if(c == 'r')
+                rewind_restore(&rewind, &emulator, 1);
+        }
+
+#ifdef M6502_PROFILE
+        if(c == 'h') {
+            heat_mode = (heat_mode + 1) % NUM_HEAT_MODES;
+        }
+
+        if(c == 'p') {
+            save_profile(&emulator);
+        }
+#endif
+
+#ifdef M6502_TRACE
+        if(c == 't') {
+            toggle_trace(&emulator);
         }
+#endif
 
         if(c == 'q') {
             if(addr > 0) {
@@ -0,0 +1,429 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define _GNU_SOURCE
+
+#include "pool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// =================================================================================
+// QUEUES
+// =================================================================================
+
+// Leaves nothing to clean up when it fails
+static _Bool pool_queue_init(pool_queue_t* queue, u32 capacity) {
+    queue->slots = malloc(capacity * sizeof(pool_session_t*));
+    queue->head = 0;
+    queue->len = 0;
+
+    if(!queue->slots)
+        return 0;
+
+    if(pthread_mutex_init(&queue->lock, NULL) != 0) {
+        free(queue->slots);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void pool_queue_free(pool_queue_t* queue) {
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->slots);
+}
+
+// Returns the length of the queue with session in it
+static u32 pool_queue_push(pool_queue_t* queue, u32 capacity, pool_session_t* session) {
+    pthread_mutex_lock(&queue->lock);
+    queue->slots[(queue->head + queue->len++) % capacity] = session;
+    const u32 len = queue->len;
+    pthread_mutex_unlock(&queue->lock);
+
+    return len;
+}
+
+// The owner takes from the front, so its sessions take turns
+static pool_session_t* pool_queue_pop(pool_queue_t* queue, u32 capacity) {
+    pool_session_t* session = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if(queue->len != 0) {
+        session = queue->slots[queue->head];
+        queue->head = (queue->head + 1) % capacity;
+        --queue->len;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return session;
+}
+
+// Thieves take half from the back, away from where the owner works.
+// Returns how many went into out.
+static u32 pool_queue_steal(pool_queue_t* queue, u32 capacity, pool_session_t** out) {
+    pthread_mutex_lock(&queue->lock);
+
+    const u32 n = (queue->len + 1) / 2;
+    for(u32 i = 0; i < n; ++i)
+        out[i] = queue->slots[(queue->head + queue->len - n + i) % capacity];
+    queue->len -= n;
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return n;
+}
+
+// =================================================================================
+// WORKERS
+// =================================================================================
+
+// Wake an idle worker after queueing a session it could take. The fence
+// orders the push before the load, pool_idle registers before it looks.
+static void pool_notify(pool_t* pool) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&pool->idle, __ATOMIC_RELAXED) == 0)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    ++pool->work_seq;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Refill an empty queue from the other workers, starting with the next one.
+// Returns a session to run, with the rest of the loot queued.
+static pool_session_t* pool_steal(pool_worker_t* worker, pool_session_t** loot) {
+    pool_t* pool = worker->pool;
+
+    for(u32 i = 1; i < pool->num_workers; ++i) {
+        pool_worker_t* victim = &pool->workers[(worker->index + i) % pool->num_workers];
+
+        const u32 n = pool_queue_steal(&victim->queue, pool->max_sessions, loot);
+        if(n == 0)
+            continue;
+
+        u32 len = 0;
+        for(u32 j = 1; j < n; ++j)
+            len = pool_queue_push(&worker->queue, pool->max_sessions, loot[j]);
+
+        // Pass on what is more than this worker needs to other idle ones
+        if(len > 1)
+            pool_notify(pool);
+
+        __atomic_store_n(&worker->steals, worker->steals + 1, __ATOMIC_RELAXED);
+
+        return loot[0];
+    }
+
+    return NULL;
+}
+
+// Hand a session the host wants stopped back to it. Returns 0 if it was
+// resumed in the meantime and should run after all.
+static _Bool pool_park(pool_t* pool, pool_session_t* session) {
+    pthread_mutex_lock(&pool->lock);
+
+    const _Bool park = session->want != POOL_RUN;
+    if(park) {
+        session->parked = 1;
+        pthread_cond_broadcast(&pool->parked);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return park;
+}
+
+// Sleep until pool_notify, unless a last look at the queues turns up a
+// session. Registering as idle first means a push racing with that look
+// always wakes someone. Returns the session found, if any.
+static pool_session_t* pool_idle(pool_worker_t* worker, pool_session_t** loot) {
+    pool_t* pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    const u32 seq = pool->work_seq;
+    __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_session_t* session = pool_queue_pop(&worker->queue, pool->max_sessions);
+    if(!session)
+        session = pool_steal(worker, loot);
+
+    pthread_mutex_lock(&pool->lock);
+    while(!session && pool->work_seq == seq && !__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+        pthread_cond_wait(&pool->work, &pool->lock);
+    __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->lock);
+
+    return session;
+}
+
+static void* pool_work(void* ctx) {
+    pool_worker_t* worker = ctx;
+    pool_t* pool = worker->pool;
+
+    pool_session_t** loot = malloc(pool->max_sessions * sizeof(pool_session_t*));
+    if(!loot)
+        return NULL;
+
+    while(!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+        pool_session_t* session = pool_queue_pop(&worker->queue, pool->max_sessions);
+
+        if(!session)
+            session = pool_steal(worker, loot);
+
+        if(!session)
+            session = pool_idle(worker, loot);
+
+        if(!session)
+            continue;
+
+        if(__atomic_load_n(&session->want, __ATOMIC_ACQUIRE) != POOL_RUN && pool_park(pool, session))
+            continue;
+
+        const u32 cycles = emulator_run_cycles(&session->emulator, pool->quantum);
+
+        session->cycles += cycles;
+        __atomic_store_n(&worker->cycles, worker->cycles + cycles, __ATOMIC_RELAXED);
+
+        // With more than the session just run queued, a thief could help
+        if(pool_queue_push(&worker->queue, pool->max_sessions, session) > 1)
+            pool_notify(pool);
+    }
+
+    free(loot);
+
+    return NULL;
+}
+
+// Set up attr so that the thread starts out on its core, instead of
+// moving there after it may already have run
+static void pool_pin(pthread_attr_t* attr, u32 index) {
+#ifdef __linux__
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % (cores > 0 ? cores : 1), &set);
+
+    pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+#endif
+}
+
+// Join the workers up to started and free everything. num_workers is how
+// many queues were set up.
+static void pool_stop(pool_t* pool, u32 started) {
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(u32 i = 0; i < started; ++i)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for(u32 i = 0; i < pool->num_workers; ++i)
+        pool_queue_free(&pool->workers[i].queue);
+
+    for(u32 i = 0; i < pool->num_sessions; ++i) {
+        cpu_release(&pool->sessions[i]->emulator.cpu);
+        free(pool->sessions[i]);
+    }
+
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->parked);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->sessions);
+    free(pool->workers);
+
+    memset(pool, 0, sizeof(pool_t));
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+_Bool pool_init(pool_t* pool, u32 num_workers, u32 max_sessions, u32 quantum, _Bool affinity) {
+    memset(pool, 0, sizeof(pool_t));
+
+    if(num_workers == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cores > 0 ? cores : 1;
+    }
+
+    pool->quantum = quantum;
+    pool->max_sessions = max_sessions;
+
+    pool->sessions = malloc(max_sessions * sizeof(pool_session_t*));
+    pool->workers = aligned_alloc(64, num_workers * sizeof(pool_worker_t));
+
+    // Only tear down what got set up
+    _Bool ok = pool->sessions && pool->workers && pthread_mutex_init(&pool->lock, NULL) == 0;
+
+    if(ok && pthread_cond_init(&pool->parked, NULL) != 0) {
+        pthread_mutex_destroy(&pool->lock);
+        ok = 0;
+    }
+
+    if(ok && pthread_cond_init(&pool->work, NULL) != 0) {
+        pthread_cond_destroy(&pool->parked);
+        pthread_mutex_destroy(&pool->lock);
+        ok = 0;
+    }
+
+    if(!ok) {
+        free(pool->sessions);
+        free(pool->workers);
+        return 0;
+    }
+
+    memset(pool->workers, 0, num_workers * sizeof(pool_worker_t));
+
+    // Every queue has to exist before the first worker goes stealing
+    u32 queues = 0;
+    for(; queues < num_workers; ++queues) {
+        pool->workers[queues].pool = pool;
+        pool->workers[queues].index = queues;
+
+        if(!pool_queue_init(&pool->workers[queues].queue, max_sessions))
+            break;
+    }
+
+    pool->num_workers = queues;
+
+    u32 started = 0;
+    for(; queues == num_workers && started < num_workers; ++started) {
+        pool_worker_t* worker = &pool->workers[started];
+
+        pthread_attr_t attr;
+        if(pthread_attr_init(&attr) != 0)
+            break;
+
+        if(affinity)
+            pool_pin(&attr, started);
+
+        const int err = pthread_create(&worker->thread, &attr, pool_work, worker);
+        pthread_attr_destroy(&attr);
+
+        if(err != 0)
+            break;
+    }
+
+    if(started < num_workers) {
+        pool_stop(pool, started);
+        return 0;
+    }
+
+    return 1;
+}
+
+void pool_destroy(pool_t* pool) {
+    pool_stop(pool, pool->num_workers);
+}
+
+pool_session_t* pool_add(pool_t* pool) {
+    pool_session_t* session = malloc(sizeof(pool_session_t));
+    if(!session)
+        return NULL;
+
+    emulator_init(&session->emulator);
+    session->want = POOL_PAUSE;
+    session->parked = 1;
+    session->cycles = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(pool->num_sessions == pool->max_sessions) {
+        pthread_mutex_unlock(&pool->lock);
+        free(session);
+        return NULL;
+    }
+
+    session->slot = pool->num_sessions;
+    pool->sessions[pool->num_sessions++] = session;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return session;
+}
+
+void pool_pause(pool_t* pool, pool_session_t* session, _Bool wait) {
+    pthread_mutex_lock(&pool->lock);
+
+    __atomic_store_n(&session->want, POOL_PAUSE, __ATOMIC_RELEASE);
+
+    while(wait && !session->parked)
+        pthread_cond_wait(&pool->parked, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_resume(pool_t* pool, pool_session_t* session) {
+    pthread_mutex_lock(&pool->lock);
+
+    __atomic_store_n(&session->want, POOL_RUN, __ATOMIC_RELEASE);
+
+    // Still in a queue if a worker has not got round to parking it
+    const _Bool queue = session->parked;
+    session->parked = 0;
+
+    const u32 index = pool->next_worker++ % pool->num_workers;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if(queue) {
+        pool_queue_push(&pool->workers[index].queue, pool->max_sessions, session);
+        pool_notify(pool);
+    }
+}
+
+void pool_remove(pool_t* pool, pool_session_t* session) {
+    pthread_mutex_lock(&pool->lock);
+
+    __atomic_store_n(&session->want, POOL_REMOVE, __ATOMIC_RELEASE);
+
+    while(!session->parked)
+        pthread_cond_wait(&pool->parked, &pool->lock);
+
+    pool_session_t* last = pool->sessions[--pool->num_sessions];
+    pool->sessions[session->slot] = last;
+    last->slot = session->slot;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    cpu_release(&session->emulator.cpu);
+    free(session);
+}
+
+u64 pool_cycles(const pool_t* pool) {
+    u64 cycles = 0;
+
+    for(u32 i = 0; i < pool->num_workers; ++i)
+        cycles += __atomic_load_n(&pool->workers[i].cycles, __ATOMIC_RELAXED);
+
+    return cycles;
+}
+
+u64 pool_steals(const pool_t* pool) {
+    u64 steals = 0;
+
+    for(u32 i = 0; i < pool->num_workers; ++i)
+        steals += __atomic_load_n(&pool->workers[i].steals, __ATOMIC_RELAXED);
+
+    return steals;
+}
@@ -0,0 +1,122 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Many independent machines on a few threads. Each worker owns a queue of
+// sessions and runs them round-robin, one quantum of cycles at a time.
+// A worker whose queue runs dry steals half of another worker's queue, so
+// load evens out without any central lock on the hot path.
+
+#ifndef M6502_POOL_H
+#define M6502_POOL_H
+
+#include <pthread.h>
+
+#include "emulator.h"
+
+typedef enum pool_want {
+    POOL_RUN,
+    POOL_PAUSE,
+    POOL_REMOVE,
+} pool_want_t;
+
+typedef struct pool_session {
+    emulator_t emulator;
+
+    // What the host asked for, checked by the workers between quanta
+    u32 want;
+
+    // In no queue and not running, so the host owns the emulator. Changed
+    // under the pool lock.
+    _Bool parked;
+
+    // Index in pool_t::sessions
+    u32 slot;
+
+    // Cycles the pool ran, written only by the worker holding the session
+    u64 cycles;
+} pool_session_t;
+
+// Ring of sessions, big enough for every session in the pool
+typedef struct pool_queue {
+    pthread_mutex_t lock;
+    pool_session_t** slots;
+    u32 head;
+    u32 len;
+} pool_queue_t;
+
+typedef struct pool_worker {
+    struct pool* pool;
+    pthread_t thread;
+    u32 index;
+
+    pool_queue_t queue;
+
+    // Read by pool_cycles and pool_steals from other threads
+    u64 cycles;
+    u64 steals;
+} __attribute__((aligned(64))) pool_worker_t;
+
+typedef struct pool {
+    pool_worker_t* workers;
+    u32 num_workers;
+
+    u32 quantum;
+
+    // Every session, running or parked, under lock
+    pthread_mutex_t lock;
+    pthread_cond_t parked;
+    pool_session_t** sessions;
+    u32 num_sessions;
+    u32 max_sessions;
+
+    // Where the next resumed session is queued
+    u32 next_worker;
+
+    // Workers with nothing to run sleep on work until pool_notify bumps
+    // work_seq. idle counts them so that pushes only notify when needed.
+    pthread_cond_t work;
+    u32 work_seq;
+    u32 idle;
+
+    u32 stop;
+} pool_t;
+
+// Start num_workers threads, or one per online core if 0, that run up to
+// max_sessions sessions quantum cycles at a time. With affinity each worker
+// is pinned to a core (Linux only). Returns 0 on failure.
+_Bool pool_init(pool_t* pool, u32 num_workers, u32 max_sessions, u32 quantum, _Bool affinity);
+
+// Stop the workers and free every session
+void pool_destroy(pool_t* pool);
+
+// A new session, initialized with emulator_init and parked so the host
+// can load it. NULL if the pool is full or allocation fails.
+pool_session_t* pool_add(pool_t* pool);
+
+// Stop running session after its current quantum. With wait, block until
+// it is parked and its emulator can be touched.
+void pool_pause(pool_t* pool, pool_session_t* session, _Bool wait);
+
+// Queue a paused or newly added session again
+void pool_resume(pool_t* pool, pool_session_t* session);
+
+// Wait for the session to park, then free it
+void pool_remove(pool_t* pool, pool_session_t* session);
+
+// Totals over all workers, for aggregate emulated clock rates
+u64 pool_cycles(const pool_t* pool);
+u64 pool_steals(const pool_t* pool);
+
+#endif //M6502_POOL_H
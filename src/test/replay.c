@@ -0,0 +1,382 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every event starts with a tag byte: the kind in the low 2 bits and, for
+// interrupts, the cycles since the interrupt before in the high 6.
+// REPLAY_LONG_DELTA there means the rest follows as a length, 7 bits per
+// byte, low bits first. Reads are only keyed by their order, so their high
+// bits are 0. A read at the same address as the read before only stores
+// its value.
+#define REPLAY_KIND_BITS 2
+#define REPLAY_KIND_MASK 0x03
+#define REPLAY_LONG_DELTA 0x3F
+
+// Tag, a 64-bit length, an address and a value
+#define REPLAY_MAX_EVENT 14
+
+#define REPLAY_EVENTS_OFFSET (sizeof(replay_header_t) + EMULATOR_SNAPSHOT_SIZE)
+
+typedef enum replay_kind {
+    REPLAY_READ,
+    REPLAY_READ_AGAIN,
+    REPLAY_IRQ,
+    REPLAY_NMI,
+} replay_kind_t;
+
+typedef struct replay_event {
+    u8 kind;
+    u8 val;
+    u16 addr;
+    u64 cycle;
+} replay_event_t;
+
+// =================================================================================
+// RECORDING
+// =================================================================================
+
+static void replay_flush(replay_t* replay) {
+    if(replay->used != 0)
+        fwrite(replay->buffer, 1, replay->used, replay->file);
+
+    replay->used = 0;
+}
+
+static void replay_put(replay_t* replay, replay_kind_t kind, u16 addr, u8 val) {
+    if(replay->used > REPLAY_BUFFER_SIZE - REPLAY_MAX_EVENT)
+        replay_flush(replay);
+
+    u8* out = replay->buffer + replay->used;
+
+    // sched.now only moves between batches, so it only tells interrupts
+    // apart, which are raised between them
+    u64 delta = 0;
+    if(kind == REPLAY_IRQ || kind == REPLAY_NMI) {
+        const u64 now = replay->emulator->sched.now;
+        delta = now - replay->last;
+        replay->last = now;
+    }
+
+    if(delta < REPLAY_LONG_DELTA) {
+        *out++ = kind | delta << REPLAY_KIND_BITS;
+    } else {
+        *out++ = kind | REPLAY_LONG_DELTA << REPLAY_KIND_BITS;
+
+        for(delta -= REPLAY_LONG_DELTA; delta >= 0x80; delta >>= 7)
+            *out++ = (u8)delta | 0x80;
+        *out++ = (u8)delta;
+    }
+
+    if(kind == REPLAY_READ) {
+        *out++ = addr & 0xFF;
+        *out++ = addr >> 8;
+        replay->last_addr = addr;
+    }
+
+    if(kind == REPLAY_READ || kind == REPLAY_READ_AGAIN)
+        *out++ = val;
+
+    replay->used = out - replay->buffer;
+    ++replay->events;
+}
+
+// =================================================================================
+// PLAYBACK
+// =================================================================================
+
+// Decode the event at *pos against the cycle and read address before it.
+// Returns 0 at the end of the file, or at an event cut short by a
+// recording that didn't get to finish.
+static _Bool replay_get(const replay_t* replay, const u8** pos, u64* last, u16* addr, replay_event_t* event) {
+    const u8* in = *pos;
+    const u8* end = replay->data + replay->size;
+
+    if(in == end)
+        return 0;
+
+    const u8 tag = *in++;
+    u64 delta = tag >> REPLAY_KIND_BITS;
+
+    if(delta == REPLAY_LONG_DELTA) {
+        u64 rest = 0;
+
+        for(u32 shift = 0; ; shift += 7) {
+            if(in == end || shift >= 64)
+                return 0;
+
+            const u8 byte = *in++;
+            rest |= (u64)(byte & 0x7F) << shift;
+
+            if(!(byte & 0x80))
+                break;
+        }
+
+        delta += rest;
+    }
+
+    event->kind = tag & REPLAY_KIND_MASK;
+    event->cycle = *last + delta;
+    event->addr = *addr;
+
+    if(event->kind == REPLAY_READ) {
+        if(end - in < 2)
+            return 0;
+
+        event->addr = in[0] | in[1] << 8;
+        in += 2;
+    }
+
+    if(event->kind == REPLAY_READ || event->kind == REPLAY_READ_AGAIN) {
+        if(in == end)
+            return 0;
+
+        event->val = *in++;
+    }
+
+    *pos = in;
+    *last = event->cycle;
+    *addr = event->addr;
+
+    return 1;
+}
+
+static void replay_interrupt(sched_t* sched, void* ctx, u64 deadline);
+
+// Find the next interrupt and have the scheduler raise it
+static void replay_schedule(replay_t* replay) {
+    replay->interrupt_event = 0;
+
+    replay_event_t event;
+    while(replay_get(replay, &replay->interrupt_pos, &replay->interrupt_last, &replay->interrupt_addr, &event)) {
+        if(event.kind != REPLAY_IRQ && event.kind != REPLAY_NMI)
+            continue;
+
+        replay->interrupt_kind = event.kind;
+        replay->interrupt_event = sched_add(&replay->emulator->sched, event.cycle, replay_interrupt, replay);
+
+        if(replay->interrupt_event == 0)
+            replay->diverged = 1;
+
+        return;
+    }
+}
+
+static void replay_interrupt(sched_t* sched, void* ctx, u64 deadline) {
+    replay_t* replay = (replay_t*)ctx;
+
+    // The CPU only stops between instructions, so it has to land on the
+    // same cycle as when this was recorded
+    if(sched->now != deadline)
+        replay->diverged = 1;
+
+    // Every read recorded before the interrupt has to be used up, then the
+    // reads carry on after it
+    u64 cycle;
+    replay_event_t event;
+    if(!replay_get(replay, &replay->read_pos, &cycle, &replay->read_addr, &event) || event.kind != replay->interrupt_kind)
+        replay->diverged = 1;
+
+    if(replay->interrupt_kind == REPLAY_IRQ)
+        cpu_irq(sched->cpu);
+    else
+        cpu_nmi(sched->cpu);
+
+    ++replay->events;
+
+    replay_schedule(replay);
+}
+
+// =================================================================================
+// BUS
+// =================================================================================
+
+static u8 replay_read_bus(void* ctx, const u16 addr) {
+    replay_t* replay = (replay_t*)ctx;
+
+    if(replay->mode == REPLAY_RECORD) {
+        const u8 val = replay->read_bus(replay->bus, addr);
+        replay_put(replay, addr == replay->last_addr ? REPLAY_READ_AGAIN : REPLAY_READ, addr, val);
+        return val;
+    }
+
+    // The next read in the log has to be this one. Interrupts are passed
+    // by replay_interrupt, so running into one means this read came after
+    // it when recording.
+    u64 cycle;
+    replay_event_t event;
+    const u8* pos = replay->read_pos;
+    u16 last_addr = replay->read_addr;
+
+    if(!replay->diverged && replay_get(replay, &pos, &cycle, &last_addr, &event)
+        && (event.kind == REPLAY_READ || event.kind == REPLAY_READ_AGAIN) && event.addr == addr) {
+        replay->read_pos = pos;
+        replay->read_addr = last_addr;
+        ++replay->events;
+        return event.val;
+    }
+
+    // Off the recording, so the device is all that's left to ask
+    replay->diverged = 1;
+    return replay->read_bus(replay->bus, addr);
+}
+
+static void replay_write_bus(void* ctx, const u16 addr, const u8 val) {
+    replay_t* replay = (replay_t*)ctx;
+    replay->write_bus(replay->bus, addr, val);
+}
+
+// Route the CPU's bus callbacks through the replay
+static void replay_attach(replay_t* replay, emulator_t* emulator, replay_mode_t mode) {
+    replay->emulator = emulator;
+    replay->mode = mode;
+    replay->events = 0;
+    replay->diverged = 0;
+
+    replay->bus = emulator->cpu.bus;
+    replay->read_bus = emulator->cpu.read_bus;
+    replay->write_bus = emulator->cpu.write_bus;
+
+    emulator->cpu.bus = replay;
+    emulator->cpu.read_bus = replay_read_bus;
+    emulator->cpu.write_bus = replay_write_bus;
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+_Bool replay_record(replay_t* replay, emulator_t* emulator, const char* path) {
+    memset(replay, 0, sizeof(replay_t));
+
+    replay->buffer = malloc(REPLAY_BUFFER_SIZE);
+    u8* snapshot = malloc(EMULATOR_SNAPSHOT_SIZE);
+    replay->file = fopen(path, "wb");
+
+    const replay_header_t header = {.magic = REPLAY_MAGIC, .version = REPLAY_VERSION};
+
+    _Bool ok = replay->buffer && snapshot && replay->file;
+    if(ok) {
+        emulator_snapshot(emulator, snapshot, EMULATOR_SNAPSHOT_SIZE);
+
+        ok = fwrite(&header, sizeof(header), 1, replay->file) == 1
+            && fwrite(snapshot, 1, EMULATOR_SNAPSHOT_SIZE, replay->file) == EMULATOR_SNAPSHOT_SIZE;
+    }
+
+    free(snapshot);
+
+    if(!ok) {
+        if(replay->file)
+            fclose(replay->file);
+        free(replay->buffer);
+        return 0;
+    }
+
+    replay->last = emulator->sched.now;
+
+    replay_attach(replay, emulator, REPLAY_RECORD);
+
+    return 1;
+}
+
+_Bool replay_play(replay_t* replay, emulator_t* emulator, const char* path) {
+    memset(replay, 0, sizeof(replay_t));
+
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < REPLAY_EVENTS_OFFSET) {
+        close(fd);
+        return 0;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED)
+        return 0;
+
+    replay_header_t header;
+    memcpy(&header, map, sizeof(header));
+
+    if(header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION
+        || !emulator_restore(emulator, (const u8*)map + sizeof(header), EMULATOR_SNAPSHOT_SIZE)) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    replay->data = map;
+    replay->size = st.st_size;
+
+    replay->read_pos = replay->interrupt_pos = replay->data + REPLAY_EVENTS_OFFSET;
+    replay->interrupt_last = emulator->sched.now;
+
+    replay_attach(replay, emulator, REPLAY_PLAY);
+    replay_schedule(replay);
+
+    return 1;
+}
+
+void replay_irq(replay_t* replay) {
+    if(replay->mode != REPLAY_RECORD)
+        return;
+
+    replay_put(replay, REPLAY_IRQ, 0, 0);
+    cpu_irq(&replay->emulator->cpu);
+}
+
+void replay_nmi(replay_t* replay) {
+    if(replay->mode != REPLAY_RECORD)
+        return;
+
+    replay_put(replay, REPLAY_NMI, 0, 0);
+    cpu_nmi(&replay->emulator->cpu);
+}
+
+_Bool replay_close(replay_t* replay) {
+    emulator_t* emulator = replay->emulator;
+
+    emulator->cpu.bus = replay->bus;
+    emulator->cpu.read_bus = replay->read_bus;
+    emulator->cpu.write_bus = replay->write_bus;
+
+    if(replay->mode == REPLAY_PLAY) {
+        if(replay->interrupt_event != 0)
+            sched_cancel(&emulator->sched, replay->interrupt_event);
+
+        munmap((void*)replay->data, replay->size);
+
+        return 1;
+    }
+
+    replay_flush(replay);
+
+    _Bool ok = !ferror(replay->file);
+    if(fclose(replay->file) != 0)
+        ok = 0;
+
+    free(replay->buffer);
+
+    return ok;
+}
@@ -0,0 +1,118 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Record everything from outside the machine that a run depends on, so it
+// can be played back bit-exactly: the starting snapshot, every read that
+// reaches the bus callbacks, which are the device pages left unmapped, and
+// every IRQ and NMI. Interrupts are keyed by the scheduler's master cycle,
+// reads by their order since the interrupt before. Mapped memory never
+// reaches the callbacks, so recording only costs a few bytes per device
+// read and per interrupt, buffered and written in large chunks.
+//
+// Playback feeds the recorded values back instead of calling the device
+// callbacks and raises the recorded interrupts from the scheduler at the
+// cycles they came in at. It needs the same build as the recording, and
+// has to be driven by emulator_run_cycles or sched_run_until so that the
+// CPU stops at those cycles, but the run can be split into batches
+// differently. Writes still go to the host's callbacks.
+// Changes the host makes to memory or registers directly are not
+// recorded.
+
+#ifndef M6502_REPLAY_H
+#define M6502_REPLAY_H
+
+#include "emulator.h"
+
+#define REPLAY_MAGIC 0x4C505236 // "6RPL" in a little-endian dump
+#define REPLAY_VERSION 2
+
+// Recorded events are collected here before they are written
+#define REPLAY_BUFFER_SIZE (64 << 10)
+
+// A replay file is this header, an emulator snapshot of the machine at
+// the start, then the events
+typedef struct replay_header {
+    u32 magic;
+    u16 version;
+    u16 reserved;
+} replay_header_t;
+
+typedef enum replay_mode {
+    REPLAY_RECORD,
+    REPLAY_PLAY,
+} replay_mode_t;
+
+typedef struct replay {
+    emulator_t* emulator;
+    u8 mode;
+
+    // The host's bus callbacks. Reads are recorded from them, writes are
+    // passed through in both modes, and replay_close puts them back.
+    void* bus;
+    u8 (*read_bus)(void* ctx, u16 addr);
+    void (*write_bus)(void* ctx, u16 addr, u8 val);
+
+    // Recording: events not written yet, and the cycle of the last
+    // interrupt and the address of the last read, which the next ones are
+    // encoded against
+    FILE* file;
+    u8* buffer;
+    u32 used;
+    u64 last;
+    u16 last_addr;
+
+    // Playing: the whole file, mapped read-only, with one position for the
+    // reads and one for the interrupts, which looks ahead to schedule them.
+    // Each keeps what its next event is decoded against.
+    const u8* data;
+    size_t size;
+    const u8* read_pos;
+    u16 read_addr;
+    const u8* interrupt_pos;
+    u64 interrupt_last;
+    u16 interrupt_addr;
+    // The scheduler event for the next interrupt, 0 if there is none, and
+    // whether it is an IRQ or an NMI
+    u64 interrupt_event;
+    u8 interrupt_kind;
+
+    // Events recorded or played back
+    u64 events;
+    // Set when playback has gone off the recording: a read at another
+    // address, more reads than were recorded before an interrupt, fewer,
+    // or an interrupt the CPU was not at the recorded cycle for
+    _Bool diverged;
+} replay_t;
+
+// Write a snapshot of the machine to a new file at path and record from
+// here on. The host's bus callbacks have to be in place already. Returns 0
+// if the file can't be written.
+_Bool replay_record(replay_t* replay, emulator_t* emulator, const char* path);
+
+// Restore the machine from the start of a recording at path and play it
+// back from there. Returns 0 and leaves the machine alone if path holds
+// no usable recording.
+_Bool replay_play(replay_t* replay, emulator_t* emulator, const char* path);
+
+// Use these instead of cpu_irq and cpu_nmi while recording. While
+// playing they do nothing, since the recording raises them instead.
+void replay_irq(replay_t* replay);
+void replay_nmi(replay_t* replay);
+
+// Stop, writing out what is left of a recording, and give the CPU its
+// bus callbacks back. Returns 0 if writing the file failed.
+_Bool replay_close(replay_t* replay);
+
+#endif //M6502_REPLAY_H
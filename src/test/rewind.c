@@ -0,0 +1,301 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Equal bytes it takes to end a run of changed ones. Shorter gaps are
+// cheaper to copy than to start a new pair for.
+#define REWIND_MIN_GAP 4
+
+// The most a length can take up in the encoding
+#define REWIND_MAX_LENGTH 5
+
+// What keyframes are XOR'd against
+static const u8 rewind_zeros[EMULATOR_SNAPSHOT_SIZE];
+
+// =================================================================================
+// ENCODING
+// =================================================================================
+
+// An encoded entry is a list of (skip, length) pairs, each followed by
+// length bytes to XOR in after skipping skip unchanged bytes. Lengths take
+// 7 bits per byte, low bits first.
+
+static u8* rewind_put_length(u8* out, u32 n) {
+    while(n >= 0x80) {
+        *out++ = (u8)n | 0x80;
+        n >>= 7;
+    }
+
+    *out++ = (u8)n;
+
+    return out;
+}
+
+static const u8* rewind_get_length(const u8* in, u32* n) {
+    u32 value = 0;
+
+    for(u32 shift = 0; ; shift += 7) {
+        const u8 byte = *in++;
+
+        value |= (u32)(byte & 0x7F) << shift;
+
+        if(!(byte & 0x80))
+            break;
+    }
+
+    *n = value;
+
+    return in;
+}
+
+static inline u64 rewind_load(const u8* p) {
+    u64 word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Encode the XOR of cur and ref into out. Returns the size, which is 0 when
+// nothing changed, or -1 if it would not be smaller than the snapshot itself.
+static int32_t rewind_encode(u8* out, const u8* cur, const u8* ref) {
+    const u32 size = EMULATOR_SNAPSHOT_SIZE;
+    u8* const start = out;
+
+    u32 pos = 0;
+
+    for(;;) {
+        // Unchanged bytes, a word at a time where possible
+        u32 changed = pos;
+        while(changed + sizeof(u64) <= size && rewind_load(cur + changed) == rewind_load(ref + changed))
+            changed += sizeof(u64);
+        while(changed < size && cur[changed] == ref[changed])
+            ++changed;
+
+        if(changed == size)
+            break;
+
+        // Changed bytes up to the next REWIND_MIN_GAP unchanged ones
+        u32 end = changed + 1;
+        u32 gap = 0;
+        for(; end < size && gap < REWIND_MIN_GAP; ++end)
+            gap = cur[end] == ref[end] ? gap + 1 : 0;
+
+        const u32 length = end - gap - changed;
+
+        if((u32)(out - start) + 2 * REWIND_MAX_LENGTH + length >= size)
+            return -1;
+
+        out = rewind_put_length(out, changed - pos);
+        out = rewind_put_length(out, length);
+
+        for(u32 i = 0; i < length; ++i)
+            out[i] = cur[changed + i] ^ ref[changed + i];
+
+        out += length;
+        pos = changed + length;
+    }
+
+    return out - start;
+}
+
+// XOR an encoded entry into snapshot
+static void rewind_apply(u8* snapshot, const u8* in, u32 size) {
+    const u8* const end = in + size;
+
+    u32 pos = 0;
+
+    while(in < end) {
+        u32 skip, length;
+        in = rewind_get_length(in, &skip);
+        in = rewind_get_length(in, &length);
+
+        pos += skip;
+
+        for(u32 i = 0; i < length; ++i)
+            snapshot[pos + i] ^= in[i];
+
+        in += length;
+        pos += length;
+    }
+}
+
+// =================================================================================
+// RING
+// =================================================================================
+
+// The ith entry from the oldest
+static inline rewind_entry_t* rewind_entry(const rewind_t* rewind, u32 i) {
+    return &rewind->entries[(rewind->first + i) % rewind->capacity];
+}
+
+// Deltas are useless without the keyframe before them, so they go with it
+static void rewind_drop_oldest(rewind_t* rewind) {
+    do {
+        rewind->used -= rewind_entry(rewind, 0)->size;
+        rewind->first = (rewind->first + 1) % rewind->capacity;
+        --rewind->count;
+    } while(rewind->count != 0 && rewind_entry(rewind, 0)->kind == REWIND_DELTA);
+}
+
+// Find size bytes in the arena after the newest entry, dropping the oldest
+// until there is room. Returns the offset.
+static u32 rewind_reserve(rewind_t* rewind, u32 size) {
+    if(rewind->count == rewind->capacity)
+        rewind_drop_oldest(rewind);
+
+    while(rewind->count != 0) {
+        const rewind_entry_t* oldest = rewind_entry(rewind, 0);
+        const rewind_entry_t* newest = rewind_entry(rewind, rewind->count - 1);
+        const u32 end = newest->offset + newest->size;
+
+        if(oldest->offset >= end) {
+            // Wrapped around, the room is between the newest and the oldest
+            if(end + size <= oldest->offset)
+                return end;
+        } else {
+            if(end + size <= rewind->arena_size)
+                return end;
+            if(size <= oldest->offset)
+                return 0;
+        }
+
+        rewind_drop_oldest(rewind);
+    }
+
+    return 0;
+}
+
+// =================================================================================
+// API
+// =================================================================================
+
+_Bool rewind_init(rewind_t* rewind, u32 capacity, u32 arena_size, u32 keyframe_interval) {
+    memset(rewind, 0, sizeof(rewind_t));
+
+    if(capacity == 0 || arena_size < EMULATOR_SNAPSHOT_SIZE)
+        return 0;
+
+    rewind->capacity = capacity;
+    rewind->arena_size = arena_size;
+    rewind->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+
+    rewind->entries = malloc(capacity * sizeof(rewind_entry_t));
+    rewind->arena = malloc(arena_size);
+    rewind->last = malloc(EMULATOR_SNAPSHOT_SIZE);
+    rewind->next = malloc(EMULATOR_SNAPSHOT_SIZE);
+    rewind->encoded = malloc(EMULATOR_SNAPSHOT_SIZE);
+
+    if(!rewind->entries || !rewind->arena || !rewind->last || !rewind->next || !rewind->encoded) {
+        rewind_free(rewind);
+        return 0;
+    }
+
+    return 1;
+}
+
+void rewind_free(rewind_t* rewind) {
+    free(rewind->entries);
+    free(rewind->arena);
+    free(rewind->last);
+    free(rewind->next);
+    free(rewind->encoded);
+
+    memset(rewind, 0, sizeof(rewind_t));
+}
+
+void rewind_push(rewind_t* rewind, emulator_t* emulator) {
+    emulator_snapshot(emulator, rewind->next, EMULATOR_SNAPSHOT_SIZE);
+
+    _Bool keyframe = rewind->count == 0 || rewind->since_keyframe + 1 >= rewind->keyframe_interval;
+
+    for(;;) {
+        const int32_t encoded = rewind_encode(rewind->encoded, rewind->next, keyframe ? rewind_zeros : rewind->last);
+        u32 size = encoded;
+        u8 kind = keyframe ? REWIND_KEYFRAME : REWIND_DELTA;
+        const u8* data = rewind->encoded;
+
+        // Too busy to be worth encoding, which is also a keyframe. An
+        // unchanged snapshot is an empty delta.
+        if(encoded < 0) {
+            size = EMULATOR_SNAPSHOT_SIZE;
+            kind = REWIND_RAW;
+            data = rewind->next;
+        }
+
+        const u32 offset = rewind_reserve(rewind, size);
+
+        // Making room took the entries this delta builds on
+        if(kind == REWIND_DELTA && rewind->count == 0) {
+            keyframe = 1;
+            continue;
+        }
+
+        memcpy(rewind->arena + offset, data, size);
+
+        *rewind_entry(rewind, rewind->count++) = (rewind_entry_t){.offset = offset, .size = size, .now = emulator->sched.now, .kind = kind};
+        rewind->used += size;
+        rewind->since_keyframe = kind == REWIND_DELTA ? rewind->since_keyframe + 1 : 0;
+        break;
+    }
+
+    u8* last = rewind->last;
+    rewind->last = rewind->next;
+    rewind->next = last;
+}
+
+_Bool rewind_restore(rewind_t* rewind, emulator_t* emulator, u32 back) {
+    if(back >= rewind->count)
+        return 0;
+
+    const u32 target = rewind->count - 1 - back;
+
+    if(back != 0) {
+        // The oldest entry is always a keyframe
+        u32 key = target;
+        while(rewind_entry(rewind, key)->kind == REWIND_DELTA)
+            --key;
+
+        const rewind_entry_t* entry = rewind_entry(rewind, key);
+
+        if(entry->kind == REWIND_RAW) {
+            memcpy(rewind->next, rewind->arena + entry->offset, EMULATOR_SNAPSHOT_SIZE);
+        } else {
+            memset(rewind->next, 0, EMULATOR_SNAPSHOT_SIZE);
+            rewind_apply(rewind->next, rewind->arena + entry->offset, entry->size);
+        }
+
+        for(u32 i = key + 1; i <= target; ++i) {
+            entry = rewind_entry(rewind, i);
+            rewind_apply(rewind->next, rewind->arena + entry->offset, entry->size);
+        }
+
+        u8* last = rewind->last;
+        rewind->last = rewind->next;
+        rewind->next = last;
+
+        while(rewind->count > target + 1)
+            rewind->used -= rewind_entry(rewind, --rewind->count)->size;
+
+        rewind->since_keyframe = target - key;
+    }
+
+    return emulator_restore(emulator, rewind->last, EMULATOR_SNAPSHOT_SIZE);
+}
+
+u64 rewind_time(const rewind_t* rewind, u32 back) {
+    return back < rewind->count ? rewind_entry(rewind, rewind->count - 1 - back)->now : 0;
+}
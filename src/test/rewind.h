@@ -0,0 +1,83 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Rewind history in a fixed amount of memory. Every keyframe_interval-th
+// snapshot is stored whole, and the ones in between as the XOR against the
+// snapshot before them, run-length encoded so unchanged bytes cost almost
+// nothing. The oldest keyframe and its deltas are dropped together when the
+// arena or the entry ring is full.
+
+#ifndef M6502_REWIND_H
+#define M6502_REWIND_H
+
+#include "emulator.h"
+
+typedef enum rewind_kind {
+    // The whole snapshot, XOR'd against zeros and run-length encoded
+    REWIND_KEYFRAME,
+    // The whole snapshot as is, used when encoding would make it bigger
+    REWIND_RAW,
+    // The XOR against the entry before, run-length encoded
+    REWIND_DELTA,
+} rewind_kind_t;
+
+typedef struct rewind_entry {
+    u32 offset;
+    u32 size;
+    u64 now;
+    u8 kind;
+} rewind_entry_t;
+
+typedef struct rewind {
+    // Ring of entries, oldest at first
+    rewind_entry_t* entries;
+    u32 capacity;
+    u32 first;
+    u32 count;
+
+    // Encoded entries, in the same order as the ring and wrapping to the
+    // start of the arena when one doesn't fit at the end
+    u8* arena;
+    u32 arena_size;
+    u32 used;
+
+    u32 keyframe_interval;
+    u32 since_keyframe;
+
+    // The newest entry in full, the snapshot being pushed, and room for
+    // its encoding. Each holds EMULATOR_SNAPSHOT_SIZE bytes.
+    u8* last;
+    u8* next;
+    u8* encoded;
+} rewind_t;
+
+// Up to capacity entries in arena_size bytes, which has to hold at least
+// one whole snapshot. Returns 0 if allocation fails.
+_Bool rewind_init(rewind_t* rewind, u32 capacity, u32 arena_size, u32 keyframe_interval);
+void rewind_free(rewind_t* rewind);
+
+// Record the machine as the newest entry, dropping the oldest as needed.
+// Costs a snapshot and one pass over it.
+void rewind_push(rewind_t* rewind, emulator_t* emulator);
+
+// Go back to the entry `back` before the newest, which becomes the newest,
+// so everything after it is dropped. Decodes at most one keyframe and
+// keyframe_interval - 1 deltas. Returns 0 if there is no such entry.
+_Bool rewind_restore(rewind_t* rewind, emulator_t* emulator, u32 back);
+
+// sched.now of the entry `back` before the newest, for seeking by time
+u64 rewind_time(const rewind_t* rewind, u32 back);
+
+#endif //M6502_REWIND_H
@@ -0,0 +1,70 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Boots a machine and serves jobs from it with fork_server.h.
+// Usage: 6502_serve socket image [boot_cycles]
+//
+// image is either a snapshot from emulator_save_snapshot, which resumes as
+// saved, or a 64K memory image, which starts from its reset vector. The
+// machine then runs boot_cycles, if given, before the first job.
+
+#include <stdlib.h>
+
+#include "fork_server.h"
+
+// Jobs that can run at once, each in a child forked ahead of time
+#define SERVE_CHILDREN 4
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "Usage: %s socket image [boot_cycles]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[2], "rb");
+    if(!file) {
+        fprintf(stderr, "Could not open %s\n", argv[2]);
+        return 1;
+    }
+    fclose(file);
+
+    static emulator_t emulator;
+    emulator_init(&emulator);
+
+    if(!emulator_restore_file(&emulator, argv[2])) {
+        emulator_load(&emulator, argv[2]);
+        cpu_reset(&emulator.cpu);
+    }
+
+    if(argc > 3) {
+        u64 boot = strtoull(argv[3], NULL, 0);
+
+        while(boot != 0) {
+            const u32 budget = boot > UINT32_MAX ? UINT32_MAX : (u32)boot;
+            const u32 ran = emulator_run_cycles(&emulator, budget);
+            if(ran == 0)
+                break;
+
+            boot -= ran < boot ? ran : boot;
+        }
+    }
+
+    if(!fork_server_serve(&emulator, argv[1], SERVE_CHILDREN, NULL, NULL)) {
+        fprintf(stderr, "Could not serve on %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Copyright (C) 2025 Om Rawaley (@omrawaley)
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Turns a binary trace from trace.h into nestest-style text:
+//
+// C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7
+//
+// Data accesses and interrupts, when recorded, go on lines of their own.
+// Usage: 6502_trace2text trace.bin [out.txt]
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../lib/trace.h"
+
+// =================================================================================
+// DISASSEMBLY
+// =================================================================================
+
+typedef enum trace_mode {
+    TRACE_IMPLICIT,
+    TRACE_ACCUMULATOR,
+    TRACE_IMMEDIATE,
+    TRACE_ZERO_PAGE,
+    TRACE_ZERO_PAGE_X,
+    TRACE_ZERO_PAGE_Y,
+    TRACE_RELATIVE,
+    TRACE_ABSOLUTE,
+    TRACE_ABSOLUTE_X,
+    TRACE_ABSOLUTE_Y,
+    TRACE_INDIRECT,
+    TRACE_INDEXED_INDIRECT,
+    TRACE_INDIRECT_INDEXED,
+} trace_mode_t;
+
+// Operand bytes per mode
+static const u8 mode_sizes[] = {0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1};
+
+typedef struct trace_opcode {
+    const char* name;
+    u8 mode;
+    u1 legal;
+} trace_opcode_t;
+
+#define OPCODE(code, instr, mode, access, cycles, legal) [code] = {#instr, TRACE_##mode, legal},
+static const trace_opcode_t trace_opcodes[256] = {
+#include "../lib/opcodes.h"
+};
+
+// Upper-case mnemonic, dropping the _acc suffix of the accumulator forms
+static void format_mnemonic(char* out, const char* name) {
+    for(size_t i = 0; i < 3 && name[i]; ++i)
+        out[i] = name[i] - 'a' + 'A';
+    out[3] = '\0';
+}
+
+static void format_operand(char* out, size_t size, const trace_record_t* record, u8 mode) {
+    const u8 lo = record->data[1];
+    const u16 word = lo | (record->data[2] << 8);
+
+    switch(mode) {
+        case TRACE_ACCUMULATOR: snprintf(out, size, "A"); break;
+        case TRACE_IMMEDIATE: snprintf(out, size, "#$%02X", lo); break;
+        case TRACE_ZERO_PAGE: snprintf(out, size, "$%02X", lo); break;
+        case TRACE_ZERO_PAGE_X: snprintf(out, size, "$%02X,X", lo); break;
+        case TRACE_ZERO_PAGE_Y: snprintf(out, size, "$%02X,Y", lo); break;
+        case TRACE_RELATIVE: snprintf(out, size, "$%04X", (u16)(record->addr + 2 + (int8_t)lo)); break;
+        case TRACE_ABSOLUTE: snprintf(out, size, "$%04X", word); break;
+        case TRACE_ABSOLUTE_X: snprintf(out, size, "$%04X,X", word); break;
+        case TRACE_ABSOLUTE_Y: snprintf(out, size, "$%04X,Y", word); break;
+        case TRACE_INDIRECT: snprintf(out, size, "($%04X)", word); break;
+        case TRACE_INDEXED_INDIRECT: snprintf(out, size, "($%02X,X)", lo); break;
+        case TRACE_INDIRECT_INDEXED: snprintf(out, size, "($%02X),Y", lo); break;
+        default: out[0] = '\0'; break;
+    }
+}
+
+static void print_registers(FILE* out, const trace_record_t* record) {
+    fprintf(out, "A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n", record->a, record->x, record->y, record->p, record->sp,
+        (unsigned long long)record->cycle);
+}
+
+static void print_instr(FILE* out, const trace_record_t* record) {
+    const trace_opcode_t* opcode = &trace_opcodes[record->data[0]];
+    const u8 size = 1 + mode_sizes[opcode->mode];
+
+    char bytes[16] = "";
+    for(u8 i = 0; i < size; ++i)
+        snprintf(bytes + strlen(bytes), sizeof(bytes) - strlen(bytes), i ? " %02X" : "%02X", record->data[i]);
+
+    char mnemonic[4], operand[16], text[32];
+    format_mnemonic(mnemonic, opcode->name);
+    format_operand(operand, sizeof(operand), record, opcode->mode);
+    snprintf(text, sizeof(text), operand[0] ? "%s %s" : "%s", mnemonic, operand);
+
+    // Undocumented opcodes get a * in front, like in the nestest log
+    fprintf(out, "%04X  %-8s %c%-32s", record->addr, bytes, opcode->legal ? ' ' : '*', text);
+    print_registers(out, record);
+}
+
+// =================================================================================
+// MAIN
+// =================================================================================
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s trace.bin [out.txt]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if(!in) {
+        fprintf(stderr, "Error opening %s\n", argv[1]);
+        return 1;
+    }
+
+    char magic[8];
+    u32 header[2];
+
+    if(fread(magic, 1, 8, in) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0 || fread(header, sizeof(u32), 2, in) != 2) {
+        fprintf(stderr, "%s is not a trace file\n", argv[1]);
+        fclose(in);
+        return 1;
+    }
+
+    if(header[0] != TRACE_VERSION || header[1] != sizeof(trace_record_t)) {
+        fprintf(stderr, "%s is trace version %u with %u-byte records, expected %u and %u\n", argv[1], header[0], header[1],
+            TRACE_VERSION, (u32)sizeof(trace_record_t));
+        fclose(in);
+        return 1;
+    }
+
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if(!out) {
+        fprintf(stderr, "Error opening %s\n", argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    trace_record_t record;
+
+    while(fread(&record, sizeof(trace_record_t), 1, in) == 1) {
+        switch(record.kind) {
+            case TRACE_INSTR:
+                print_instr(out, &record);
+                break;
+            case TRACE_READ:
+                fprintf(out, "      read  $%04X = %02X\n", record.addr, record.data[0]);
+                break;
+            case TRACE_WRITE:
+                fprintf(out, "      write $%04X = %02X\n", record.addr, record.data[0]);
+                break;
+            case TRACE_IRQ:
+            case TRACE_NMI:
+                fprintf(out, "%04X  %-8s  %-32s", record.addr, "", record.kind == TRACE_IRQ ? "-- IRQ --" : "-- NMI --");
+                print_registers(out, &record);
+                break;
+        }
+    }
+
+    fclose(in);
+    if(out != stdout)
+        fclose(out);
+
+    return 0;
+}